@@ -143,6 +143,9 @@ struct	field {
 #define	FIELD_UNIQUE	   0x02 /* this is a unique field */
 #define FIELD_NULL	   0x04 /* can be null */
 #define	FIELD_NOEXPORT	   0x08 /* don't export the field (JSON) */
+#define	FIELD_LAZY	   0x10 /* struct loaded on demand */
+#define	FIELD_CHILDREN	   0x20 /* reverse struct (after link) */
+#define	FIELD_SHARED	   0x40 /* struct de-duplicated in results */
 	TAILQ_ENTRY(field) entries;
 };
 
@@ -170,13 +173,14 @@ TAILQ_HEAD(aliasq, alias);
  * For example, in a chain of "user.company.name", which presumes
  * structures "user" and "company", then a "name" in the latter, the
  * fields would be "user", "company", an "name".
- * These compose search entities, "struct sent".
+ * These compose search entities, "struct sent", and ordering terms,
+ * "struct ord".
  */
 struct	sref {
 	char		 *name; /* field name */
 	struct pos	  pos; /* parse point */
 	struct field	 *field; /* field (after link) */
-	struct sent	 *parent; /* up-reference */
+	struct sent	 *parent; /* up-reference (NULL for ord/fields) */
 	TAILQ_ENTRY(sref) entries;
 };
 
@@ -231,10 +235,38 @@ struct	sent {
 
 TAILQ_HEAD(sentq, sent);
 
+enum	ordtype {
+	ORDTYPE_ASC = 0, /* ascending (default) */
+	ORDTYPE_DESC, /* descending */
+	ORDTYPE__MAX
+};
+
+/*
+ * An ordering term within a search.
+ * For example, in "order user.company.name desc, userid", this would
+ * be one of "user.company.name desc" or "userid".
+ * Like search entities, these are queues of srefs.
+ */
+struct	ord {
+	struct srefq	  srq; /* queue of order fields */
+	struct pos	  pos; /* parse point */
+	struct search	 *parent; /* up-reference */
+	enum ordtype	  op; /* direction */
+	char		 *name; /* sub-structure dot-form name or NULL */
+	char		 *fname; /* canonical dot-form name */
+	struct alias	 *alias; /* resolved alias */
+	TAILQ_ENTRY(ord)  entries;
+};
+
+TAILQ_HEAD(ordq, ord);
+
 enum	stype {
 	STYPE_SEARCH, /* singular response */
 	STYPE_LIST, /* queue of responses */
 	STYPE_ITERATE, /* iterator of responses */
+	STYPE_ARRAY, /* array of responses */
+	STYPE_COUNT, /* number of responses */
+	STYPE_EXISTS, /* whether there are responses */
 };
 
 /*
@@ -246,6 +278,8 @@ enum	stype {
  */
 struct	search {
 	struct sentq	    sntq; /* nested reference chain */
+	struct ordq	    ordq; /* ordering terms */
+	struct srefq	    fq; /* projected fields or empty for all */
 	struct pos	    pos; /* parse point */
 	char		   *name; /* named or NULL */
 	char		   *doc; /* documentation */
@@ -253,6 +287,10 @@ struct	search {
 	enum stype	    type; /* type of search */
 	unsigned int	    flags; 
 #define	SEARCH_IS_UNIQUE    0x01 /* has a rowid or unique somewhere */
+#define	SEARCH_HAS_LIMIT    0x02 /* accepts a limit */
+#define	SEARCH_HAS_OFFSET   0x04 /* accepts an offset */
+#define	SEARCH_HAS_AFTER    0x08 /* accepts a keyset position */
+#define	SEARCH_IS_CACHED    0x10 /* results kept in a row cache */
 	TAILQ_ENTRY(search) entries;
 };
 
@@ -303,12 +341,28 @@ struct	unique {
 
 TAILQ_HEAD(uniqueq, unique);
 
+/*
+ * An index on a structure's columns.
+ * These aren't specified in the configuration: the linker derives them
+ * from the constraints of searches, updates, and deletes.
+ */
+struct	sindex {
+	char		   *name; /* deterministic index name */
+	char		   *cols; /* indexed columns (SQL) */
+	char		   *where; /* partial clause (SQL) or NULL */
+	struct strct	   *parent; /* up-reference */
+	TAILQ_ENTRY(sindex) entries;
+};
+
+TAILQ_HEAD(sindexq, sindex);
+
 /*
  * Type of modifier.
  */
 enum	upt {
 	UP_MODIFY, /* generate an "update" entry */
-	UP_DELETE /* generate a "delete" entry */
+	UP_DELETE, /* generate a "delete" entry */
+	UP_UPSERT /* generate an "upsert" entry */
 };
 
 /*
@@ -321,6 +375,8 @@ struct	update {
 	char		   *name; /* named or NULL */
 	char		   *doc; /* documentation */
 	enum upt	    type; /* type of update */
+	unsigned int	    flags; /* flags (see below) */
+#define	UPDATE_HAS_MANY	    0x01 /* set-based variant */
 	struct strct	   *parent; /* up-reference */
 	TAILQ_ENTRY(update) entries;
 };
@@ -345,22 +401,65 @@ struct	strct {
 	struct aliasq	   aq; /* join aliases */
 	struct updateq	   uq; /* update conditions */
 	struct updateq	   dq; /* delete constraints */
+	struct updateq	   pq; /* upsert conflicts */
 	struct uniqueq	   nq; /* unique constraints */
+	struct sindexq	   ixq; /* derived indexes */
 	unsigned int	   flags;
 #define	STRCT_HAS_QUEUE	   0x01 /* needs a queue interface */
 #define	STRCT_HAS_ITERATOR 0x02 /* needs iterator interface */
 #define	STRCT_HAS_BLOB	   0x04 /* needs resolv.h */
+#define	STRCT_HAS_ARRAY	   0x08 /* needs an array interface */
+#define	STRCT_HAS_BORROW   0x10 /* filled in-place by iterators */
+#define	STRCT_HAS_FILL	   0x20 /* filled by copying searches */
+#define	STRCT_HAS_LAZY	   0x40 /* target of lazy fields */
+#define	STRCT_HAS_LAZY_IN  0x80 /* lazy target loaded in batches */
+#define	STRCT_HAS_SHARED   0x100 /* target of shared fields */
+#define	STRCT_HAS_DEDUP	   0x200 /* fill takes a de-duplication table */
+#define	STRCT_HAS_CACHE	   0x400 /* has a row cache */
+#define	STRCT_HAS_COPY	   0x800 /* copied out of a row cache */
+#define	STRCT_HAS_ACOPY	   0x1000 /* same, but only into arenas */
 	TAILQ_ENTRY(strct) entries;
 };
 
 TAILQ_HEAD(strctq, strct);
 
+/*
+ * Number of rowids bound to each statement loading lazy fields in
+ * batches (STRCT_HAS_LAZY_IN).
+ * This is well under SQLite's default maximum number of parameters.
+ */
+#define	LAZY_BATCH 64
+
+/*
+ * Number of keys bound to each statement of set-based updates and
+ * deletes (UPDATE_HAS_MANY).
+ */
+#define	MANY_BATCH 64
+
+/*
+ * Database settings (in the "database" block), each applied as a
+ * pragma by db_open() when set.
+ * These are in the order they're applied: the page size must be set
+ * before switching to write-ahead logging.
+ */
+enum	pragmat {
+	PRAGMA_PAGESIZE = 0, /* page_size (persistent) */
+	PRAGMA_JOURNAL, /* journal_mode (persistent if wal) */
+	PRAGMA_SYNC, /* synchronous */
+	PRAGMA_CACHESIZE, /* cache_size */
+	PRAGMA_MMAPSIZE, /* mmap_size */
+	PRAGMA_TEMPSTORE, /* temp_store */
+	PRAGMA_BUSYTIMEOUT, /* busy_timeout */
+	PRAGMA__MAX
+};
+
 /*
  * Hold entire parse sequence results.
  */
 struct	config {
 	struct strctq	sq; /* all structures */
 	struct enmq	eq; /* all enumerations */
+	char		*pragmas[PRAGMA__MAX]; /* settings or NULL */
 };
 
 /*
@@ -384,13 +483,16 @@ int		 parse_link(struct config *);
 struct config	*parse_config(FILE *, const char *);
 void		 parse_free(struct config *);
 
-void		 gen_c_header(const struct config *, int, int);
-void		 gen_c_source(const struct strctq *, 
-			int, int, const char *);
-void		 gen_sql(const struct strctq *);
+void		 gen_c_header(const struct config *, 
+			int, int, int, int, int);
+void		 gen_c_metrics(void);
+void		 gen_c_source(const struct config *, 
+			int, int, int, int, int, const char *);
+void		 gen_sql(const struct config *);
 int		 gen_diff(const struct config *,
 			const struct config *);
 void		 gen_javascript(const struct strctq *);
+void		 gen_metrics_structs(void);
 
 void		 print_commentt(size_t, enum cmtt, const char *);
 void		 print_commentv(size_t, enum cmtt, const char *, ...)
@@ -398,15 +500,44 @@ void		 print_commentv(size_t, enum cmtt, const char *, ...)
 
 void		 print_src(size_t, const char *, ...);
 
+void		 print_func_db_arena_alloc(int);
+void		 print_func_db_arena_free(int);
+void		 print_func_db_arena_reset(int);
+void		 print_func_db_busy_expired(int);
+void		 print_func_db_busy_stats(int);
+void		 print_func_db_busy_timeout(int);
 void		 print_func_db_close(int);
+void		 print_func_db_cursor_close(const struct strct *, int);
+void		 print_func_db_cursor_next(const struct strct *, int);
+void		 print_func_db_cursor_open(const struct search *, int);
+void		 print_func_db_deadline(int);
+void		 print_func_db_deadline_expired(int);
+void		 print_func_db_metrics_attach(int);
 void		 print_func_db_open(int);
-void		 print_func_db_insert(const struct strct *, int);
-void		 print_func_db_fill(const struct strct *, int);
+void		 print_func_db_pool_close(int);
+void		 print_func_db_pool_get(int, int);
+void		 print_func_db_pool_metrics_attach(int);
+void		 print_func_db_pool_open(int);
+void		 print_func_db_pool_put(int);
+void		 print_func_db_pool_shm_attach(int);
+void		 print_func_db_insert(const struct strct *, int, int);
+void		 print_func_db_insert_many(const struct strct *, int);
+void		 print_func_db_load(const struct field *, int, int);
+void		 print_func_db_load_array(const struct field *, int, int);
+void		 print_func_db_load_q(const struct field *, int, int);
+void		 print_func_db_fill(const struct strct *, int, int);
 void		 print_func_db_free(const struct strct *, int);
 void		 print_func_db_freeq(const struct strct *, int);
-void		 print_func_db_search(const struct search *, int);
+void		 print_func_db_freearray(const struct strct *, int);
+void		 print_func_db_search(const struct search *, int, int);
+void		 print_func_db_shm_attach(int);
+void		 print_func_db_trans_close(int, int);
+void		 print_func_db_trans_open(int, int);
 void		 print_func_db_unfill(const struct strct *, int);
-void		 print_func_db_update(const struct update *, int);
+void		 print_func_db_unload(int);
+void		 print_func_db_update(const struct update *, int, int);
+void		 print_func_db_update_many(const struct update *, int);
+void		 print_func_db_upsert(const struct update *, int);
 
 void		 print_func_json_array(const struct strct *, int);
 void		 print_func_json_data(const struct strct *, int);
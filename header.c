@@ -40,8 +40,22 @@ gen_strct_field(const struct field *p)
 
 	switch (p->type) {
 	case (FTYPE_STRUCT):
-		printf("\tstruct %s %s;\n", 
-			p->ref->tstrct, p->name);
+		if (FIELD_LAZY & p->flags) {
+			print_commentv(1, COMMENT_C,
+				"Set by db_%s_load_%s() (or NULL).",
+				p->parent->name, p->name);
+			printf("\tstruct %s%s *%s;\n", p->ref->tstrct, 
+				FIELD_CHILDREN & p->flags ? "_q" : "",
+				p->name);
+		} else if (FIELD_SHARED & p->flags) {
+			print_commentt(1, COMMENT_C,
+				"Shared with other results: don't "
+				"modify or free.");
+			printf("\tstruct %s *%s;\n", 
+				p->ref->tstrct, p->name);
+		} else
+			printf("\tstruct %s %s;\n", 
+				p->ref->tstrct, p->name);
 		break;
 	case (FTYPE_REAL):
 		printf("\tdouble\t %s;\n", p->name);
@@ -99,7 +113,7 @@ gen_enum(const struct enm *e)
 /*
  * Generate the C API for a given structure.
  * This generates the TAILQ_ENTRY listing if the structure has any
- * listings declared on it.
+ * listings declared on it, and the array type for any arrays.
  */
 static void
 gen_struct(const struct strct *p)
@@ -133,15 +147,32 @@ gen_struct(const struct strct *p)
 		printf("TAILQ_HEAD(%s_q, %s);\n\n", p->name, p->name);
 	}
 
+	if (STRCT_HAS_ARRAY & p->flags) {
+		print_commentv(0, COMMENT_C, 
+			"Contiguous array of %s for array listings.\n"
+			"There are \"count\" elements in \"items\".",
+			p->name);
+		printf("struct\t%s_array {\n"
+		       "\tsize_t count;\n"
+		       "\tstruct %s *items;\n"
+		       "};\n"
+		       "\n", p->name, p->name);
+	}
+
 	if (STRCT_HAS_ITERATOR & p->flags) {
 		print_commentv(0, COMMENT_C, 
 			"Callback of %s for iteration.\n"
 			"The arg parameter is the opaque pointer "
-			"passed into the iterate function.",
+			"passed into the iterate function.\n"
+			"Return non-zero to stop iterating.",
 			p->name);
-		printf("typedef void (*%s_cb)"
+		printf("typedef int (*%s_cb)"
 		       "(const struct %s *v, void *arg);\n\n", 
 		       p->name, p->name);
+		print_commentv(0, COMMENT_C, 
+			"Opaque cursor over an iterate search "
+			"of %s.", p->name);
+		printf("struct\t%s_cursor;\n\n", p->name);
 	}
 }
 
@@ -196,9 +227,120 @@ gen_func_update(const struct update *up)
 				"\tv%zu: %s", pos++, ref->name);
 
 	print_commentt(0, COMMENT_C_FRAG_CLOSE,
-		"Returns zero on failure, non-zero on "
-		"constraint errors.");
-	print_func_db_update(up, 1);
+		"Returns zero on failure (e.g., constraint errors), "
+		"non-zero on success.");
+	print_func_db_update(up, 0, 1);
+	puts("");
+
+	if (UP_MODIFY == up->type)
+		print_commentv(0, COMMENT_C,
+			"Like the above, but if any rows are updated, "
+			"fill \"p\" with the first\n"
+			"as modified (using RETURNING, needing SQLite "
+			"3.35.0), to be freed\n"
+			"with db_%s_unfill().\n"
+			"Nested structures are filled by re-reading "
+			"the row.\n"
+			"Returns the number of updated rows or <0 on "
+			"constraint errors.",
+			up->parent->name);
+	else
+		print_commentv(0, COMMENT_C,
+			"Like the above, but if any rows are deleted, "
+			"fill \"p\" with the first\n"
+			"as it was (using RETURNING, needing SQLite "
+			"3.35.0), to be freed\n"
+			"with db_%s_unfill().\n"
+			"Nested structures are filled by reading "
+			"the row before it's deleted.\n"
+			"Returns the number of deleted rows or <0 on "
+			"constraint errors.",
+			up->parent->name);
+	print_func_db_update(up, 1, 1);
+	puts("");
+
+	if ( ! (UPDATE_HAS_MANY & up->flags))
+		return;
+
+	pos = 1;
+	TAILQ_FOREACH(ref, &up->mrq, entries)
+		pos++;
+
+	print_commentv(0, COMMENT_C,
+		"Like the first, but constrained by any of the "
+		"\"sz\" values in the array\n"
+		"\"v%zu\", within a single transaction (or "
+		"savepoint, if one is already open).\n"
+		"Values are matched MANY_BATCH (%d) at a time%s\n"
+		"Returns the number of %s rows or <0 on constraint "
+		"errors, in which\n"
+		"case none are modified.",
+		pos, MANY_BATCH, UP_MODIFY == up->type ?
+		", so values should be\n"
+		"distinct for increments and decrements to apply "
+		"once per row." : ".",
+		UP_MODIFY == up->type ? "updated" : "deleted");
+	print_func_db_update_many(up, 1);
+	puts("");
+}
+
+/*
+ * Generate upsert functions for a structure.
+ */
+static void
+gen_func_upsert(const struct update *up)
+{
+	const struct uref *ref;
+	const struct field *f;
+	enum cmtt	 ct = COMMENT_C_FRAG_OPEN;
+	size_t		 pos;
+
+	if (NULL != up->doc) {
+		print_commentt(0, COMMENT_C_FRAG_OPEN, up->doc);
+		print_commentt(0, COMMENT_C_FRAG, "");
+		ct = COMMENT_C_FRAG;
+	}
+
+	print_commentv(0, ct,
+		"Insert a new row into the database as with "
+		"db_%s_insert():", up->parent->name);
+	pos = 1;
+	TAILQ_FOREACH(f, &up->parent->fq, entries) {
+		if (FTYPE_STRUCT == f->type ||
+		    FIELD_ROWID & f->flags)
+			continue;
+		if (FTYPE_PASSWORD == f->type) 
+			print_commentv(0, COMMENT_C_FRAG,
+				"\tv%zu: %s (pre-hashed password)", 
+				pos++, f->name);
+		else
+			print_commentv(0, COMMENT_C_FRAG,
+				"\tv%zu: %s", pos++, f->name);
+	}
+	print_commentt(0, COMMENT_C_FRAG,
+		"If a row already has the same values of:");
+	TAILQ_FOREACH(ref, &up->crq, entries)
+		print_commentv(0, COMMENT_C_FRAG,
+			"\t%s", ref->name);
+	print_commentt(0, COMMENT_C_FRAG,
+		"instead update its fields (in one statement):");
+	TAILQ_FOREACH(ref, &up->mrq, entries)
+		if (MODTYPE_INC == ref->mod)
+			print_commentv(0, COMMENT_C_FRAG,
+				"\t%s (incremented by the new value)", 
+				ref->name);
+		else if (MODTYPE_DEC == ref->mod)
+			print_commentv(0, COMMENT_C_FRAG,
+				"\t%s (decremented by the new value)", 
+				ref->name);
+		else
+			print_commentv(0, COMMENT_C_FRAG,
+				"\t%s", ref->name);
+	print_commentt(0, COMMENT_C_FRAG_CLOSE,
+		"Returns the inserted or updated row's "
+		"identifier on success or <0\n"
+		"otherwise.");
+	print_func_db_upsert(up, 1);
 	puts("");
 }
 
@@ -206,9 +348,10 @@ gen_func_update(const struct update *up)
  * Generate a custom search function declaration.
  */
 static void
-gen_func_search(const struct search *s)
+gen_func_search(const struct search *s, int arena)
 {
 	const struct sent *sent;
+	const struct ord *ord;
 	const struct sref *sr;
 	size_t	 pos = 1;
 
@@ -218,6 +361,14 @@ gen_func_search(const struct search *s)
 		print_commentv(0, COMMENT_C_FRAG_OPEN,
 			"Search for a specific %s.", 
 			s->parent->name);
+	else if (STYPE_COUNT == s->type)
+		print_commentv(0, COMMENT_C_FRAG_OPEN,
+			"Count a set of %s.", 
+			s->parent->name);
+	else if (STYPE_EXISTS == s->type)
+		print_commentv(0, COMMENT_C_FRAG_OPEN,
+			"Test for the existence of a %s.", 
+			s->parent->name);
 	else
 		print_commentv(0, COMMENT_C_FRAG_OPEN,
 			"Search for a set of %s.", 
@@ -245,22 +396,131 @@ gen_func_search(const struct search *s)
 				sent->fname);
 	}
 
-	if (STYPE_SEARCH == s->type)
+	if ( ! TAILQ_EMPTY(&s->ordq)) {
+		print_commentt(0, COMMENT_C_FRAG,
+			"\nResults are ordered by:");
+		TAILQ_FOREACH(ord, &s->ordq, entries)
+			print_commentv(0, COMMENT_C_FRAG,
+				"\t%s (%s)", ord->fname,
+				ORDTYPE_DESC == ord->op ?
+				"descending" : "ascending");
+	}
+
+	if ( ! TAILQ_EMPTY(&s->fq)) {
+		print_commentt(0, COMMENT_C_FRAG,
+			"\nOnly the following fields are filled, "
+			"with the rest (and nested\n"
+			"structures) zeroed:");
+		TAILQ_FOREACH(sr, &s->fq, entries)
+			print_commentv(0, COMMENT_C_FRAG,
+				"\t%s", sr->name);
+	}
+
+	if (SEARCH_HAS_LIMIT & s->flags)
+		print_commentt(0, COMMENT_C_FRAG,
+			"\nThe \"limit\" is the maximum number of "
+			"results (less than zero for no limit).");
+	if (SEARCH_HAS_OFFSET & s->flags)
+		print_commentt(0, COMMENT_C_FRAG,
+			"\nThe \"offset\" is the number of results "
+			"to skip.");
+	if (SEARCH_HAS_AFTER & s->flags)
+		print_commentt(0, COMMENT_C_FRAG,
+			"\nIf \"after\" is not NULL, results start "
+			"after its ordering fields\n"
+			"(e.g., the last result of the prior page); "
+			"otherwise, from the first.");
+
+	if (SEARCH_IS_CACHED & s->flags)
+		print_commentv(0, COMMENT_C_FRAG,
+			"\nThe result is copied from a cache of the "
+			"most recently used rows,\n"
+			"which is flushed by the insert, update, and "
+			"delete functions and\n"
+			"by writes from other connections.");
+
+	if (STYPE_SEARCH == s->type && arena)
+		print_commentv(0, COMMENT_C_FRAG_CLOSE,
+			"Returns a pointer or NULL on fail.\n"
+			"If \"a\" is not NULL, the result is "
+			"allocated from the arena and released\n"
+			"with db_arena_reset(); otherwise, free "
+			"the pointer with db_%s_free().",
+			s->parent->name);
+	else if (STYPE_SEARCH == s->type)
 		print_commentv(0, COMMENT_C_FRAG_CLOSE,
 			"Returns a pointer or NULL on fail.\n"
 			"Free the pointer with db_%s_free().",
 			s->parent->name);
+	else if (STYPE_LIST == s->type && arena)
+		print_commentv(0, COMMENT_C_FRAG_CLOSE,
+			"Returns a queue pointer or NULL if "
+			"interrupted by the deadline.\n"
+			"If \"a\" is not NULL, the queue and its "
+			"members are allocated from the arena\n"
+			"and released with db_arena_reset(); "
+			"otherwise, free this with db_%s_freeq().",
+			s->parent->name);
 	else if (STYPE_LIST == s->type)
 		print_commentv(0, COMMENT_C_FRAG_CLOSE,
-			"Always returns a queue pointer.\n"
+			"Returns a queue pointer or NULL if "
+			"interrupted by the deadline.\n"
 			"Free this with db_%s_freeq().",
 			s->parent->name);
+	else if (STYPE_ARRAY == s->type && arena)
+		print_commentv(0, COMMENT_C_FRAG_CLOSE,
+			"Returns an array pointer or NULL if "
+			"interrupted by the deadline.\n"
+			"If \"a\" is not NULL, the array and its "
+			"members are allocated from the arena\n"
+			"and released with db_arena_reset(); "
+			"otherwise, free this with "
+			"db_%s_freearray().",
+			s->parent->name);
+	else if (STYPE_ARRAY == s->type)
+		print_commentv(0, COMMENT_C_FRAG_CLOSE,
+			"Returns an array pointer or NULL if "
+			"interrupted by the deadline.\n"
+			"Free this with db_%s_freearray().",
+			s->parent->name);
+	else if (STYPE_COUNT == s->type)
+		print_commentt(0, COMMENT_C_FRAG_CLOSE,
+			"Returns the number of matching rows or -1 "
+			"if interrupted by the\n"
+			"deadline.");
+	else if (STYPE_EXISTS == s->type)
+		print_commentt(0, COMMENT_C_FRAG_CLOSE,
+			"Returns non-zero if any row matches, "
+			"zero otherwise, or -1 if\n"
+			"interrupted by the deadline.");
 	else
 		print_commentv(0, COMMENT_C_FRAG_CLOSE,
 			"Invokes the given callback with "
-			"retrieved data.");
+			"retrieved data.\n"
+			"The data is not copied from the database: "
+			"it's only valid within the callback.\n"
+			"Stops when the callback returns non-zero.\n"
+			"Returns zero if interrupted by the deadline, "
+			"non-zero otherwise.");
 
-	print_func_db_search(s, 1);
+	print_func_db_search(s, arena, 1);
+	puts("");
+
+	if (STYPE_ITERATE != s->type)
+		return;
+
+	print_commentv(0, COMMENT_C,
+		"Open a cursor over the results of the "
+		"iterate function above.\n"
+		"Step through the results with "
+		"db_%s_cursor_next() and free the cursor "
+		"with db_%s_cursor_close().\n"
+		"Arguments are not copied: they must remain "
+		"valid until the cursor is closed.\n"
+		"The cursor runs under the deadline in effect "
+		"when it's opened.",
+		s->parent->name, s->parent->name);
+	print_func_db_cursor_open(s, 1);
 	puts("");
 }
 
@@ -268,7 +528,7 @@ gen_func_search(const struct search *s)
  * Generate the function declarations for a given structure.
  */
 static void
-gen_funcs(const struct strct *p, int json, int valids)
+gen_funcs(const struct strct *p, int json, int valids, int arena)
 {
 	const struct search *s;
 	const struct field *f;
@@ -289,13 +549,56 @@ gen_funcs(const struct strct *p, int json, int valids)
 		puts("");
 	}
 
-	print_commentv(0, COMMENT_C, 
-	       "Fill in a %s from an open statement \"stmt\".\n"
-	       "This starts grabbing results from \"pos\", "
-	       "which may be NULL to start from zero.\n"
-	       "This follows DB_SCHEMA_%s's order for columns.",
-	       p->name, p->cname);
-	print_func_db_fill(p, 1);
+	if (STRCT_HAS_ARRAY & p->flags) {
+		print_commentv(0, COMMENT_C,
+		     "Unfill all array members and free the array.\n"
+		     "Has no effect if \"q\" is NULL.");
+		print_func_db_freearray(p, 1);
+		puts("");
+	}
+
+	if (STRCT_HAS_ITERATOR & p->flags) {
+		print_commentv(0, COMMENT_C,
+		     "Get the next result of a cursor or NULL if "
+		     "there are no more results\n"
+		     "or it was interrupted by its deadline, "
+		     "as db_deadline_expired() then tells.\n"
+		     "The result is not copied from the database: "
+		     "it's only valid until the next call to\n"
+		     "db_%s_cursor_next() or db_%s_cursor_close().",
+		     p->name, p->name);
+		print_func_db_cursor_next(p, 1);
+		puts("");
+		print_commentv(0, COMMENT_C,
+		     "Close a cursor, which may be done before "
+		     "all results have been retrieved.\n"
+		     "Has no effect if \"c\" is NULL.");
+		print_func_db_cursor_close(p, 1);
+		puts("");
+	}
+
+	if (arena)
+		print_commentv(0, COMMENT_C, 
+		       "Fill in a %s from an open statement "
+		       "\"stmt\".\n"
+		       "This starts grabbing results from \"pos\", "
+		       "which may be NULL to start from zero.\n"
+		       "This follows DB_SCHEMA_%s's order for "
+		       "columns.\n"
+		       "Memory is allocated from the arena \"a\" "
+		       "or, if NULL, from the heap\n"
+		       "(release it with db_%s_unfill()).",
+		       p->name, p->cname, p->name);
+	else
+		print_commentv(0, COMMENT_C, 
+		       "Fill in a %s from an open statement "
+		       "\"stmt\".\n"
+		       "This starts grabbing results from \"pos\", "
+		       "which may be NULL to start from zero.\n"
+		       "This follows DB_SCHEMA_%s's order for "
+		       "columns.",
+		       p->name, p->cname);
+	print_func_db_fill(p, arena, 1);
 	puts("");
 
 	print_commentt(0, COMMENT_C_FRAG_OPEN,
@@ -319,22 +622,120 @@ gen_funcs(const struct strct *p, int json, int valids)
 	print_commentt(0, COMMENT_C_FRAG_CLOSE,
 		"Returns the new row's identifier on "
 		"success or <0 otherwise.");
-	print_func_db_insert(p, 1);
+	print_func_db_insert(p, 0, 1);
+	puts("");
+
+	print_commentv(0, COMMENT_C,
+		"Like db_%s_insert(), but fill \"p\" with the "
+		"new row (using RETURNING,\n"
+		"needing SQLite 3.35.0), to be freed with "
+		"db_%s_unfill().\n"
+		"Nested structures are filled by re-reading "
+		"the row.\n"
+		"Returns zero on constraint errors (leaving "
+		"\"p\" untouched), non-zero\n"
+		"on success.",
+		p->name, p->name);
+	print_func_db_insert(p, 1, 1);
+	puts("");
+
+	print_commentv(0, COMMENT_C_FRAG_OPEN,
+		"Insert \"sz\" rows from the array \"v\" "
+		"within a single transaction\n"
+		"(or savepoint, if one is already open), "
+		"re-using one statement.\n"
+		"Only native (and non-rowid) fields are used, "
+		"with null fields given by\n"
+		"their \"has_\" flag.");
+	pos = 1;
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_PASSWORD == f->type)
+			print_commentv(0, COMMENT_C_FRAG,
+				"\"pw%zu\" holds the unhashed \"%s\" "
+				"of each row%s,\n"
+				"to be hashed as by db_%s_insert().",
+				pos++, f->name, FIELD_NULL & f->flags ?
+				" (NULL for null)" : "", p->name);
+	print_commentt(0, COMMENT_C_FRAG_CLOSE,
+		"If \"ids\" is not NULL, it's filled with "
+		"the new rows' identifiers, or -1\n"
+		"if none are inserted.\n"
+		"Returns non-zero on success or zero if any "
+		"row violates a constraint,\n"
+		"in which case none are inserted.");
+	print_func_db_insert_many(p, 1);
 	puts("");
 
 	print_commentv(0, COMMENT_C,
-	       "Free memory allocated by db_%s_fill().\n"
+	       "Free memory allocated by db_%s_fill() or the "
+	       "functions filling\n"
+	       "\"p\" with a written row, including nested "
+	       "structures.\n"
 	       "Has not effect if \"p\" is NULL.",
 	       p->name);
 	print_func_db_unfill(p, 1);
 	puts("");
 
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if ( ! (FIELD_LAZY & f->flags))
+			continue;
+		if (FIELD_CHILDREN & f->flags)
+			print_commentv(0, COMMENT_C,
+			       "Load all %s with \"%s\" referring to "
+			       "\"p\", if not already loaded,\n"
+			       "and set them in \"p\".\n"
+			       "They're freed with \"p\" by "
+			       "db_%s_unfill().%s\n"
+			       "Returns the (possibly empty) queue.",
+			       f->ref->tstrct, f->ref->tfield, p->name,
+			       arena ? "\nThey're allocated from the "
+			       "arena \"a\" (which should be that "
+			       "of \"p\")\nor, if NULL, from the "
+			       "heap." : "");
+		else
+			print_commentv(0, COMMENT_C,
+			       "Load the %s referenced by \"%s\" of \"p\", "
+			       "if not already loaded,\n"
+			       "and set it in \"p\".\n"
+			       "Each %s is loaded once per handle and "
+			       "shared until\n"
+			       "db_unload() or db_close(): "
+			       "it must not be freed by the caller.\n"
+			       "Returns the %s or NULL if not found.",
+			       f->ref->tstrct, f->ref->sfield, 
+			       f->ref->tstrct, f->ref->tstrct);
+		print_func_db_load(f, arena, 1);
+		puts("");
+		if (STRCT_HAS_QUEUE & p->flags) {
+			print_commentv(0, COMMENT_C,
+			       "Like db_%s_load_%s() for all members "
+			       "of \"q\", loading those not already "
+			       "loaded\n"
+			       "with one query per %d.",
+			       p->name, f->name, LAZY_BATCH);
+			print_func_db_load_q(f, arena, 1);
+			puts("");
+		}
+		if (STRCT_HAS_ARRAY & p->flags) {
+			print_commentv(0, COMMENT_C,
+			       "Like db_%s_load_%s() for all members "
+			       "of \"q\", loading those not already "
+			       "loaded\n"
+			       "with one query per %d.",
+			       p->name, f->name, LAZY_BATCH);
+			print_func_db_load_array(f, arena, 1);
+			puts("");
+		}
+	}
+
 	TAILQ_FOREACH(s, &p->sq, entries)
-		gen_func_search(s);
+		gen_func_search(s, arena);
 	TAILQ_FOREACH(u, &p->uq, entries)
 		gen_func_update(u);
 	TAILQ_FOREACH(u, &p->dq, entries)
 		gen_func_update(u);
+	TAILQ_FOREACH(u, &p->pq, entries)
+		gen_func_upsert(u);
 
 	if (json) {
 		print_commentv(0, COMMENT_C,
@@ -372,7 +773,9 @@ gen_funcs(const struct strct *p, int json, int valids)
 				"See json_%s_data() for the data.\n"
 				"The \"void\" argument is taken "
 				"to be a kjsonreq as if were invoked "
-				"from an iterator.", p->name);
+				"from an iterator.\n"
+				"Always returns zero (continue "
+				"iterating).", p->name);
 			print_func_json_iterate(p, 1);
 			puts("");
 		}
@@ -400,14 +803,16 @@ static void
 gen_schema(const struct strct *p)
 {
 	const struct field *f;
+	int	 first = 1;
 
 	printf("#define DB_SCHEMA_%s(_x) \\\n", p->cname);
 	TAILQ_FOREACH(f, &p->fq, entries) {
 		if (FTYPE_STRUCT == f->type)
 			continue;
-		printf("\t#_x \".%s\"", f->name);
-		if (TAILQ_NEXT(f, entries))
+		if ( ! first)
 			puts(" \",\" \\");
+		printf("\t#_x \".%s\"", f->name);
+		first = 0;
 	}
 	puts("");
 }
@@ -438,12 +843,17 @@ gen_valid_enums(const struct strct *p)
  * Generate the C header file.
  * If "json" is non-zero, this generates the JSON formatters.
  * If "valids" is non-zero, this generates the field validators.
+ * If "arena" is non-zero, results may be allocated from an arena.
+ * If "pool" is non-zero, this generates the connection pool.
+ * If "metrics" is non-zero, this generates per-statement metrics.
  */
 void
-gen_c_header(const struct config *cfg, int json, int valids)
+gen_c_header(const struct config *cfg, 
+	int json, int valids, int arena, int pool, int metrics)
 {
 	const struct strct *p;
 	const struct enm *e;
+	size_t	 i;
 
 	puts("#ifndef DB_H\n"
 	     "#define DB_H\n"
@@ -495,15 +905,72 @@ gen_c_header(const struct config *cfg, int json, int valids)
 		      "valid_keys[VALID__MAX];");
 	}
 
+	puts("");
+	print_commentt(0, COMMENT_C,
+		"Opaque database handle.\n"
+		"This wraps the ksql(3) connection and a cache of its "
+		"prepared statements.");
+	puts("struct\tkwbp;");
+	puts("");
+	print_commentt(0, COMMENT_C,
+		"Waits for a database locked by other connections, "
+		"as returned by\n"
+		"db_busy_stats().");
+	puts("struct\tkwbp_busystats {\n"
+	     "\tuint64_t waits; /* statements finding it locked */\n"
+	     "\tuint64_t retries; /* retries after waiting */\n"
+	     "\tuint64_t timeouts; /* waits given up */\n"
+	     "\tuint64_t waited; /* total wait (microseconds) */\n"
+	     "};");
+
+	if (arena) {
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Opaque memory arena.\n"
+			"Results of search, list, and array functions may "
+			"be allocated from an arena,\n"
+			"then released all at once with "
+			"db_arena_reset().");
+		puts("struct\tkwbp_arena;");
+	}
+
+	if (pool) {
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Opaque connection pool.\n"
+			"This holds a writer and any number of reader "
+			"handles for use by threads.\n"
+			"The database functions aren't given pool "
+			"variants: check out a handle\n"
+			"and pass it to them.");
+		puts("struct\tkwbp_pool;");
+	}
+
 	puts("\n"
 	     "__BEGIN_DECLS\n"
 	     "");
 
-	print_commentt(0, COMMENT_C,
+	print_commentt(0, COMMENT_C_FRAG_OPEN,
 		"Allocate and open the database in \"file\".\n"
-		"This returns a pointer to the database "
+		"This returns a handle to the database "
 		"in \"safe exit\" mode (see ksql(3)).\n"
-		"It returns NULL on memory allocation failure.\n"
+		"Statements are prepared once per handle, on first use, "
+		"and re-used thereafter.\n"
+		"It returns NULL on memory allocation failure.");
+	for (i = 0; i < PRAGMA__MAX; i++)
+		if (NULL != cfg->pragmas[i])
+			break;
+	if (i < PRAGMA__MAX)
+		print_commentt(0, COMMENT_C_FRAG,
+			"Once opened, the database settings of the "
+			"configuration are applied.");
+	print_commentt(0, COMMENT_C_FRAG,
+		"Busy waits, deadlines, and statement metrics use "
+		"the sqlite3(3)\n"
+		"connection only if the source is compiled with "
+		"DB_SQLITE defined\n"
+		"as an accessor yielding it from the ksql(3) handle.");
+	print_commentt(0, COMMENT_C_FRAG_CLOSE,
 		"The returned pointer must be closed with "
 		"db_close().");
 	print_func_db_open(1);
@@ -511,12 +978,241 @@ gen_c_header(const struct config *cfg, int json, int valids)
 
 	print_commentt(0, COMMENT_C,
 		"Close the database opened by db_open().\n"
+		"This frees all cached statements.\n"
 		"Has no effect if \"p\" is NULL.");
 	print_func_db_close(1);
 	puts("");
 
+	print_commentt(0, COMMENT_C,
+		"Open a transaction for reading (BEGIN DEFERRED) "
+		"or writing (BEGIN\n"
+		"IMMEDIATE, acquiring the write lock up front).\n"
+		"If a transaction is already open, these instead "
+		"open a nested savepoint,\n"
+		"which all subsequent database functions take "
+		"part in.\n"
+		"Returns zero on failure, non-zero on success.");
+	print_func_db_trans_open(0, 1);
+	print_func_db_trans_open(1, 1);
+	puts("");
+
+	print_commentt(0, COMMENT_C,
+		"Commit or roll back the innermost open "
+		"transaction or savepoint.\n"
+		"Returns zero if none is open or on failure, "
+		"non-zero on success.");
+	print_func_db_trans_close(0, 1);
+	print_func_db_trans_close(1, 1);
+	puts("");
+
+	print_commentv(0, COMMENT_C,
+		"Set how long, in milliseconds, statements wait for "
+		"a database locked by\n"
+		"other connections, retrying at random intervals "
+		"increasing from\n"
+		"BUSY_BACKOFF_MIN to BUSY_BACKOFF_MAX microseconds.\n"
+		"Insert, update, delete, and transaction functions "
+		"then fail, returning\n"
+		"-2 if they return identifiers or counts and zero "
+		"otherwise, while\n"
+		"searches fail as usual.\n"
+		"This defaults to %s.",
+		NULL != cfg->pragmas[PRAGMA_BUSYTIMEOUT] ?
+		cfg->pragmas[PRAGMA_BUSYTIMEOUT] : 
+		"BUSY_TIMEOUT (5000)");
+	print_func_db_busy_timeout(1);
+	puts("");
+
+	print_commentt(0, COMMENT_C,
+		"Returns non-zero if the last insert, update, delete, "
+		"or transaction\n"
+		"function failed because the database remained locked "
+		"by other\n"
+		"connections (see db_busy_timeout()), zero otherwise "
+		"(e.g., for\n"
+		"constraint errors).\n"
+		"A transaction whose commit failed this way is still "
+		"open.");
+	print_func_db_busy_expired(1);
+	puts("");
+
+	print_commentt(0, COMMENT_C,
+		"Copy the counts of waits for locks by the handle "
+		"into \"p\".");
+	print_func_db_busy_stats(1);
+	puts("");
+
+	print_commentt(0, COMMENT_C,
+		"Set how long, in milliseconds, each search may run "
+		"before it's\n"
+		"interrupted, or zero (the default) for no limit.\n"
+		"Searches run from within others (e.g., from iterator "
+		"callbacks) share\n"
+		"the outermost search's deadline, which also "
+		"interrupts any writes made\n"
+		"by the callbacks and rolls back their transaction.\n"
+		"Cursors run under the deadline in effect when "
+		"they're opened.\n"
+		"This has no effect unless DB_SQLITE is defined "
+		"(see db_open()).");
+	print_func_db_deadline(1);
+	puts("");
+
+	print_commentt(0, COMMENT_C,
+		"Returns non-zero if the last search (or cursor step) "
+		"was interrupted by\n"
+		"its deadline.\n"
+		"Its result is then NULL for single values, lists, "
+		"arrays, and cursors,\n"
+		"-1 for counts and existence, and zero for "
+		"iterators.");
+	print_func_db_deadline_expired(1);
+	puts("");
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			break;
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Free all structures loaded by the "
+			"db_xxxx_load_yyyy() functions.\n"
+			"Pointers to them (set in or returned to "
+			"the caller) are no longer valid.\n"
+			"Call this at the end of each request so that "
+			"none are stale.");
+		print_func_db_unload(1);
+		puts("");
+	}
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			break;
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Share the row caches of cached searches with "
+			"all processes attached to \"file\",\n"
+			"which is created if it doesn't exist.\n"
+			"Rows are then validated by generation counters "
+			"bumped by the insert,\n"
+			"update, and delete functions instead of by the "
+			"database, so all writers\n"
+			"must be attached.\n"
+			"Returns zero on failure (e.g., if \"file\" was "
+			"created for another\n"
+			"configuration), non-zero on success.");
+		print_func_db_shm_attach(1);
+		puts("");
+	}
+
+	if (metrics) {
+		print_commentt(0, COMMENT_C,
+			"Count the calls, latencies, rows, and bytes "
+			"of each statement, and\n"
+			"the full scans, sorts, and automatic indices "
+			"of its plan, into\n"
+			"\"file\", which is created if it doesn't exist "
+			"and shared by all\n"
+			"processes attaching it.\n"
+			"The slowest runs of each statement are kept "
+			"with their bound\n"
+			"parameters, so the file must be kept private.\n"
+			"Returns zero on failure (e.g., if \"file\" was "
+			"created for different\n"
+			"statements), non-zero on success.");
+		print_func_db_metrics_attach(1);
+		puts("");
+	}
+
+	if (arena) {
+		print_commentt(0, COMMENT_C,
+			"Allocate an empty memory arena.\n"
+			"Returns NULL on memory allocation failure.\n"
+			"The returned pointer must be freed with "
+			"db_arena_free().");
+		print_func_db_arena_alloc(1);
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Release all results allocated from "
+			"the arena.\n"
+			"Its memory is retained for re-use.");
+		print_func_db_arena_reset(1);
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Free the arena and all results allocated "
+			"from it.\n"
+			"Has no effect if \"a\" is NULL.");
+		print_func_db_arena_free(1);
+		puts("");
+	}
+
+	if (pool) {
+		print_commentt(0, COMMENT_C,
+			"Allocate a pool of connections to the database "
+			"in \"file\", each opened\n"
+			"as with db_open(): one writer and \"nreaders\" "
+			"readers, which refuse\n"
+			"writes.\n"
+			"Readers only run alongside the writer if the "
+			"database uses write-ahead\n"
+			"logging (see the \"database\" block).\n"
+			"It returns NULL on failure.\n"
+			"The returned pointer must be closed with "
+			"db_pool_close().");
+		print_func_db_pool_open(1);
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Close the pool opened by db_pool_open() and all "
+			"of its connections,\n"
+			"which must have been returned with "
+			"db_pool_put().\n"
+			"Has no effect if \"pool\" is NULL.");
+		print_func_db_pool_close(1);
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Check out a reader or the writer from the pool, "
+			"waiting until one is\n"
+			"free, for use by the calling thread for one or "
+			"more calls or\n"
+			"transactions.\n"
+			"If the pool has no readers, the writer is used "
+			"for reading.\n"
+			"The returned handle must be returned with "
+			"db_pool_put().");
+		print_func_db_pool_get(0, 1);
+		print_func_db_pool_get(1, 1);
+		puts("");
+		print_commentt(0, COMMENT_C,
+			"Return a handle checked out from the pool, "
+			"first rolling back any\n"
+			"transactions left open.\n"
+			"Has no effect if \"ctx\" is NULL.");
+		print_func_db_pool_put(1);
+		puts("");
+		TAILQ_FOREACH(p, &cfg->sq, entries)
+			if (STRCT_HAS_CACHE & p->flags)
+				break;
+		if (NULL != p) {
+			print_commentt(0, COMMENT_C,
+				"Attach all connections of the pool "
+				"as with db_shm_attach().\n"
+				"Returns zero if any is checked out or "
+				"on failure, non-zero on success.");
+			print_func_db_pool_shm_attach(1);
+			puts("");
+		}
+		if (metrics) {
+			print_commentt(0, COMMENT_C,
+				"Attach all connections of the pool "
+				"as with db_metrics_attach().\n"
+				"Returns zero if any is checked out or "
+				"on failure, non-zero on success.");
+			print_func_db_pool_metrics_attach(1);
+			puts("");
+		}
+	}
+
 	TAILQ_FOREACH(p, &cfg->sq, entries)
-		gen_funcs(p, json, valids);
+		gen_funcs(p, json, valids, arena);
 
 	puts("__END_DECLS\n"
 	     "\n"
@@ -29,10 +29,11 @@ static void
 gen_jsdoc_field(const struct field *f)
 {
 
-	if (FIELD_NOEXPORT & f->flags || FTYPE_BLOB == f->type)
+	if (FIELD_NOEXPORT & f->flags || FTYPE_BLOB == f->type ||
+	    FIELD_CHILDREN & f->flags)
 		return;
 
-	if (FIELD_NULL & f->flags) {
+	if ((FIELD_NULL | FIELD_LAZY | FIELD_SHARED) & f->flags) {
 		print_commentv(2, COMMENT_JS_FRAG,
 			"%s-has-%s: \"hide\" class "
 			"removed if %s not null, otherwise "
@@ -51,7 +52,7 @@ gen_jsdoc_field(const struct field *f)
 			"with %s data%s",
 			f->parent->name, f->name, 
 			f->ref->tstrct, f->name,
-			FIELD_NULL & f->flags ? 
+			(FIELD_NULL | FIELD_LAZY | FIELD_SHARED) & f->flags ? 
 			" (if non-null)" : "");
 	} else {
 		print_commentv(2, COMMENT_JS_FRAG,
@@ -74,10 +75,11 @@ gen_js_field(const struct field *f)
 {
 	size_t	 indent;
 
-	if (FIELD_NOEXPORT & f->flags || FTYPE_BLOB == f->type)
+	if (FIELD_NOEXPORT & f->flags || FTYPE_BLOB == f->type ||
+	    FIELD_CHILDREN & f->flags)
 		return;
 
-	if (FIELD_NULL & f->flags) {
+	if ((FIELD_NULL | FIELD_LAZY | FIELD_SHARED) & f->flags) {
 		indent = 4;
 		printf("\t\t\tif (null === this.obj.%s) {\n"
 		       "\t\t\t\t_hidecl(e, '%s-has-%s');\n"
@@ -112,7 +114,7 @@ gen_js_field(const struct field *f)
 		        f->parent->name, f->name, 
 		        f->ref->tstrct, f->name);
 
-	if (FIELD_NULL & f->flags)
+	if ((FIELD_NULL | FIELD_LAZY | FIELD_SHARED) & f->flags)
 		puts("\t\t\t}");
 }
 
@@ -80,7 +80,8 @@ checktargettype(const struct ref *ref)
 		return(0);
 	}
 
-	if ( ! (FIELD_ROWID & ref->target->flags)) 
+	if ( ! (FIELD_ROWID & ref->target->flags) &&
+	    ! (FIELD_CHILDREN & ref->parent->flags)) 
 		warnx("%s.%s: referenced target %s.%s is not "
 			"a unique field",
 			ref->parent->parent->name,
@@ -91,10 +92,40 @@ checktargettype(const struct ref *ref)
 	return(1);
 }
 
+/*
+ * Whether the struct reference "ref" is a reverse reference, that is,
+ * whether its target field is a foreign key (native or that of a
+ * struct) into its source field.
+ * This is checked by name, as the target may not yet be linked.
+ */
+static int
+checkreverse(const struct ref *ref)
+{
+	const struct field *f;
+
+	TAILQ_FOREACH(f, &ref->target->parent->fq, entries) {
+		if (NULL == f->ref)
+			continue;
+		if (FTYPE_STRUCT == f->type ? 
+		    strcasecmp(f->ref->sfield, ref->target->name) :
+		    f != ref->target)
+			continue;
+		if (0 == strcasecmp(f->ref->tstrct, 
+		     ref->source->parent->name) &&
+		    0 == strcasecmp(f->ref->tfield, 
+		     ref->source->name))
+			return(1);
+	}
+
+	return(0);
+}
+
 /*
  * When we're parsing a structure's reference, we need to create the
  * referring information to the source field, which is the actual
  * reference itself.
+ * Reverse references (see checkreverse()) are instead marked as
+ * children: they're loaded on demand, so they're also lazy.
  * Return zero on failure, non-zero on success.
  */
 static int
@@ -108,6 +139,18 @@ linkref(struct ref *ref)
 	if (FTYPE_STRUCT != ref->parent->type)
 		return(1);
 
+	if ( ! (FIELD_ROWID & ref->target->flags) &&
+	    checkreverse(ref)) {
+		if (FIELD_SHARED & ref->parent->flags) {
+			warnx("%s.%s: reverse reference can't be shared",
+				ref->parent->parent->name,
+				ref->parent->name);
+			return(0);
+		}
+		ref->parent->flags |= FIELD_CHILDREN | FIELD_LAZY;
+		return(1);
+	}
+
 	/*
 	 * If our source field is already a reference, make sure it
 	 * points to the same thing we point to.
@@ -259,7 +302,8 @@ check_recursive(struct ref *ref, const struct strct *check)
 		return(0);
 
 	TAILQ_FOREACH(f, &p->fq, entries)
-		if (FTYPE_STRUCT == f->type)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_CHILDREN & f->flags))
 			if ( ! check_recursive(f->ref, check))
 				return(0);
 
@@ -285,10 +329,78 @@ annotate(struct ref *ref, size_t height, size_t colour)
 	p->height += height;
 
 	TAILQ_FOREACH(f, &p->fq, entries)
-		if (FTYPE_STRUCT == f->type)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_CHILDREN & f->flags))
 			annotate(f->ref, height + 1, colour);
 }
 
+/*
+ * Recursively mark a structure and all of its nested structures with
+ * "flag", which describes how search results are filled.
+ */
+static void
+mark_fill(struct strct *p, unsigned int flag)
+{
+	struct field	*f;
+
+	if (flag & p->flags)
+		return;
+
+	p->flags |= flag;
+
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags))
+			mark_fill(f->ref->target->parent, flag);
+}
+
+/*
+ * Recursively mark a structure copied out of a row cache with "flag",
+ * along with its nested structures.
+ * Shared structures are only copied into arenas (otherwise they're
+ * referenced), so they (and theirs) are marked with STRCT_HAS_ACOPY.
+ */
+static void
+mark_copy(struct strct *p, unsigned int flag)
+{
+	struct field	*f;
+
+	p->flags |= flag;
+
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags))
+			mark_copy(f->ref->target->parent, 
+				FIELD_SHARED & f->flags ?
+				STRCT_HAS_ACOPY : flag);
+}
+
+/*
+ * Mark structures whose fill (including nested fills) reaches a shared
+ * field: these are passed the de-duplication table.
+ * Return non-zero if the structure is so marked.
+ */
+static int
+mark_dedup(struct strct *p)
+{
+	struct field	*f;
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT != f->type ||
+		    FIELD_LAZY & f->flags)
+			continue;
+		if (FIELD_SHARED & f->flags) {
+			f->ref->target->parent->flags |= 
+				STRCT_HAS_SHARED;
+			p->flags |= STRCT_HAS_DEDUP;
+		}
+		if (mark_dedup(f->ref->target->parent))
+			p->flags |= STRCT_HAS_DEDUP;
+	}
+
+	return(STRCT_HAS_DEDUP & p->flags);
+}
+
 /*
  * Resolve a specific update reference by looking it up in our parent
  * structure.
@@ -300,8 +412,8 @@ resolve_uref(struct uref *ref, int crq)
 	struct field	*f;
 	const char	*type;
 
-	type = UP_MODIFY == ref->parent->type ? 
-		"update" : "delete";
+	type = UP_MODIFY == ref->parent->type ? "update" :
+		UP_UPSERT == ref->parent->type ? "upsert" : "delete";
 
 	assert(NULL == ref->field);
 	assert(NULL != ref->parent);
@@ -331,6 +443,8 @@ resolve_uref(struct uref *ref, int crq)
 /*
  * Make sure that our constraint operator is consistent with the type
  * named in the constraint.
+ * While here, mark updates constrained by a single (non-blob) equality
+ * as having set-based variants over arrays of values.
  * Returns zero on failure, non-zero on success.
  * (For the time being, this always returns non-zero.)
  */
@@ -348,6 +462,13 @@ check_updatetype(struct update *up)
 				ref->pos.fname, 
 				ref->pos.line,
 				ref->pos.column);
+
+	ref = TAILQ_FIRST(&up->crq);
+	if (NULL != ref && 
+	    NULL == TAILQ_NEXT(ref, entries) &&
+	    OPTYPE_EQUAL == ref->op &&
+	    FTYPE_BLOB != ref->field->type)
+		up->flags |= UPDATE_HAS_MANY;
 	return(1);
 }
 
@@ -444,6 +565,12 @@ resolve_sref(struct sref *ref, struct strct *s)
 			ref->pos.fname, ref->pos.line,
 			ref->pos.column);
 		return(0);
+	} else if (FIELD_LAZY & f->flags) {
+		warnx("%s:%zu:%zu: search term node field "
+			"is lazy", 
+			ref->pos.fname, ref->pos.line,
+			ref->pos.column);
+		return(0);
 	}
 
 	/* Follow the chain of our reference. */
@@ -470,6 +597,7 @@ parse_cmp(const void *a1, const void *a2)
  * going to see in this structure.
  * This consists of all "parent.child" chains of structure that descend
  * from the given "orig" original structure.
+ * Lazy fields aren't joined, so they (and their descendents) have none.
  * FIXME: artificially limited to 26 entries.
  */
 static void
@@ -481,7 +609,8 @@ resolve_aliases(struct strct *orig, struct strct *p,
 	int		 c;
 
 	TAILQ_FOREACH(f, &p->fq, entries) {
-		if (FTYPE_STRUCT != f->type)
+		if (FTYPE_STRUCT != f->type ||
+		    FIELD_LAZY & f->flags)
 			continue;
 		assert(NULL != f->ref);
 		
@@ -512,6 +641,82 @@ resolve_aliases(struct strct *orig, struct strct *p,
 	}
 }
 
+/*
+ * Counts and existence tests run entirely in the database and don't
+ * return rows, so they can neither verify password hashes nor have
+ * projection, ordering, or paging.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+check_counttype(const struct search *srch)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+
+	TAILQ_FOREACH(sent, &srch->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD != sr->field->type)
+			continue;
+		warnx("%s:%zu:%zu: password field in "
+			"count or exists",
+			sent->pos.fname, sent->pos.line,
+			sent->pos.column);
+		return(0);
+	}
+
+	if (TAILQ_EMPTY(&srch->ordq) && TAILQ_EMPTY(&srch->fq) &&
+	    ! ((SEARCH_HAS_LIMIT | SEARCH_HAS_OFFSET | 
+	        SEARCH_HAS_AFTER) & srch->flags))
+		return(1);
+
+	warnx("%s:%zu:%zu: fields, order, or paging "
+		"in count or exists",
+		srch->pos.fname, srch->pos.line,
+		srch->pos.column);
+	return(0);
+}
+
+/*
+ * Check that a cached search may be answered from the row cache.
+ * This must be a unique search whose terms are all compared for
+ * equality, so that cached rows may be matched by value.
+ * Return zero on failure, non-zero on success.
+ */
+static int
+check_cachetype(const struct search *srch)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+
+	if (STYPE_SEARCH != srch->type ||
+	    ! (SEARCH_IS_UNIQUE & srch->flags) ||
+	    ! TAILQ_EMPTY(&srch->ordq) || 
+	    ! TAILQ_EMPTY(&srch->fq) ||
+	    ((SEARCH_HAS_LIMIT | SEARCH_HAS_OFFSET | 
+	      SEARCH_HAS_AFTER) & srch->flags)) {
+		warnx("%s:%zu:%zu: cache on non-unique search, or "
+			"with fields, order, or paging",
+			srch->pos.fname, srch->pos.line,
+			srch->pos.column);
+		return(0);
+	}
+
+	TAILQ_FOREACH(sent, &srch->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (OPTYPE_EQUAL == sent->op &&
+		    FTYPE_PASSWORD != sr->field->type &&
+		    FTYPE_BLOB != sr->field->type)
+			continue;
+		warnx("%s:%zu:%zu: cached search terms must be "
+			"equalities on non-password, non-blob fields",
+			sent->pos.fname, sent->pos.line,
+			sent->pos.column);
+		return(0);
+	}
+
+	return(1);
+}
+
 /*
  * Check to see that our search type (e.g., list or iterate) is
  * consistent with the fields that we're searching for.
@@ -519,6 +724,7 @@ resolve_aliases(struct strct *orig, struct strct *p,
  * generally useful.
  * Also warn if null-sensitive operators (isnull, notnull) will be run
  * on non-null fields.
+ * Keyset paging with projected fields must select its ordering fields.
  * Return zero on failure, non-zero on success.
  */
 static int
@@ -526,11 +732,21 @@ check_searchtype(const struct strct *p)
 {
 	const struct search *srch;
 	const struct sent *sent;
-	const struct sref *sr;
+	const struct ord *ord;
+	const struct sref *sr, *fr;
 
 	TAILQ_FOREACH(srch, &p->sq, entries) {
+		if ((STYPE_COUNT == srch->type ||
+		     STYPE_EXISTS == srch->type) &&
+		    ! check_counttype(srch))
+			return(0);
+		if (SEARCH_IS_CACHED & srch->flags &&
+		    ! check_cachetype(srch))
+			return(0);
 		if (SEARCH_IS_UNIQUE & srch->flags && 
-		    STYPE_SEARCH != srch->type) 
+		    STYPE_SEARCH != srch->type &&
+		    STYPE_COUNT != srch->type &&
+		    STYPE_EXISTS != srch->type) 
 			warnx("%s:%zu:%zu: multiple-result search "
 				"on a unique field",
 				srch->pos.fname, srch->pos.line,
@@ -566,7 +782,85 @@ check_searchtype(const struct strct *p)
 					sent->pos.column);
 				return(0);
 			}
+			/*
+			 * Passwords are verified against the extracted
+			 * hash, so it must be selected.
+			 */
+			if (FTYPE_PASSWORD != sr->field->type ||
+			    TAILQ_EMPTY(&srch->fq))
+				continue;
+			TAILQ_FOREACH(fr, &srch->fq, entries)
+				if (fr->field == sr->field)
+					break;
+			if (NULL == fr) {
+				warnx("%s:%zu:%zu: password field "
+					"not in projected fields",
+					sent->pos.fname,
+					sent->pos.line,
+					sent->pos.column);
+				return(0);
+			}
 		}
+
+		TAILQ_FOREACH(ord, &srch->ordq, entries) {
+			sr = TAILQ_LAST(&ord->srq, srefq);
+			if (FTYPE_BLOB == sr->field->type ||
+			    FTYPE_PASSWORD == sr->field->type) {
+				warnx("%s:%zu:%zu: cannot order by "
+					"blob or password field",
+					ord->pos.fname,
+					ord->pos.line,
+					ord->pos.column);
+				return(0);
+			}
+			if ((SEARCH_HAS_AFTER & srch->flags) &&
+			    FIELD_NULL & sr->field->flags)
+				warnx("%s:%zu:%zu: keyset paging on "
+					"null field skips null rows",
+					ord->pos.fname,
+					ord->pos.line,
+					ord->pos.column);
+		}
+
+		if ( ! (SEARCH_HAS_AFTER & srch->flags))
+			continue;
+
+		if (TAILQ_EMPTY(&srch->ordq)) {
+			warnx("%s:%zu:%zu: keyset paging "
+				"requires an order",
+				srch->pos.fname, srch->pos.line,
+				srch->pos.column);
+			return(0);
+		}
+
+		/*
+		 * The position is read from the ordering fields of the
+		 * last result, so these must be selected.
+		 */
+
+		if ( ! TAILQ_EMPTY(&srch->fq))
+			TAILQ_FOREACH(ord, &srch->ordq, entries) {
+				sr = TAILQ_LAST(&ord->srq, srefq);
+				TAILQ_FOREACH(fr, &srch->fq, entries)
+					if (fr->field == sr->field)
+						break;
+				if (NULL != fr)
+					continue;
+				warnx("%s:%zu:%zu: keyset paging "
+					"order field not in projected "
+					"fields", ord->pos.fname, 
+					ord->pos.line, ord->pos.column);
+				return(0);
+			}
+
+		ord = TAILQ_LAST(&srch->ordq, ordq);
+		sr = TAILQ_LAST(&ord->srq, srefq);
+		if ( ! (FIELD_ROWID & sr->field->flags) &&
+		    ! (FIELD_UNIQUE & sr->field->flags))
+			warnx("%s:%zu:%zu: keyset paging should "
+				"end with a unique field",
+				ord->pos.fname, ord->pos.line,
+				ord->pos.column);
 	}
 
 	return(1);
@@ -582,7 +876,9 @@ static int
 resolve_search(struct search *srch)
 {
 	struct sent	*sent;
-	struct sref	*ref;
+	struct ord	*ord;
+	struct sref	*ref, *rr;
+	struct field	*f;
 	struct alias	*a;
 	struct strct	*p;
 
@@ -615,6 +911,45 @@ resolve_search(struct search *srch)
 		sent->alias = a;
 	}
 
+	TAILQ_FOREACH(ref, &srch->fq, entries) {
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (0 == strcasecmp(f->name, ref->name))
+				break;
+		if (NULL == (ref->field = f)) {
+			warnx("%s:%zu:%zu: projected field not found",
+				ref->pos.fname, ref->pos.line,
+				ref->pos.column);
+			return(0);
+		} else if (FTYPE_STRUCT == f->type) {
+			warnx("%s:%zu:%zu: projected field "
+				"is a struct", ref->pos.fname, 
+				ref->pos.line, ref->pos.column);
+			return(0);
+		}
+		TAILQ_FOREACH(rr, &srch->fq, entries)
+			if (rr != ref && rr->field == f)
+				break;
+		if (NULL != rr) {
+			warnx("%s:%zu:%zu: duplicate projected field",
+				ref->pos.fname, ref->pos.line,
+				ref->pos.column);
+			return(0);
+		}
+	}
+
+	TAILQ_FOREACH(ord, &srch->ordq, entries) {
+		ref = TAILQ_FIRST(&ord->srq);
+		if ( ! resolve_sref(ref, p))
+			return(0);
+		if (NULL == ord->name)
+			continue;
+		TAILQ_FOREACH(a, &p->aq, entries)
+			if (0 == strcasecmp(a->name, ord->name))
+				break;
+		assert(NULL != a);
+		ord->alias = a;
+	}
+
 	return(1);
 }
 
@@ -634,6 +969,71 @@ check_unique(const struct unique *u)
 	return(1);
 }
 
+/*
+ * Make sure that the conflict target of an upsert is exactly a unique
+ * field or unique clause, which SQLite requires of "ON CONFLICT", and
+ * that the rowid isn't modified on conflict.
+ * The rowid isn't bound by inserts, so it can never conflict.
+ * Returns zero on failure, non-zero on success.
+ */
+static int
+check_upserttype(const struct update *up)
+{
+	const struct uref *ref, *rr;
+	const struct unique *u;
+	const struct nref *n;
+	size_t	 sz = 0, nsz;
+
+	TAILQ_FOREACH(ref, &up->mrq, entries) {
+		if ( ! (FIELD_ROWID & ref->field->flags))
+			continue;
+		warnx("%s:%zu:%zu: upsert modifies rowid",
+			ref->pos.fname, ref->pos.line,
+			ref->pos.column);
+		return(0);
+	}
+
+	TAILQ_FOREACH(ref, &up->crq, entries) {
+		if (OPTYPE_EQUAL != ref->op) {
+			warnx("%s:%zu:%zu: upsert conflict "
+				"term not an equality",
+				ref->pos.fname, ref->pos.line,
+				ref->pos.column);
+			return(0);
+		}
+		if (FIELD_ROWID & ref->field->flags) {
+			warnx("%s:%zu:%zu: upsert conflict "
+				"term is the unbound rowid",
+				ref->pos.fname, ref->pos.line,
+				ref->pos.column);
+			return(0);
+		}
+		sz++;
+	}
+
+	ref = TAILQ_FIRST(&up->crq);
+	if (1 == sz && FIELD_UNIQUE & ref->field->flags)
+		return(1);
+
+	TAILQ_FOREACH(u, &up->parent->nq, entries) {
+		nsz = 0;
+		TAILQ_FOREACH(n, &u->nq, entries) {
+			TAILQ_FOREACH(rr, &up->crq, entries)
+				if (rr->field == n->field)
+					break;
+			if (NULL == rr)
+				break;
+			nsz++;
+		}
+		if (NULL == n && nsz == sz)
+			return(1);
+	}
+
+	warnx("%s:%zu:%zu: upsert conflict terms not unique",
+		ref->pos.fname, ref->pos.line, ref->pos.column);
+	return(0);
+}
+
 /*
  * Resolve the chain of unique fields.
  * These are all in the local structure.
@@ -658,6 +1058,319 @@ resolve_unique(struct unique *u)
 	return(1);
 }
 
+/*
+ * Columns of an index being derived.
+ * These are sized to hold every term of the originating statement.
+ */
+struct	icols {
+	const struct field **key; /* key columns */
+	int		  *desc; /* whether key column descends */
+	size_t		   keysz;
+	const struct field **nul; /* null-tested columns */
+	int		  *notnul; /* whether tested not null */
+	size_t		   nulsz;
+};
+
+static void
+icols_alloc(struct icols *ic, size_t sz)
+{
+
+	memset(ic, 0, sizeof(struct icols));
+	ic->key = calloc(sz, sizeof(struct field *));
+	ic->desc = calloc(sz, sizeof(int));
+	ic->nul = calloc(sz, sizeof(struct field *));
+	ic->notnul = calloc(sz, sizeof(int));
+	if (NULL == ic->key || NULL == ic->desc ||
+	    NULL == ic->nul || NULL == ic->notnul)
+		err(EXIT_FAILURE, NULL);
+}
+
+static void
+icols_free(struct icols *ic)
+{
+
+	free(ic->key);
+	free(ic->desc);
+	free(ic->nul);
+	free(ic->notnul);
+}
+
+/*
+ * Append a key column if not already in the index.
+ */
+static void
+icols_key(struct icols *ic, const struct field *f, int desc)
+{
+	size_t	 i;
+
+	for (i = 0; i < ic->keysz; i++)
+		if (ic->key[i] == f)
+			return;
+	ic->desc[ic->keysz] = desc;
+	ic->key[ic->keysz++] = f;
+}
+
+/*
+ * Append a null-tested column if not already in the index.
+ */
+static void
+icols_null(struct icols *ic, const struct field *f, int notnul)
+{
+	size_t	 i;
+
+	for (i = 0; i < ic->nulsz; i++)
+		if (ic->nul[i] == f)
+			return;
+	ic->notnul[ic->nulsz] = notnul;
+	ic->nul[ic->nulsz++] = f;
+}
+
+/*
+ * Append "str" to "*p" (which may be NULL), separated by "sep" if "*p"
+ * is not NULL.
+ */
+static void
+index_cat(char **p, const char *sep, const char *str)
+{
+	char	*cp;
+
+	if (asprintf(&cp, "%s%s%s", NULL == *p ? "" : *p, 
+	    NULL == *p ? "" : sep, str) < 0)
+		err(EXIT_FAILURE, NULL);
+	free(*p);
+	*p = cp;
+}
+
+/*
+ * Add the index described by "ic" to the structure "p".
+ * If there are no key columns, the null-tested columns are used.
+ * This does nothing if the leading column is already indexed as a
+ * rowid or unique, the columns are covered by a unique clause, or the
+ * index is a prefix of an existing one; it replaces existing indexes
+ * that are its prefix.
+ * The index name is derived from its columns, so it's stable across
+ * configurations (and usable by -Osqldiff).
+ */
+static void
+index_add(struct strct *p, const struct icols *ic)
+{
+	const struct field *const *key;
+	const int	*desc;
+	const struct unique *u;
+	const struct nref *nr;
+	struct sindex	*ix, *ixx;
+	size_t		 i, sz;
+	char		*name = NULL, *cols = NULL, *where = NULL;
+
+	if (ic->keysz > 0) {
+		key = ic->key;
+		desc = ic->desc;
+		sz = ic->keysz;
+	} else {
+		key = ic->nul;
+		desc = NULL;
+		sz = ic->nulsz;
+	}
+
+	if (0 == sz || (FIELD_ROWID & key[0]->flags) ||
+	    (FIELD_UNIQUE & key[0]->flags))
+		return;
+
+	TAILQ_FOREACH(u, &p->nq, entries) {
+		i = 0;
+		TAILQ_FOREACH(nr, &u->nq, entries) {
+			if (i == sz || nr->field != key[i])
+				break;
+			i++;
+		}
+		if (i == sz)
+			return;
+	}
+
+	index_cat(&name, "_", "idx");
+	index_cat(&name, "_", p->name);
+	for (i = 0; i < sz; i++) {
+		if (ic->keysz > 0)
+			index_cat(&name, "_", key[i]->name);
+		index_cat(&cols, ", ", key[i]->name);
+		if (NULL == desc || ! desc[i])
+			continue;
+		index_cat(&name, "_", "desc");
+		index_cat(&cols, "", " DESC");
+	}
+	for (i = 0; i < ic->nulsz; i++) {
+		index_cat(&name, "_", ic->nul[i]->name);
+		index_cat(&name, "_", ic->notnul[i] ? 
+			"notnull" : "isnull");
+		index_cat(&where, " AND ", ic->nul[i]->name);
+		index_cat(&where, "", ic->notnul[i] ? 
+			" IS NOT NULL" : " IS NULL");
+	}
+
+	/* Look for indexes with the same partial clause. */
+
+	sz = strlen(cols);
+	ix = TAILQ_FIRST(&p->ixq);
+	while (NULL != ix) {
+		ixx = TAILQ_NEXT(ix, entries);
+		if ((NULL == where) != (NULL == ix->where) ||
+		    (NULL != where && strcmp(where, ix->where))) {
+			ix = ixx;
+			continue;
+		}
+		if (0 == strncmp(ix->cols, cols, sz) &&
+		    ('\0' == ix->cols[sz] || ',' == ix->cols[sz])) {
+			free(name);
+			free(cols);
+			free(where);
+			return;
+		} 
+		i = strlen(ix->cols);
+		if (0 == strncmp(ix->cols, cols, i) &&
+		    ',' == cols[i]) {
+			TAILQ_REMOVE(&p->ixq, ix, entries);
+			free(ix->name);
+			free(ix->cols);
+			free(ix->where);
+			free(ix);
+		}
+		ix = ixx;
+	}
+
+	if (NULL == (ix = calloc(1, sizeof(struct sindex))))
+		err(EXIT_FAILURE, NULL);
+	ix->name = name;
+	ix->cols = cols;
+	ix->where = where;
+	ix->parent = p;
+	TAILQ_INSERT_TAIL(&p->ixq, ix, entries);
+}
+
+/*
+ * Derive the indexes used by search "s".
+ * Terms are grouped by the table (join alias) they constrain, giving
+ * each an index of equality columns followed by either the leading
+ * ordering columns on that table or a single range column, which is
+ * as much of an index as a query may use.
+ * Null tests are made into a partial index clause.
+ * Lastly, foreign keys joined when searching nested structures are
+ * indexed so that the join may be driven from the nested side.
+ */
+static void
+resolve_index_search(const struct search *s)
+{
+	const struct sent *sent, *ss;
+	const struct ord *ord;
+	const struct sref *sr;
+	const struct field *range;
+	struct icols	 ic;
+	size_t		 sz = 0;
+
+	TAILQ_FOREACH(sent, &s->sntq, entries)
+		sz++;
+	TAILQ_FOREACH(ord, &s->ordq, entries)
+		sz++;
+
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		TAILQ_FOREACH(ss, &s->sntq, entries)
+			if (ss == sent || ss->alias == sent->alias)
+				break;
+		if (ss != sent)
+			continue;
+
+		icols_alloc(&ic, sz);
+		range = NULL;
+		TAILQ_FOREACH(ss, &s->sntq, entries) {
+			if (ss->alias != sent->alias)
+				continue;
+			sr = TAILQ_LAST(&ss->srq, srefq);
+			if (FTYPE_PASSWORD == sr->field->type)
+				continue;
+			if (OPTYPE_EQUAL == ss->op)
+				icols_key(&ic, sr->field, 0);
+			else if (OPTYPE_ISUNARY(ss->op))
+				icols_null(&ic, sr->field,
+					OPTYPE_NOTNULL == ss->op);
+			else if (OPTYPE_NEQUAL != ss->op && 
+			    NULL == range)
+				range = sr->field;
+		}
+
+		if (NULL != range)
+			icols_key(&ic, range, 0);
+		else
+			TAILQ_FOREACH(ord, &s->ordq, entries) {
+				if (ord->alias != sent->alias)
+					break;
+				sr = TAILQ_LAST(&ord->srq, srefq);
+				icols_key(&ic, sr->field,
+					ORDTYPE_DESC == ord->op);
+			}
+
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		index_add(sr->field->parent, &ic);
+		icols_free(&ic);
+	}
+
+	TAILQ_FOREACH(sent, &s->sntq, entries)
+		TAILQ_FOREACH(sr, &sent->srq, entries) {
+			if (FTYPE_STRUCT != sr->field->type)
+				continue;
+			icols_alloc(&ic, 1);
+			icols_key(&ic, sr->field->ref->source, 0);
+			index_add(sr->field->parent, &ic);
+			icols_free(&ic);
+		}
+}
+
+/*
+ * Derive the index used by the constraints of update or delete "u".
+ * As with resolve_index_search(), this consists of the equality
+ * columns, then one range column, with null tests being partial.
+ */
+static void
+resolve_index_update(const struct update *u)
+{
+	const struct uref *ur;
+	const struct field *range = NULL;
+	struct icols	 ic;
+	size_t		 sz = 0;
+
+	TAILQ_FOREACH(ur, &u->crq, entries)
+		sz++;
+	if (0 == sz)
+		return;
+
+	icols_alloc(&ic, sz);
+	TAILQ_FOREACH(ur, &u->crq, entries)
+		if (OPTYPE_EQUAL == ur->op)
+			icols_key(&ic, ur->field, 0);
+		else if (OPTYPE_ISUNARY(ur->op))
+			icols_null(&ic, ur->field,
+				OPTYPE_NOTNULL == ur->op);
+		else if (OPTYPE_NEQUAL != ur->op && NULL == range)
+			range = ur->field;
+	if (NULL != range)
+		icols_key(&ic, range, 0);
+	index_add(u->parent, &ic);
+	icols_free(&ic);
+}
+
+/*
+ * Derive the index used when loading the children "f" by the foreign
+ * key in its target structure.
+ */
+static void
+resolve_index_children(const struct field *f)
+{
+	struct icols	 ic;
+
+	icols_alloc(&ic, 1);
+	icols_key(&ic, f->ref->target, 0);
+	index_add(f->ref->target->parent, &ic);
+	icols_free(&ic);
+}
+
 int
 parse_link(struct config *cfg)
 {
@@ -698,13 +1411,20 @@ parse_link(struct config *cfg)
 			if ( ! resolve_update(u) ||
 			     ! check_updatetype(u))
 				return(0);
+		TAILQ_FOREACH(u, &p->pq, entries)
+			if ( ! resolve_update(u))
+				return(0);
 	}
 
-	/* Check for reference recursion. */
+	/* 
+	 * Check for reference recursion.
+	 * Children refer back to their parent, so aren't considered.
+	 */
 
 	TAILQ_FOREACH(p, &cfg->sq, entries)
 		TAILQ_FOREACH(f, &p->fq, entries)
-			if (FTYPE_STRUCT == f->type) {
+			if (FTYPE_STRUCT == f->type &&
+			    ! (FIELD_CHILDREN & f->flags)) {
 				if (check_recursive(f->ref, p))
 					continue;
 				warnx("%s:%zu:%zu: recursive "
@@ -726,7 +1446,8 @@ parse_link(struct config *cfg)
 		if (p->colour)
 			continue;
 		TAILQ_FOREACH(f, &p->fq, entries)
-			if (FTYPE_STRUCT == f->type) {
+			if (FTYPE_STRUCT == f->type &&
+			    ! (FIELD_CHILDREN & f->flags)) {
 				p->colour = colour;
 				annotate(f->ref, 1, colour);
 			}
@@ -734,6 +1455,92 @@ parse_link(struct config *cfg)
 	}
 	assert(sz > 0);
 
+	/* 
+	 * Iterators (and their nested structures) fill in-place.
+	 * Counts, existence tests, and projections don't use these.
+	 * All other searches copy out their results.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		TAILQ_FOREACH(srch, &p->sq, entries)
+			if ( ! TAILQ_EMPTY(&srch->fq))
+				continue;
+			else if (STYPE_ITERATE == srch->type)
+				mark_fill(p, STRCT_HAS_BORROW);
+			else if (STYPE_COUNT != srch->type &&
+			    STYPE_EXISTS != srch->type)
+				mark_fill(p, STRCT_HAS_FILL);
+
+	/*
+	 * Functions filling in the written row of a structure with
+	 * nested structures re-read the row with its joins.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FTYPE_STRUCT == f->type &&
+			    ! (FIELD_LAZY & f->flags)) {
+				mark_fill(p, STRCT_HAS_FILL);
+				break;
+			}
+
+	/*
+	 * Structures with cached searches keep a row cache, from which
+	 * results (and their nested structures) are copied out.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		TAILQ_FOREACH(srch, &p->sq, entries)
+			if (SEARCH_IS_CACHED & srch->flags) {
+				p->flags |= STRCT_HAS_CACHE;
+				mark_copy(p, STRCT_HAS_COPY);
+			}
+
+	/*
+	 * Lazy fields aren't filled with their parent: their targets are
+	 * instead loaded by rowid and copied into the handle.
+	 * If the parent has lists or arrays, these are loaded in batches
+	 * for all of their members.
+	 * Children are instead filled into a queue.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		TAILQ_FOREACH(f, &p->fq, entries) {
+			if (FIELD_CHILDREN & f->flags) {
+				f->ref->target->parent->flags |= 
+					STRCT_HAS_QUEUE;
+				mark_fill(f->ref->target->parent, 
+					STRCT_HAS_FILL);
+				continue;
+			} else if ( ! (FIELD_LAZY & f->flags))
+				continue;
+			f->ref->target->parent->flags |= STRCT_HAS_LAZY;
+			if ((STRCT_HAS_QUEUE | STRCT_HAS_ARRAY) & p->flags)
+				f->ref->target->parent->flags |= 
+					STRCT_HAS_LAZY_IN;
+			mark_fill(f->ref->target->parent, STRCT_HAS_FILL);
+		}
+
+	/*
+	 * Shared fields are referenced by pointer and de-duplicated
+	 * within a result set.
+	 * Iterators fill in-place, so they can't share.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries) {
+		mark_dedup(p);
+		if ( ! (STRCT_HAS_BORROW & p->flags))
+			continue;
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FIELD_SHARED & f->flags) {
+				warnx("%s:%zu:%zu: shared field in "
+					"iterated structure",
+					f->pos.fname, f->pos.line,
+					f->pos.column);
+				return(0);
+			}
+	}
+
 	/*
 	 * Next, create unique names for all joins within a structure.
 	 * We do this by creating a list of all search patterns (e.g.,
@@ -759,12 +1566,34 @@ parse_link(struct config *cfg)
 			     ! check_unique(n))
 				return(0);
 
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		TAILQ_FOREACH(u, &p->pq, entries)
+			if ( ! check_upserttype(u))
+				return(0);
+
 	/* See if our search type is wonky. */
 
 	TAILQ_FOREACH(p, &cfg->sq, entries)
 		if ( ! check_searchtype(p))
 			return(0);
 
+	/* 
+	 * Derive indexes from the constraints we've resolved.
+	 * Do this in order of declaration so that they're stable.
+	 */
+
+	TAILQ_FOREACH(p, &cfg->sq, entries) {
+		TAILQ_FOREACH(srch, &p->sq, entries)
+			resolve_index_search(srch);
+		TAILQ_FOREACH(u, &p->uq, entries)
+			resolve_index_update(u);
+		TAILQ_FOREACH(u, &p->dq, entries)
+			resolve_index_update(u);
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FIELD_CHILDREN & f->flags)
+				resolve_index_children(f);
+	}
+
 	/* 
 	 * Copy the list into a temporary array.
 	 * Then sort the list by reverse-height.
@@ -32,6 +32,7 @@ enum	op {
 	OP_NOOP,
 	OP_DIFF,
 	OP_C_HEADER,
+	OP_C_METRICS,
 	OP_C_SOURCE,
 	OP_JAVASCRIPT,
 	OP_SQL
@@ -44,7 +45,8 @@ main(int argc, char *argv[])
 	const char	*confile = NULL, *dconfile = NULL,
 	      		*header = NULL;
 	struct config	*cfg, *dcfg = NULL;
-	int		 c, rc = 1, json = 0, valids = 0;
+	int		 c, rc = 1, json = 0, valids = 0, arena = 0,
+			 pool = 0, metrics = 0;
 	enum op		 op = OP_NOOP;
 
 #if HAVE_PLEDGE
@@ -59,6 +61,8 @@ main(int argc, char *argv[])
 				op = OP_C_SOURCE;
 			else if (0 == strcmp(optarg, "cheader"))
 				op = OP_C_HEADER;
+			else if (0 == strcmp(optarg, "cmetrics"))
+				op = OP_C_METRICS;
 			else if (0 == strcmp(optarg, "sqldiff"))
 				op = OP_DIFF;
 			else if (0 == strcmp(optarg, "sql"))
@@ -75,6 +79,12 @@ main(int argc, char *argv[])
 				json = 1;
 			else if (0 == strcmp(optarg, "valids"))
 				valids = 1;
+			else if (0 == strcmp(optarg, "arena"))
+				arena = 1;
+			else if (0 == strcmp(optarg, "pool"))
+				pool = 1;
+			else if (0 == strcmp(optarg, "metrics"))
+				metrics = 1;
 			else
 				goto usage;
 			break;
@@ -107,6 +117,22 @@ main(int argc, char *argv[])
 		argc--;
 	}
 
+	/* The metrics reader doesn't depend upon a configuration. */
+
+	if (OP_C_METRICS == op) {
+		if (argc > 0)
+			goto usage;
+#if HAVE_PLEDGE
+		if (-1 == pledge("stdio", NULL))
+			err(EXIT_FAILURE, "pledge");
+#endif
+		if (json || valids || arena || pool || metrics)
+			warnx("-F options meaningless with "
+				"metrics reader output");
+		gen_c_metrics();
+		return(EXIT_SUCCESS);
+	}
+
 	if (0 == argc) {
 		confile = "<stdin>";
 		conf = stdin;
@@ -132,6 +158,12 @@ main(int argc, char *argv[])
 		warnx("-Fjson meaningless with non-C output");
 	if (valids && (OP_C_HEADER != op && OP_C_SOURCE != op)) 
 		warnx("-Fvalids meaningless with non-C output");
+	if (arena && (OP_C_HEADER != op && OP_C_SOURCE != op)) 
+		warnx("-Farena meaningless with non-C output");
+	if (pool && (OP_C_HEADER != op && OP_C_SOURCE != op)) 
+		warnx("-Fpool meaningless with non-C output");
+	if (metrics && (OP_C_HEADER != op && OP_C_SOURCE != op)) 
+		warnx("-Fmetrics meaningless with non-C output");
 
 	/*
 	 * First, parse the file.
@@ -165,11 +197,12 @@ main(int argc, char *argv[])
 	/* Finally, (optionally) generate output. */
 
 	if (OP_C_SOURCE == op)
-		gen_c_source(&cfg->sq, json, valids, header);
+		gen_c_source(cfg, json, valids, 
+			arena, pool, metrics, header);
 	else if (OP_C_HEADER == op)
-		gen_c_header(cfg, json, valids);
+		gen_c_header(cfg, json, valids, arena, pool, metrics);
 	else if (OP_SQL == op)
-		gen_sql(&cfg->sq);
+		gen_sql(cfg);
 	else if (OP_DIFF == op)
 		rc = gen_diff(cfg, dcfg);
 	else if (OP_JAVASCRIPT == op)
@@ -183,7 +216,8 @@ usage:
 		"usage: %s "
 		"[-F options] "
 		"[-O output] "
-		"[oldconfig|header] [config]\n",
-		getprogname());
+		"[oldconfig|header] [config]\n"
+		"       %s -O cmetrics\n",
+		getprogname(), getprogname());
 	return(EXIT_FAILURE);
 }
@@ -0,0 +1,323 @@
+/*	$Id$ */
+/*
+ * Copyright (c) 2017 Kristaps Dzonsons <kristaps@bsd.lv>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/queue.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "extern.h"
+
+/*
+ * Generate the layout of the per-statement metrics file shared by
+ * db_metrics_attach() and the reader generated by gen_c_metrics().
+ * Its sizes aren't configurable, as all processes and the reader must
+ * agree upon them.
+ */
+void
+gen_metrics_structs(void)
+{
+
+	print_commentt(0, COMMENT_C,
+		"Layout of the file of per-statement metrics "
+		"(see db_metrics_attach()).\n"
+		"Latencies are counted in METRICS_BUCKETS buckets, "
+		"each up to twice\n"
+		"the last, starting below one microsecond.\n"
+		"The METRICS_SLOW slowest runs of each statement "
+		"are kept with their\n"
+		"bound parameters.");
+	puts("#define\tMETRICS_MAGIC 0x6b7762706d657432ULL\n"
+	     "#define\tMETRICS_BUCKETS 24\n"
+	     "#define\tMETRICS_SLOW 4\n"
+	     "#define\tMETRICS_NAME_SIZE 64\n"
+	     "#define\tMETRICS_SQL_SIZE 256\n"
+	     "\n"
+	     "struct\tkwbp_metrics_slow {\n"
+	     "\tuint64_t seq;\n"
+	     "\tuint64_t ns;\n"
+	     "\tchar sql[METRICS_SQL_SIZE];\n"
+	     "};\n"
+	     "\n"
+	     "struct\tkwbp_metrics_stmt {\n"
+	     "\tchar name[METRICS_NAME_SIZE];\n"
+	     "\tuint64_t calls;\n"
+	     "\tuint64_t ns;\n"
+	     "\tuint64_t rows;\n"
+	     "\tuint64_t bytes;\n"
+	     "\tuint64_t fullscans;\n"
+	     "\tuint64_t sorts;\n"
+	     "\tuint64_t autoindexes;\n"
+	     "\tuint64_t hist[METRICS_BUCKETS];\n"
+	     "\tstruct kwbp_metrics_slow slow[METRICS_SLOW];\n"
+	     "};\n"
+	     "\n"
+	     "struct\tkwbp_metrics {\n"
+	     "\tvolatile uint64_t magic;\n"
+	     "\tvolatile uint64_t layout;\n"
+	     "\tuint64_t nstmts;\n"
+	     "\tstruct kwbp_metrics_stmt stmts[];\n"
+	     "};\n"
+	     "");
+}
+
+/*
+ * Generate a stand-alone program reading the file of per-statement
+ * metrics written by db_metrics_attach().
+ * It prints the statements taking the most time in all, then the
+ * slowest runs with their bound parameters.
+ * With a delay, it instead refreshes the screen with the differences
+ * over each interval, much like top(1).
+ */
+void
+gen_c_metrics(void)
+{
+
+	print_commentt(0, COMMENT_C,
+		"WARNING: automatically generated by "
+		"kwebapp " VERSION ".\n"
+		"DO NOT EDIT!");
+	print_commentt(0, COMMENT_C,
+		"Required for getopt(3) by strict C99 compilers.");
+	puts("#define\t_POSIX_C_SOURCE 200809L\n"
+	     "\n"
+	     "#include <sys/mman.h>\n"
+	     "#include <sys/stat.h>\n"
+	     "\n"
+	     "#include <err.h>\n"
+	     "#include <fcntl.h>\n"
+	     "#include <stdint.h>\n"
+	     "#include <stdio.h>\n"
+	     "#include <stdlib.h>\n"
+	     "#include <string.h>\n"
+	     "#include <unistd.h>\n"
+	     "");
+
+	gen_metrics_structs();
+
+	print_commentt(0, COMMENT_C,
+		"A slow run copied out of the file.");
+	puts("struct\tslow {\n"
+	     "\tconst char *name;\n"
+	     "\tuint64_t ns;\n"
+	     "\tchar sql[METRICS_SQL_SIZE];\n"
+	     "};\n"
+	     "");
+
+	puts("static int\n"
+	     "cmp_stmt(const void *a, const void *b)\n"
+	     "{\n"
+	     "\tconst struct kwbp_metrics_stmt *sa = "
+	     "*(const struct kwbp_metrics_stmt **)a,\n"
+	     "\t      *sb = *(const struct kwbp_metrics_stmt **)b;\n"
+	     "\n"
+	     "\treturn(sa->ns < sb->ns ? 1 : sa->ns > sb->ns ? -1 : 0);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "cmp_slow(const void *a, const void *b)\n"
+	     "{\n"
+	     "\tconst struct slow *sa = a, *sb = b;\n"
+	     "\n"
+	     "\treturn(sa->ns < sb->ns ? 1 : sa->ns > sb->ns ? -1 : 0);\n"
+	     "}\n"
+	     "");
+
+	print_commentt(0, COMMENT_C,
+		"Return the upper bound, in microseconds, of the "
+		"latency bucket holding\n"
+		"the \"pct\" percentile of the \"calls\" calls "
+		"counted in \"h\".");
+	puts("static uint64_t\n"
+	     "percentile(const uint64_t *h, uint64_t calls, "
+	     "uint64_t pct)\n"
+	     "{\n"
+	     "\tuint64_t sum = 0, want;\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\twant = (calls * pct + 99) / 100;\n"
+	     "\tfor (i = 0; i < METRICS_BUCKETS - 1; i++)\n"
+	     "\t\tif ((sum += h[i]) >= want)\n"
+	     "\t\t\tbreak;\n"
+	     "\treturn(1ULL << i);\n"
+	     "}\n"
+	     "");
+
+	print_commentt(0, COMMENT_C,
+		"Copy the slow runs of \"s\" into \"sl\", skipping "
+		"empty ones and those\n"
+		"being written.\n"
+		"Returns how many were copied.");
+	puts("static size_t\n"
+	     "slow_get(const struct kwbp_metrics_stmt *s, "
+	     "struct slow *sl)\n"
+	     "{\n"
+	     "\tconst struct kwbp_metrics_slow *p;\n"
+	     "\tuint64_t seq;\n"
+	     "\tsize_t i, n = 0;\n"
+	     "\n"
+	     "\tfor (i = 0; i < METRICS_SLOW; i++) {\n"
+	     "\t\tp = &s->slow[i];\n"
+	     "\t\tseq = p->seq;\n"
+	     "\t\t__sync_synchronize();\n"
+	     "\t\tif ((seq & 1) || 0 == p->ns)\n"
+	     "\t\t\tcontinue;\n"
+	     "\t\tsl[n].name = s->name;\n"
+	     "\t\tsl[n].ns = p->ns;\n"
+	     "\t\tmemcpy(sl[n].sql, p->sql, METRICS_SQL_SIZE);\n"
+	     "\t\tsl[n].sql[METRICS_SQL_SIZE - 1] = '\\0';\n"
+	     "\t\t__sync_synchronize();\n"
+	     "\t\tif (seq == p->seq)\n"
+	     "\t\t\tn++;\n"
+	     "\t}\n"
+	     "\treturn(n);\n"
+	     "}\n"
+	     "");
+
+	puts("int\n"
+	     "main(int argc, char *argv[])\n"
+	     "{\n"
+	     "\tconst struct kwbp_metrics *m;\n"
+	     "\tstruct kwbp_metrics *cur, *prev, *tmp;\n"
+	     "\tstruct kwbp_metrics_stmt **v, *s, *p;\n"
+	     "\tconst char *progname = argv[0];\n"
+	     "\tstruct slow *sl;\n"
+	     "\tstruct stat st;\n"
+	     "\tsize_t i, j, n, nsl, sz, lines = 20;\n"
+	     "\tint c, fd, delay = 0;\n"
+	     "\tvoid *map;\n"
+	     "\n"
+	     "\twhile (-1 != (c = getopt(argc, argv, \"d:n:\")))\n"
+	     "\t\tswitch (c) {\n"
+	     "\t\tcase ('d'):\n"
+	     "\t\t\tdelay = atoi(optarg);\n"
+	     "\t\t\tbreak;\n"
+	     "\t\tcase ('n'):\n"
+	     "\t\t\tlines = strtoul(optarg, NULL, 10);\n"
+	     "\t\t\tbreak;\n"
+	     "\t\tdefault:\n"
+	     "\t\t\tgoto usage;\n"
+	     "\t\t}\n"
+	     "\targc -= optind;\n"
+	     "\targv += optind;\n"
+	     "\tif (1 != argc)\n"
+	     "\t\tgoto usage;\n"
+	     "\n"
+	     "\tif (-1 == (fd = open(argv[0], O_RDONLY)))\n"
+	     "\t\terr(EXIT_FAILURE, \"%s\", argv[0]);\n"
+	     "\tif (-1 == fstat(fd, &st))\n"
+	     "\t\terr(EXIT_FAILURE, \"%s\", argv[0]);\n"
+	     "\tsz = st.st_size;\n"
+	     "\tif (sz < sizeof(struct kwbp_metrics))\n"
+	     "\t\terrx(EXIT_FAILURE, "
+	     "\"%s: not a metrics file\", argv[0]);\n"
+	     "\tmap = mmap(NULL, sz, PROT_READ, MAP_SHARED, fd, 0);\n"
+	     "\tif (MAP_FAILED == map)\n"
+	     "\t\terr(EXIT_FAILURE, \"%s\", argv[0]);\n"
+	     "\tclose(fd);\n"
+	     "\tm = map;\n"
+	     "\tif (METRICS_MAGIC != m->magic ||\n"
+	     "\t    sz != sizeof(struct kwbp_metrics) +\n"
+	     "\t    m->nstmts * sizeof(struct kwbp_metrics_stmt))\n"
+	     "\t\terrx(EXIT_FAILURE, "
+	     "\"%s: not a metrics file\", argv[0]);\n"
+	     "\n"
+	     "\tn = m->nstmts;\n"
+	     "\tif (NULL == (cur = malloc(sz)) ||\n"
+	     "\t    NULL == (prev = calloc(1, sz)) ||\n"
+	     "\t    NULL == (v = calloc(n, sizeof(*v))) ||\n"
+	     "\t    NULL == (sl = calloc(n * METRICS_SLOW, "
+	     "sizeof(struct slow))))\n"
+	     "\t\terr(EXIT_FAILURE, NULL);\n"
+	     "\n"
+	     "\tfor (;;) {\n"
+	     "\t\tmemcpy(cur, m, sz);\n"
+	     "\t\tfor (i = nsl = 0; i < n; i++) {\n"
+	     "\t\t\ts = &cur->stmts[i];\n"
+	     "\t\t\tp = &prev->stmts[i];\n"
+	     "\t\t\tmemcpy(p->name, s->name, METRICS_NAME_SIZE);\n"
+	     "\t\t\tp->name[METRICS_NAME_SIZE - 1] = '\\0';\n"
+	     "\t\t\tp->calls = s->calls - p->calls;\n"
+	     "\t\t\tp->ns = s->ns - p->ns;\n"
+	     "\t\t\tp->rows = s->rows - p->rows;\n"
+	     "\t\t\tp->bytes = s->bytes - p->bytes;\n"
+	     "\t\t\tp->fullscans = s->fullscans - p->fullscans;\n"
+	     "\t\t\tp->sorts = s->sorts - p->sorts;\n"
+	     "\t\t\tp->autoindexes = "
+	     "s->autoindexes - p->autoindexes;\n"
+	     "\t\t\tfor (j = 0; j < METRICS_BUCKETS; j++)\n"
+	     "\t\t\t\tp->hist[j] = s->hist[j] - p->hist[j];\n"
+	     "\t\t\tv[i] = p;\n"
+	     "\t\t\tnsl += slow_get(&m->stmts[i], &sl[nsl]);\n"
+	     "\t\t}\n"
+	     "\t\tqsort(v, n, sizeof(*v), cmp_stmt);\n"
+	     "\t\tqsort(sl, nsl, sizeof(struct slow), cmp_slow);\n"
+	     "\n"
+	     "\t\tif (delay)\n"
+	     "\t\t\tfputs(\"\\033[H\\033[2J\", stdout);\n"
+	     "\t\tprintf(\"%-32s %9s %10s %8s %8s %8s "
+	     "%9s %11s %6s %6s %6s\\n\",\n"
+	     "\t\t\t\"STATEMENT\", \"CALLS\", \"TOTAL(ms)\", "
+	     "\"AVG(us)\",\n"
+	     "\t\t\t\"P50(us)\", \"P99(us)\", \"ROWS\", "
+	     "\"BYTES\",\n"
+	     "\t\t\t\"SCANS\", \"SORTS\", \"AUTOIX\");\n"
+	     "\t\tfor (i = 0; i < n && i < lines; i++) {\n"
+	     "\t\t\tif (0 == (p = v[i])->calls)\n"
+	     "\t\t\t\tbreak;\n"
+	     "\t\t\tprintf(\"%-32s %9llu %10.3f %8llu %8llu %8llu "
+	     "%9llu %11llu %6llu %6llu %6llu\\n\",\n"
+	     "\t\t\t\tp->name,\n"
+	     "\t\t\t\t(unsigned long long)p->calls,\n"
+	     "\t\t\t\tp->ns / 1000000.0,\n"
+	     "\t\t\t\t(unsigned long long)"
+	     "(p->ns / p->calls / 1000),\n"
+	     "\t\t\t\t(unsigned long long)"
+	     "percentile(p->hist, p->calls, 50),\n"
+	     "\t\t\t\t(unsigned long long)"
+	     "percentile(p->hist, p->calls, 99),\n"
+	     "\t\t\t\t(unsigned long long)p->rows,\n"
+	     "\t\t\t\t(unsigned long long)p->bytes,\n"
+	     "\t\t\t\t(unsigned long long)p->fullscans,\n"
+	     "\t\t\t\t(unsigned long long)p->sorts,\n"
+	     "\t\t\t\t(unsigned long long)p->autoindexes);\n"
+	     "\t\t}\n"
+	     "\t\tputs(\"\\nSLOWEST\");\n"
+	     "\t\tfor (i = 0; i < nsl && i < lines; i++)\n"
+	     "\t\t\tprintf(\"%10.3f ms %s\\n\\t%s\\n\", "
+	     "sl[i].ns / 1000000.0,\n"
+	     "\t\t\t\tsl[i].name, sl[i].sql);\n"
+	     "\t\tfflush(stdout);\n"
+	     "\t\tif (0 == delay)\n"
+	     "\t\t\tbreak;\n"
+	     "\n"
+	     "\t\t/* Subsequent screens show differences. */\n"
+	     "\n"
+	     "\t\ttmp = prev;\n"
+	     "\t\tprev = cur;\n"
+	     "\t\tcur = tmp;\n"
+	     "\t\tsleep(delay);\n"
+	     "\t}\n"
+	     "\treturn(EXIT_SUCCESS);\n"
+	     "usage:\n"
+	     "\tfprintf(stderr, \"usage: %s [-d delay] "
+	     "[-n lines] file\\n\",\n"
+	     "\t\tprogname);\n"
+	     "\treturn(EXIT_FAILURE);\n"
+	     "}");
+}
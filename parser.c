@@ -251,6 +251,29 @@ static	const char *const vtypes[VALIDATE__MAX] = {
 	"eq", /* VALIDATE_EQ */
 };
 
+static	const char *const pragmas[PRAGMA__MAX] = {
+	"pagesize", /* PRAGMA_PAGESIZE */
+	"journal", /* PRAGMA_JOURNAL */
+	"synchronous", /* PRAGMA_SYNC */
+	"cachesize", /* PRAGMA_CACHESIZE */
+	"mmapsize", /* PRAGMA_MMAPSIZE */
+	"tempstore", /* PRAGMA_TEMPSTORE */
+	"busytimeout", /* PRAGMA_BUSYTIMEOUT */
+};
+
+/*
+ * Values of the non-integer database settings.
+ */
+static	const char *const journals[] = {
+	"delete", "truncate", "persist", "memory", "wal", "off", NULL
+};
+static	const char *const syncs[] = {
+	"off", "normal", "full", "extra", NULL
+};
+static	const char *const tempstores[] = {
+	"default", "file", "memory", NULL
+};
+
 static enum tok parse_errx(struct parse *, const char *, ...)
 	__attribute__((format(printf, 2, 3)));
 static void parse_warnx(struct parse *p, const char *, ...)
@@ -351,11 +374,13 @@ uref_alloc(const struct parse *p, const char *name,
 }
 
 /*
- * Allocate a search reference and add it to the parent queue.
+ * Allocate a search reference and add it to the queue "q".
+ * The "up" search entity may be NULL (for ordering terms).
  * Always returns the created pointer.
  */
 static struct sref *
-sref_alloc(const struct parse *p, const char *name, struct sent *up)
+sref_alloc(const struct parse *p, const char *name, 
+	struct srefq *q, struct sent *up)
 {
 	struct sref	*ref;
 
@@ -365,10 +390,28 @@ sref_alloc(const struct parse *p, const char *name, struct sent *up)
 		err(EXIT_FAILURE, NULL);
 	ref->parent = up;
 	parse_point(p, &ref->pos);
-	TAILQ_INSERT_TAIL(&up->srq, ref, entries);
+	TAILQ_INSERT_TAIL(q, ref, entries);
 	return(ref);
 }
 
+/*
+ * Allocate an ordering term and add it to the parent queue.
+ * Always returns the created pointer.
+ */
+static struct ord *
+ord_alloc(const struct parse *p, struct search *up)
+{
+	struct ord	*ord;
+
+	if (NULL == (ord = calloc(1, sizeof(struct ord))))
+		err(EXIT_FAILURE, NULL);
+	ord->parent = up;
+	parse_point(p, &ord->pos);
+	TAILQ_INIT(&ord->srq);
+	TAILQ_INSERT_TAIL(&up->ordq, ord, entries);
+	return(ord);
+}
+
 /*
  * Allocate a search entity and add it to the parent queue.
  * Always returns the created pointer.
@@ -787,7 +830,8 @@ parse_validate(struct parse *p, struct field *fd)
  *
  *   [options | "comment" string_literal]* ";"
  *
- * The options are any of "rowid", "unique", or "noexport".
+ * The options are any of "rowid", "unique", "noexport", "lazy", or
+ * "shared".
  * This will continue processing until the semicolon is reached.
  */
 static void
@@ -836,6 +880,28 @@ parse_config_field_info(struct parse *p, struct field *fd)
 			if (FTYPE_PASSWORD == fd->type)
 				parse_warnx(p, "noexport is redundant");
 			fd->flags |= FIELD_NOEXPORT;
+		} else if (0 == strcasecmp(p->last.string, "lazy")) {
+			/* Only structures may be loaded on demand. */
+
+			if (FTYPE_STRUCT != fd->type) {
+				parse_errx(p, "lazy on non-struct");
+				break;
+			} else if (FIELD_SHARED & fd->flags) {
+				parse_errx(p, "lazy on shared struct");
+				break;
+			}
+			fd->flags |= FIELD_LAZY;
+		} else if (0 == strcasecmp(p->last.string, "shared")) {
+			/* Only joined structures may be shared. */
+
+			if (FTYPE_STRUCT != fd->type) {
+				parse_errx(p, "shared on non-struct");
+				break;
+			} else if (FIELD_LAZY & fd->flags) {
+				parse_errx(p, "shared on lazy struct");
+				break;
+			}
+			fd->flags |= FIELD_SHARED;
 		} else if (0 == strcasecmp(p->last.string, "limit")) {
 			parse_validate(p, fd);
 		} else if (0 == strcasecmp(p->last.string, "unique")) {
@@ -1029,6 +1095,48 @@ parse_field(struct parse *p, struct field *fd)
 	parse_config_field_info(p, fd);
 }
 
+/*
+ * Fill in the canonical and partial structure name of a chain of
+ * search references.
+ * For example of the latter, if our fields are "user.company.name",
+ * this would be "user.company".
+ * For a singleton field (e.g., "userid"), this is NULL.
+ */
+static void
+sref_names(const struct srefq *q, char **name, char **fname)
+{
+	const struct sref *sf;
+	size_t		 sz;
+
+	TAILQ_FOREACH(sf, q, entries) {
+		if (NULL == *fname) {
+			if (NULL == (*fname = strdup(sf->name)))
+				err(EXIT_FAILURE, NULL);
+			continue;
+		}
+		sz = strlen(*fname) + strlen(sf->name) + 2;
+		if (NULL == (*fname = realloc(*fname, sz)))
+			err(EXIT_FAILURE, NULL);
+		strlcat(*fname, ".", sz);
+		strlcat(*fname, sf->name, sz);
+	}
+
+	TAILQ_FOREACH(sf, q, entries) {
+		if (NULL == TAILQ_NEXT(sf, entries))
+			break;
+		if (NULL == *name) {
+			if (NULL == (*name = strdup(sf->name)))
+				err(EXIT_FAILURE, NULL);
+			continue;
+		}
+		sz = strlen(*name) + strlen(sf->name) + 2;
+		if (NULL == (*name = realloc(*name, sz)))
+			err(EXIT_FAILURE, NULL);
+		strlcat(*name, ".", sz);
+		strlcat(*name, sf->name, sz);
+	}
+}
+
 /*
  * Parse the field used in a search.  This is the FIELD designation in
  * parse_config_search().
@@ -1042,14 +1150,12 @@ parse_field(struct parse *p, struct field *fd)
 static void
 parse_config_search_terms(struct parse *p, struct sent *sent)
 {
-	struct sref	*sf;
-	size_t		 sz;
 
 	if (TOK_IDENT != parse_next(p)) {
 		parse_errx(p, "expected field identifier");
 		return;
 	}
-	sref_alloc(p, p->last.string, sent);
+	sref_alloc(p, p->last.string, &sent->srq, sent);
 
 	while (TOK_ERR != p->lasttype && TOK_EOF != p->lasttype) {
 		if (TOK_COMMA == parse_next(p) ||
@@ -1089,46 +1195,51 @@ parse_config_search_terms(struct parse *p, struct sent *sent)
 			parse_errx(p, "expected field identifier");
 			return;
 		}
-		sref_alloc(p, p->last.string, sent);
+		sref_alloc(p, p->last.string, &sent->srq, sent);
 	}
 
-	/*
-	 * Now fill in the search field's canonical and partial
-	 * structure name.
-	 * For example of the latter, if our fields are
-	 * "user.company.name", this would be "user.company".
-	 * For a singleton field (e.g., "userid"), this is NULL.
-	 */
+	sref_names(&sent->srq, &sent->name, &sent->fname);
+}
 
-	TAILQ_FOREACH(sf, &sent->srq, entries) {
-		if (NULL == sent->fname) {
-			sent->fname = strdup(sf->name);
-			if (NULL == sent->fname)
-				err(EXIT_FAILURE, NULL);
-			continue;
-		}
-		sz = strlen(sent->fname) +
-		     strlen(sf->name) + 2;
-		sent->fname = realloc(sent->fname, sz);
-		strlcat(sent->fname, ".", sz);
-		strlcat(sent->fname, sf->name, sz);
-	}
+/*
+ * Parse the ordering terms of a search's "order" parameter:
+ *
+ *  "order" term ["," term]*
+ *
+ * Each term is a field (possibly in dot-notation, as for search
+ * fields) followed by an optional "asc" or "desc".
+ * On return, the last token is the one following the terms.
+ */
+static void
+parse_config_search_order(struct parse *p, struct search *s)
+{
+	struct ord	*ord;
 
-	TAILQ_FOREACH(sf, &sent->srq, entries) {
-		if (NULL == TAILQ_NEXT(sf, entries))
-			break;
-		if (NULL == sent->name) {
-			sent->name = strdup(sf->name);
-			if (NULL == sent->name)
-				err(EXIT_FAILURE, NULL);
+	do {
+		if (TOK_IDENT != parse_next(p)) {
+			parse_errx(p, "expected order field");
+			return;
+		}
+		ord = ord_alloc(p, s);
+		sref_alloc(p, p->last.string, &ord->srq, NULL);
+		while (TOK_PERIOD == parse_next(p)) {
+			if (TOK_IDENT != parse_next(p)) {
+				parse_errx(p, "expected order field");
+				return;
+			}
+			sref_alloc(p, p->last.string, &ord->srq, NULL);
+		}
+		sref_names(&ord->srq, &ord->name, &ord->fname);
+		if (TOK_IDENT != p->lasttype)
 			continue;
+		if (0 == strcasecmp("asc", p->last.string)) {
+			ord->op = ORDTYPE_ASC;
+			parse_next(p);
+		} else if (0 == strcasecmp("desc", p->last.string)) {
+			ord->op = ORDTYPE_DESC;
+			parse_next(p);
 		}
-		sz = strlen(sent->name) +
-		     strlen(sf->name) + 2;
-		sent->name = realloc(sent->name, sz);
-		strlcat(sent->name, ".", sz);
-		strlcat(sent->name, sf->name, sz);
-	}
+	} while (TOK_COMMA == p->lasttype);
 }
 
 /*
@@ -1138,6 +1249,9 @@ parse_config_search_terms(struct parse *p, struct sent *sent)
  *
  * The "key" can be "name" or "comment"; and the name, a unique function
  * name or a comment literal.
+ * It may also be "order", followed by ordering terms; "fields",
+ * followed by the fields to select; or "limit", "offset", "after", or
+ * "cache", which take no value.
  */
 static void
 parse_config_search_params(struct parse *p, struct search *s)
@@ -1181,6 +1295,45 @@ parse_config_search_params(struct parse *p, struct search *s)
 				break;
 			if (TOK_SEMICOLON == parse_next(p))
 				break;
+		} else if (0 == strcasecmp("order", p->last.string)) {
+			if ( ! TAILQ_EMPTY(&s->ordq)) {
+				parse_errx(p, "duplicate order");
+				break;
+			}
+			parse_config_search_order(p, s);
+			if (TOK_SEMICOLON == p->lasttype)
+				break;
+		} else if (0 == strcasecmp("fields", p->last.string)) {
+			if ( ! TAILQ_EMPTY(&s->fq)) {
+				parse_errx(p, "duplicate fields");
+				break;
+			}
+			do {
+				if (TOK_IDENT != parse_next(p)) {
+					parse_errx(p, "expected field");
+					break;
+				}
+				sref_alloc(p, p->last.string, 
+					&s->fq, NULL);
+			} while (TOK_COMMA == parse_next(p));
+			if (TOK_SEMICOLON == p->lasttype)
+				break;
+		} else if (0 == strcasecmp("limit", p->last.string)) {
+			s->flags |= SEARCH_HAS_LIMIT;
+			if (TOK_SEMICOLON == parse_next(p))
+				break;
+		} else if (0 == strcasecmp("offset", p->last.string)) {
+			s->flags |= SEARCH_HAS_OFFSET;
+			if (TOK_SEMICOLON == parse_next(p))
+				break;
+		} else if (0 == strcasecmp("after", p->last.string)) {
+			s->flags |= SEARCH_HAS_AFTER;
+			if (TOK_SEMICOLON == parse_next(p))
+				break;
+		} else if (0 == strcasecmp("cache", p->last.string)) {
+			s->flags |= SEARCH_IS_CACHED;
+			if (TOK_SEMICOLON == parse_next(p))
+				break;
 		} else {
 			parse_errx(p, "unknown search parameter");
 			break;
@@ -1270,7 +1423,8 @@ parse_config_unique(struct parse *p, struct strct *s)
  *
  * The fields ("ufield" for update field and "sfield" for select field)
  * are within the current structure.
- * These are only for UPT_MODIFY parses.
+ * These are only for UP_MODIFY and UP_UPSERT parses: for the latter,
+ * "sfield" is the conflict target.
  * Note that "sfield" also contains an optional operator, just like in
  * the search parameters.
  */
@@ -1289,6 +1443,8 @@ parse_config_update(struct parse *p, struct strct *s, enum upt type)
 
 	if (UP_MODIFY == up->type)
 		TAILQ_INSERT_TAIL(&s->uq, up, entries);
+	else if (UP_UPSERT == up->type)
+		TAILQ_INSERT_TAIL(&s->pq, up, entries);
 	else
 		TAILQ_INSERT_TAIL(&s->dq, up, entries);
 
@@ -1296,9 +1452,10 @@ parse_config_update(struct parse *p, struct strct *s, enum upt type)
 	 * For modifiers, start with the fields that will be updated.
 	 * (At least one field will be updated.)
 	 * This is followed by a colon.
+	 * Upserts update these fields on conflict.
 	 */
 
-	if (UP_MODIFY == up->type) {
+	if (UP_DELETE != up->type) {
 		if (TOK_IDENT != parse_next(p)) {
 			parse_errx(p, "expected field to modify");
 			return;
@@ -1434,12 +1591,16 @@ parse_config_search(struct parse *p, struct strct *s, enum stype stype)
 	srch->type = stype;
 	parse_point(p, &srch->pos);
 	TAILQ_INIT(&srch->sntq);
+	TAILQ_INIT(&srch->ordq);
+	TAILQ_INIT(&srch->fq);
 	TAILQ_INSERT_TAIL(&s->sq, srch, entries);
 
 	if (STYPE_LIST == stype)
 		s->flags |= STRCT_HAS_QUEUE;
 	else if (STYPE_ITERATE == stype)
 		s->flags |= STRCT_HAS_ITERATOR;
+	else if (STYPE_ARRAY == stype)
+		s->flags |= STRCT_HAS_ARRAY;
 
 	/* We need at least one search term. */
 
@@ -1584,9 +1745,11 @@ parse_enum_data(struct parse *p, struct enm *e)
  * 
  *  "{" 
  *    ["field" ident FIELD]+ 
- *    [["iterate" | "search" | "list" ] search_fields]*
+ *    [["iterate" | "search" | "list" | "array" |
+ *      "count" | "exists" ] search_fields]*
  *    ["update" update_fields]*
  *    ["delete" delete_fields]*
+ *    ["upsert" update_fields]*
  *    ["unique" unique_fields]*
  *    ["comment" quoted_string]?
  *  "};"
@@ -1626,12 +1789,24 @@ parse_struct_data(struct parse *p, struct strct *s)
 		} else if (0 == strcasecmp(p->last.string, "iterate")) {
 			parse_config_search(p, s, STYPE_ITERATE);
 			continue;
+		} else if (0 == strcasecmp(p->last.string, "array")) {
+			parse_config_search(p, s, STYPE_ARRAY);
+			continue;
+		} else if (0 == strcasecmp(p->last.string, "count")) {
+			parse_config_search(p, s, STYPE_COUNT);
+			continue;
+		} else if (0 == strcasecmp(p->last.string, "exists")) {
+			parse_config_search(p, s, STYPE_EXISTS);
+			continue;
 		} else if (0 == strcasecmp(p->last.string, "update")) {
 			parse_config_update(p, s, UP_MODIFY);
 			continue;
 		} else if (0 == strcasecmp(p->last.string, "delete")) {
 			parse_config_update(p, s, UP_DELETE);
 			continue;
+		} else if (0 == strcasecmp(p->last.string, "upsert")) {
+			parse_config_update(p, s, UP_UPSERT);
+			continue;
 		} else if (0 == strcasecmp(p->last.string, "unique")) {
 			parse_config_unique(p, s);
 			continue;
@@ -1750,9 +1925,147 @@ parse_struct(struct parse *p, struct strctq *q)
 	TAILQ_INIT(&s->uq);
 	TAILQ_INIT(&s->nq);
 	TAILQ_INIT(&s->dq);
+	TAILQ_INIT(&s->pq);
+	TAILQ_INIT(&s->ixq);
 	parse_struct_data(p, s);
 }
 
+/*
+ * Read the value of a database setting "type", which must be an
+ * integer in the given range or one of the identifiers in "vals" (if
+ * not NULL).
+ * Sets the value in "cfg" and returns the next token.
+ */
+static enum tok
+parse_database_value(struct parse *p, struct config *cfg, 
+	enum pragmat type, const char *const *vals, 
+	int64_t min, int64_t max)
+{
+	const char *const *cp;
+	char	 buf[32];
+
+	if (NULL != vals) {
+		if (TOK_IDENT != parse_next(p))
+			return(parse_errx(p, "expected %s value", 
+				pragmas[type]));
+		for (cp = vals; NULL != *cp; cp++)
+			if (0 == strcasecmp(*cp, p->last.string))
+				break;
+		if (NULL == *cp)
+			return(parse_errx(p, "unknown %s value", 
+				pragmas[type]));
+		if (NULL == (cfg->pragmas[type] = strdup(*cp)))
+			err(EXIT_FAILURE, NULL);
+		return(parse_next(p));
+	}
+
+	if (TOK_INTEGER != parse_next(p))
+		return(parse_errx(p, "expected %s value", 
+			pragmas[type]));
+	if (p->last.integer < min || p->last.integer > max)
+		return(parse_errx(p, "%s value out of range", 
+			pragmas[type]));
+	if (PRAGMA_PAGESIZE == type &&
+	    (p->last.integer & (p->last.integer - 1)))
+		return(parse_errx(p, "%s value not a power of two",
+			pragmas[type]));
+	snprintf(buf, sizeof(buf), "%" PRId64, p->last.integer);
+	if (NULL == (cfg->pragmas[type] = strdup(buf)))
+		err(EXIT_FAILURE, NULL);
+	return(parse_next(p));
+}
+
+/*
+ * Read the database settings.
+ * Each may be set only once.
+ * Its syntax is:
+ *
+ *  "{"
+ *    [ "pagesize" integer ";" ]?
+ *    [ "journal" "delete"|"truncate"|"persist"|"memory"|
+ *      "wal"|"off" ";" ]?
+ *    [ "synchronous" "off"|"normal"|"full"|"extra" ";" ]?
+ *    [ "cachesize" integer ";" ]?
+ *    [ "mmapsize" integer ";" ]?
+ *    [ "tempstore" "default"|"file"|"memory" ";" ]?
+ *    [ "busytimeout" integer ";" ]?
+ *  "};"
+ *
+ * The page size must be a power of two from 512 to 65536, and the
+ * map size and busy timeout (in milliseconds) non-negative.
+ */
+static void
+parse_database(struct parse *p, struct config *cfg)
+{
+	enum pragmat	 type;
+
+	if (TOK_LBRACE != parse_next(p)) {
+		parse_errx(p, "expected left brace");
+		return;
+	}
+
+	while ( ! PARSE_STOP(p)) {
+		if (TOK_RBRACE == parse_next(p))
+			break;
+		if (TOK_IDENT != p->lasttype) {
+			parse_errx(p, "expected database setting");
+			return;
+		}
+
+		for (type = 0; type < PRAGMA__MAX; type++)
+			if (0 == strcasecmp(p->last.string, 
+			    pragmas[type]))
+				break;
+		if (PRAGMA__MAX == type) {
+			parse_errx(p, "unknown database setting");
+			return;
+		} else if (NULL != cfg->pragmas[type]) {
+			parse_errx(p, "duplicate database setting");
+			return;
+		}
+
+		switch (type) {
+		case (PRAGMA_JOURNAL):
+			parse_database_value(p, cfg, type, 
+				journals, 0, 0);
+			break;
+		case (PRAGMA_SYNC):
+			parse_database_value(p, cfg, type, 
+				syncs, 0, 0);
+			break;
+		case (PRAGMA_TEMPSTORE):
+			parse_database_value(p, cfg, type, 
+				tempstores, 0, 0);
+			break;
+		case (PRAGMA_CACHESIZE):
+			parse_database_value(p, cfg, type, 
+				NULL, -INT64_MAX, INT64_MAX);
+			break;
+		case (PRAGMA_PAGESIZE):
+			parse_database_value(p, cfg, type, 
+				NULL, 512, 65536);
+			break;
+		default:
+			parse_database_value(p, cfg, type, 
+				NULL, 0, INT64_MAX);
+			break;
+		}
+
+		if (PARSE_STOP(p))
+			return;
+		if (TOK_SEMICOLON != p->lasttype) {
+			parse_errx(p, "expected semicolon");
+			return;
+		}
+	}
+
+	if (PARSE_STOP(p))
+		return;
+
+	if (TOK_SEMICOLON != parse_next(p))
+		parse_errx(p, "expected semicolon");
+}
+
 /*
  * Top-level parse.
  * Read until we reach an identifier for a structure.
@@ -1760,10 +2073,11 @@ parse_struct(struct parse *p, struct strctq *q)
  * Then continue until we've read all structures.
  * Its syntax is:
  *
- *  [ "struct" ident STRUCT | "enum" ident ENUM ]+
+ *  [ "struct" ident STRUCT | "enum" ident ENUM | "database" DATABASE ]+
  *
- * Where STRUCT is defined in parse_struct_data and ident is a unique,
- * alphanumeric (starting with alpha), non-reserved string.
+ * Where STRUCT is defined in parse_struct_data, DATABASE in
+ * parse_database, and ident is a unique, alphanumeric (starting with
+ * alpha), non-reserved string.
  */
 struct config *
 parse_config(FILE *f, const char *fname)
@@ -1810,6 +2124,9 @@ parse_config(FILE *f, const char *fname)
 				continue;
 			}
 			parse_errx(&p, "expected struct name");
+		} else if (0 == strcasecmp(p.last.string, "database")) {
+			parse_database(&p, cfg);
+			continue;
 		} else
 			parse_errx(&p, "unknown top-level type");
 	}
@@ -1866,6 +2183,7 @@ parse_free_search(struct search *p)
 {
 	struct sref	*s;
 	struct sent	*sent;
+	struct ord	*ord;
 
 	if (NULL == p)
 		return;
@@ -1881,6 +2199,22 @@ parse_free_search(struct search *p)
 		free(sent->name);
 		free(sent);
 	}
+	while (NULL != (ord = TAILQ_FIRST(&p->ordq))) {
+		TAILQ_REMOVE(&p->ordq, ord, entries);
+		while (NULL != (s = TAILQ_FIRST(&ord->srq))) {
+			TAILQ_REMOVE(&ord->srq, s, entries);
+			free(s->name);
+			free(s);
+		}
+		free(ord->fname);
+		free(ord->name);
+		free(ord);
+	}
+	while (NULL != (s = TAILQ_FIRST(&p->fq))) {
+		TAILQ_REMOVE(&p->fq, s, entries);
+		free(s->name);
+		free(s);
+	}
 	free(p->doc);
 	free(p->name);
 	free(p);
@@ -1998,11 +2332,16 @@ parse_free(struct config *cfg)
 	struct alias	*a;
 	struct update	*u;
 	struct unique	*n;
+	struct sindex	*ix;
 	struct enm	*e;
+	size_t		 i;
 
 	if (NULL == cfg)
 		return;
 
+	for (i = 0; i < PRAGMA__MAX; i++)
+		free(cfg->pragmas[i]);
+
 	while (NULL != (e = TAILQ_FIRST(&cfg->eq))) {
 		TAILQ_REMOVE(&cfg->eq, e, entries);
 		parse_free_enum(e);
@@ -2032,10 +2371,21 @@ parse_free(struct config *cfg)
 			TAILQ_REMOVE(&p->dq, u, entries);
 			parse_free_update(u);
 		}
+		while (NULL != (u = TAILQ_FIRST(&p->pq))) {
+			TAILQ_REMOVE(&p->pq, u, entries);
+			parse_free_update(u);
+		}
 		while (NULL != (n = TAILQ_FIRST(&p->nq))) {
 			TAILQ_REMOVE(&p->nq, n, entries);
 			parse_free_unique(n);
 		}
+		while (NULL != (ix = TAILQ_FIRST(&p->ixq))) {
+			TAILQ_REMOVE(&p->ixq, ix, entries);
+			free(ix->name);
+			free(ix->cols);
+			free(ix->where);
+			free(ix);
+		}
 		free(p->doc);
 		free(p->name);
 		free(p->cname);
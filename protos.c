@@ -62,7 +62,7 @@ void
 print_func_db_open(int decl)
 {
 
-	printf("struct ksql *%sdb_open(const char *file)%s\n",
+	printf("struct kwbp *%sdb_open(const char *file)%s\n",
 		decl ? "" : "\n", decl ? ";" : "");
 }
 
@@ -75,7 +75,256 @@ void
 print_func_db_close(int decl)
 {
 
-	printf("void%sdb_close(struct ksql *p)%s\n",
+	printf("void%sdb_close(struct kwbp *p)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function opening a transaction, for writing if "write" is
+ * non-zero.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_trans_open(int write, int decl)
+{
+
+	printf("int%sdb_trans_open_%s(struct kwbp *ctx)%s",
+		decl ? " " : "\n", write ? "write" : "read", 
+		decl ? ";\n" : "");
+}
+
+/*
+ * Generate the function committing (or, if "rollback" is non-zero,
+ * rolling back) a transaction.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_trans_close(int rollback, int decl)
+{
+
+	printf("int%sdb_trans_%s(struct kwbp *ctx)%s",
+		decl ? " " : "\n", rollback ? "rollback" : "commit", 
+		decl ? ";\n" : "");
+}
+
+/*
+ * Generate the function reporting lock contention.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_busy_stats(int decl)
+{
+
+	printf("void%sdb_busy_stats(struct kwbp *ctx, "
+		"struct kwbp_busystats *p)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function setting how long to wait for locks.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_busy_timeout(int decl)
+{
+
+	printf("void%sdb_busy_timeout(struct kwbp *ctx, int64_t ms)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function reporting whether the last write gave up on a
+ * locked database.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_busy_expired(int decl)
+{
+
+	printf("int%sdb_busy_expired(struct kwbp *ctx)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function setting the deadline of searches.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_deadline(int decl)
+{
+
+	printf("void%sdb_deadline(struct kwbp *ctx, int64_t ms)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function reporting whether the last search timed out.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_deadline_expired(int decl)
+{
+
+	printf("int%sdb_deadline_expired(struct kwbp *ctx)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function attaching the shared-memory row cache.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_shm_attach(int decl)
+{
+
+	printf("int%sdb_shm_attach(struct kwbp *ctx, const char *file)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the "arena" allocation function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_arena_alloc(int decl)
+{
+
+	printf("struct kwbp_arena *%sdb_arena_alloc(void)%s\n",
+		decl ? "" : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the "arena" reset function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_arena_reset(int decl)
+{
+
+	printf("void%sdb_arena_reset(struct kwbp_arena *a)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the "arena" free function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_arena_free(int decl)
+{
+
+	printf("void%sdb_arena_free(struct kwbp_arena *a)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the connection pool "open" function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_open(int decl)
+{
+
+	printf("struct kwbp_pool *%sdb_pool_open(const char *file, "
+		"size_t nreaders)%s\n",
+		decl ? "" : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the connection pool "close" function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_close(int decl)
+{
+
+	printf("void%sdb_pool_close(struct kwbp_pool *pool)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function checking out a connection from the pool, the
+ * writer if "write" is non-zero.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_get(int write, int decl)
+{
+
+	printf("struct kwbp *%sdb_pool_get_%s(struct kwbp_pool *pool)%s\n",
+		decl ? "" : "\n", write ? "write" : "read", 
+		decl ? ";" : "");
+}
+
+/*
+ * Generate the function returning a connection to the pool.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_put(int decl)
+{
+
+	printf("void%sdb_pool_put(struct kwbp_pool *pool, "
+		"struct kwbp *ctx)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function attaching the shared-memory row cache to all
+ * connections of a pool.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_shm_attach(int decl)
+{
+
+	printf("int%sdb_pool_shm_attach(struct kwbp_pool *pool, "
+		"const char *file)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function attaching the per-statement metrics.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_metrics_attach(int decl)
+{
+
+	printf("int%sdb_metrics_attach(struct kwbp *ctx, "
+		"const char *file)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
+/*
+ * Generate the function attaching the per-statement metrics to all
+ * connections of a pool.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_pool_metrics_attach(int decl)
+{
+
+	printf("int%sdb_pool_metrics_attach(struct kwbp_pool *pool, "
+		"const char *file)%s\n",
 		decl ? " " : "\n", decl ? ";" : "");
 }
 
@@ -122,23 +371,97 @@ print_var(size_t pos, size_t col,
 }
 
 /*
- * Generate the "update" function for a given structure.
- * If this is NOT a declaration ("decl"), then print a newline after the
- * return type; otherwise, have it on one line.
+ * Print a non-field parameter "str" in a function declaration.
+ * The "col" is the current position in the output line.
+ * Returns the current position in the output line.
  */
-void
-print_func_db_update(const struct update *u, int decl)
+static int
+print_param(const char *str, int col)
 {
-	const struct uref *ur;
+
+	putchar(',');
+	if (col >= 72) {
+		printf("\n\t");
+		col = 0;
+	} else {
+		putchar(' ');
+		col++;
+	}
+	return(col + printf("%s", str));
+}
+
+/*
+ * Print the name suffix of a search function, either the search's name
+ * or the fields and operations it searches by.
+ * Returns the number of characters printed.
+ */
+static int
+print_search_name(const struct search *s)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	int	 col = 0;
+
+	if (NULL != s->name)
+		return(printf("_%s", s->name));
+
+	col += printf("_by");
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		TAILQ_FOREACH(sr, &sent->srq, entries)
+			col += printf("_%s", sr->name);
+		col += printf("_%s", optypes[sent->op]);
+	}
+	return(col);
+}
+
+/*
+ * Print the search variables of a search function.
+ * The "col" is the current position in the output line.
+ * Returns the current position in the output line.
+ */
+static int
+print_search_vars(const struct search *s, int col)
+{
+	const struct sent *sent;
+	const struct sref *sr;
 	size_t	 pos = 1;
+
+	/* Don't accept input for unary operation. */
+
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		if (OPTYPE_ISUNARY(sent->op))
+			continue;
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		col = print_var(pos++, col, sr->field, 0);
+	}
+
+	/* Paging parameters follow the search terms. */
+
+	if (SEARCH_HAS_LIMIT & s->flags)
+		col = print_param("int64_t limit", col);
+	if (SEARCH_HAS_OFFSET & s->flags)
+		col = print_param("int64_t offset", col);
+	if (SEARCH_HAS_AFTER & s->flags) {
+		col = print_param("const struct ", col);
+		col += printf("%s *after", s->parent->name);
+	}
+	return(col);
+}
+
+/*
+ * Print the name of an update or delete function, sans return type.
+ * Returns the number of characters printed.
+ */
+static int
+print_update_name(const struct update *u)
+{
+	const struct uref *ur;
 	int	 col = 0;
 
 	if (UP_MODIFY == u->type)
-		col += printf("int%sdb_%s_update",
-			decl ? " " : "\n", u->parent->name);
+		col += printf("db_%s_update", u->parent->name);
 	else
-		col += printf("int%sdb_%s_delete",
-			decl ? " " : "\n", u->parent->name);
+		col += printf("db_%s_delete", u->parent->name);
 
 	if (NULL == u->name && UP_MODIFY == u->type) {
 		TAILQ_FOREACH(ur, &u->mrq, entries)
@@ -155,7 +478,31 @@ print_func_db_update(const struct update *u, int decl)
 	} else 
 		col += printf("_%s", u->name);
 
-	col += printf("(struct ksql *db");
+	return(col);
+}
+
+/*
+ * Generate the "update" function for a given structure.
+ * If "ret" is non-zero, this is the variant filling in the modified
+ * row.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_update(const struct update *u, int ret, int decl)
+{
+	const struct uref *ur;
+	size_t	 pos = 1;
+	int	 col = 0;
+
+	col += printf("int%s", decl ? " " : "\n");
+	col += print_update_name(u);
+
+	if (ret)
+		col += printf("_ret(struct kwbp *ctx, struct %s *p",
+			u->parent->name);
+	else
+		col += printf("(struct kwbp *ctx");
 
 	TAILQ_FOREACH(ur, &u->mrq, entries)
 		col = print_var(pos++, col, 
@@ -170,19 +517,49 @@ print_func_db_update(const struct update *u, int decl)
 	printf(")%s", decl ? ";\n" : "");
 }
 
+/*
+ * Generate the set-based "update" function for a given structure, which
+ * accepts an array of values for its sole constraint.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_update_many(const struct update *u, int decl)
+{
+	const struct uref *ur;
+	size_t	 pos = 1;
+	int	 col = 0;
+
+	assert(UPDATE_HAS_MANY & u->flags);
+	col += printf("int64_t%s", decl ? " " : "\n");
+	col += print_update_name(u);
+	col += printf("_many(struct kwbp *ctx");
+
+	TAILQ_FOREACH(ur, &u->mrq, entries)
+		col = print_var(pos++, col, 
+			ur->field, ur->field->flags);
+
+	/* The constraint array is passed as for null values. */
+
+	ur = TAILQ_FIRST(&u->crq);
+	col = print_var(pos, col, ur->field, FIELD_NULL);
+	col = print_param("size_t sz", col);
+	printf(")%s", decl ? ";\n" : "");
+}
+
 /*
  * Generate the declaration for a search function "s".
  * The format of the declaration depends upon the search type.
+ * If "arena" is non-zero, list, array, and search functions accept an
+ * arena (possibly NULL) from which results are allocated.
+ * Count and exists functions return their result directly.
  * If this is NOT a declaration ("decl"), then print a newline after the
  * return type; otherwise, have it on one line.
  * FIXME: line wrapping.
  */
 void
-print_func_db_search(const struct search *s, int decl)
+print_func_db_search(const struct search *s, int arena, int decl)
 {
-	const struct sent *sent;
-	const struct sref *sr;
-	size_t	 pos = 1;
 	int	 col = 0;
 
 	if (STYPE_SEARCH == s->type)
@@ -193,52 +570,106 @@ print_func_db_search(const struct search *s, int decl)
 		col += printf("struct %s_q *%sdb_%s_list", 
 			s->parent->name, decl ? "" : "\n", 
 			s->parent->name);
+	else if (STYPE_ARRAY == s->type)
+		col += printf("struct %s_array *%sdb_%s_array", 
+			s->parent->name, decl ? "" : "\n", 
+			s->parent->name);
+	else if (STYPE_COUNT == s->type)
+		col += printf("int64_t%sdb_%s_count",
+			decl ? " " : "\n", s->parent->name);
+	else if (STYPE_EXISTS == s->type)
+		col += printf("int%sdb_%s_exists",
+			decl ? " " : "\n", s->parent->name);
 	else
-		col += printf("void%sdb_%s_iterate",
+		col += printf("int%sdb_%s_iterate",
 			decl ? " " : "\n", s->parent->name);
 
-	if (NULL == s->name) {
-		col += printf("_by");
-		TAILQ_FOREACH(sent, &s->sntq, entries) {
-			TAILQ_FOREACH(sr, &sent->srq, entries)
-				col += printf("_%s", sr->name);
-			col += printf("_%s", optypes[sent->op]);
-		}
-	} else 
-		col += printf("_%s", s->name);
-
-	col += printf("(struct ksql *db");
+	col += print_search_name(s);
+	col += printf("(struct kwbp *ctx");
 
 	if (STYPE_ITERATE == s->type)
 		col += printf(", %s_cb cb, void *arg", 
 			s->parent->name);
+	else if (arena && STYPE_COUNT != s->type &&
+	    STYPE_EXISTS != s->type)
+		col += printf(", struct kwbp_arena *a");
 
-	/* Don't accept input for unary operation. */
+	print_search_vars(s, col);
+	printf(")%s", decl ? ";\n" : "");
+}
 
-	TAILQ_FOREACH(sent, &s->sntq, entries) {
-		if (OPTYPE_ISUNARY(sent->op))
-			continue;
-		sr = TAILQ_LAST(&sent->srq, srefq);
-		col = print_var(pos++, col, sr->field, 0);
-	}
+/*
+ * Generate the declaration for opening a cursor over the iterate
+ * search "s".
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_cursor_open(const struct search *s, int decl)
+{
+	int	 col = 0;
 
+	assert(STYPE_ITERATE == s->type);
+	col += printf("struct %s_cursor *%sdb_%s_cursor_open", 
+		s->parent->name, decl ? "" : "\n", 
+		s->parent->name);
+	col += print_search_name(s);
+	col += printf("(struct kwbp *ctx");
+	print_search_vars(s, col);
 	printf(")%s", decl ? ";\n" : "");
 }
 
+/*
+ * Generate the "cursor_next" function for a given structure.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_cursor_next(const struct strct *p, int decl)
+{
+
+	assert(STRCT_HAS_ITERATOR & p->flags);
+	printf("const struct %s *%sdb_%s_cursor_next"
+	       "(struct %s_cursor *c)%s",
+	       p->name, decl ? "" : "\n", p->name, 
+	       p->name, decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "cursor_close" function for a given structure.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_cursor_close(const struct strct *p, int decl)
+{
+
+	assert(STRCT_HAS_ITERATOR & p->flags);
+	printf("void%sdb_%s_cursor_close(struct %s_cursor *c)%s",
+	       decl ? " " : "\n", p->name, p->name,
+	       decl ? ";\n" : "");
+}
+
 /*
  * Generate the "insert" function for a given structure.
+ * If "ret" is non-zero, this is the variant filling in the new row.
  * If this is NOT a declaration ("decl"), then print a newline after the
  * return type; otherwise, have it on one line.
  */
 void
-print_func_db_insert(const struct strct *p, int decl)
+print_func_db_insert(const struct strct *p, int ret, int decl)
 {
 	const struct field *f;
 	size_t	 pos = 1;
 	int	 col = 0;
 
-	col += printf("int64_t%sdb_%s_insert("
-		"struct ksql *db", decl ? " " : "\n", p->name);
+	if (ret)
+		col += printf("int%sdb_%s_insert_ret("
+			"struct kwbp *ctx, struct %s *p", 
+			decl ? " " : "\n", p->name, p->name);
+	else
+		col += printf("int64_t%sdb_%s_insert("
+			"struct kwbp *ctx", decl ? " " : "\n", p->name);
 
 	TAILQ_FOREACH(f, &p->fq, entries)
 		if ( ! (FTYPE_STRUCT == f->type ||
@@ -248,6 +679,147 @@ print_func_db_insert(const struct strct *p, int decl)
 	printf(")%s", decl ? ";\n" : "");
 }
 
+/*
+ * Generate the "upsert" function for a given structure.
+ * This accepts the same values as the "insert" function.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_upsert(const struct update *u, int decl)
+{
+	const struct field *f;
+	const struct uref *ur;
+	size_t	 pos = 1;
+	int	 col = 0;
+
+	assert(UP_UPSERT == u->type);
+	col += printf("int64_t%sdb_%s_upsert",
+		decl ? " " : "\n", u->parent->name);
+
+	if (NULL == u->name) {
+		TAILQ_FOREACH(ur, &u->mrq, entries)
+			col += printf("_%s", ur->name);
+		col += printf("_by");
+		TAILQ_FOREACH(ur, &u->crq, entries)
+			col += printf("_%s", ur->name);
+	} else 
+		col += printf("_%s", u->name);
+
+	col += printf("(struct kwbp *ctx");
+
+	TAILQ_FOREACH(f, &u->parent->fq, entries)
+		if ( ! (FTYPE_STRUCT == f->type ||
+		        FIELD_ROWID & f->flags))
+			col = print_var(pos++, col, f, f->flags);
+
+	printf(")%s", decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "insert_many" function.
+ * Its unhashed passwords are given in an array per password field.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_insert_many(const struct strct *p, int decl)
+{
+	const struct field *f;
+	size_t	 pos = 1;
+	int	 col = 0;
+	char	 buf[32];
+
+	col += printf("int%sdb_%s_insert_many(struct kwbp *ctx, "
+	       "const struct %s *v, size_t sz",
+	       decl ? " " : "\n", p->name, p->name);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_PASSWORD == f->type) {
+			snprintf(buf, sizeof(buf), 
+				"const char **pw%zu", pos++);
+			col = print_param(buf, col);
+		}
+	print_param("int64_t *ids", col);
+	printf(")%s", decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "load" function for the lazy field "f".
+ * Loading children (FIELD_CHILDREN) allocates, so these accept an arena
+ * if "arena" is non-zero.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_load(const struct field *f, int arena, int decl)
+{
+
+	assert(FIELD_LAZY & f->flags);
+	printf("struct %s%s *%sdb_%s_load_%s(struct kwbp *ctx, %s"
+	       "struct %s *p)%s",
+	       f->ref->tstrct, 
+	       FIELD_CHILDREN & f->flags ? "_q" : "",
+	       decl ? "" : "\n", f->parent->name, f->name,
+	       arena && (FIELD_CHILDREN & f->flags) ?
+	       "struct kwbp_arena *a, " : "",
+	       f->parent->name, decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "load" function for the lazy field "f" over all members
+ * of a queue.
+ * See print_func_db_load() for "arena".
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_load_q(const struct field *f, int arena, int decl)
+{
+
+	assert(FIELD_LAZY & f->flags);
+	assert(STRCT_HAS_QUEUE & f->parent->flags);
+	printf("void%sdb_%s_load_%s_q(struct kwbp *ctx, %s"
+	       "struct %s_q *q)%s",
+	       decl ? " " : "\n", f->parent->name, f->name, 
+	       arena && (FIELD_CHILDREN & f->flags) ?
+	       "struct kwbp_arena *a, " : "",
+	       f->parent->name, decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "load" function for the lazy field "f" over all members
+ * of an array.
+ * See print_func_db_load() for "arena".
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_load_array(const struct field *f, int arena, int decl)
+{
+
+	assert(FIELD_LAZY & f->flags);
+	assert(STRCT_HAS_ARRAY & f->parent->flags);
+	printf("void%sdb_%s_load_%s_array(struct kwbp *ctx, %s"
+	       "struct %s_array *q)%s",
+	       decl ? " " : "\n", f->parent->name, f->name, 
+	       arena && (FIELD_CHILDREN & f->flags) ?
+	       "struct kwbp_arena *a, " : "",
+	       f->parent->name, decl ? ";\n" : "");
+}
+
+/*
+ * Generate the "unload" function releasing lazily-loaded structures.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_unload(int decl)
+{
+
+	printf("void%sdb_unload(struct kwbp *ctx)%s\n",
+		decl ? " " : "\n", decl ? ";" : "");
+}
+
 /*
  * Generate the "freeq" function for a given structure.
  * If this is NOT a declaration ("decl"), then print a newline after the
@@ -263,6 +835,21 @@ print_func_db_freeq(const struct strct *p, int decl)
 	       decl ? ";\n" : "");
 }
 
+/*
+ * Generate the "freearray" function for a given structure.
+ * If this is NOT a declaration ("decl"), then print a newline after the
+ * return type; otherwise, have it on one line.
+ */
+void
+print_func_db_freearray(const struct strct *p, int decl)
+{
+
+	assert(STRCT_HAS_ARRAY & p->flags);
+	printf("void%sdb_%s_freearray(struct %s_array *q)%s",
+	       decl ? " " : "\n", p->name, p->name,
+	       decl ? ";\n" : "");
+}
+
 /*
  * Generate the "free" function for a given structure.
  * If this is NOT a declaration ("decl"), then print a newline after the
@@ -293,18 +880,20 @@ print_func_db_unfill(const struct strct *p, int decl)
 
 /*
  * Generate the "fill" function for a given structure.
+ * If "arena" is non-zero, the function also accepts an arena (possibly
+ * NULL) from which to allocate.
  * If this is NOT a declaration ("decl"), then print a newline after the
  * return type; otherwise, have it on one line.
  */
 void
-print_func_db_fill(const struct strct *p, int decl)
+print_func_db_fill(const struct strct *p, int arena, int decl)
 {
 
-	printf("void%sdb_%s_fill(struct %s *p, "
+	printf("void%sdb_%s_fill(%sstruct %s *p, "
 	       "struct ksqlstmt *stmt, size_t *pos)%s",
-	       decl ? " " : "\n",
-	       p->name, p->name,
-	       decl ? ";\n" : "");
+	       decl ? " " : "\n", p->name, 
+	       arena ? "struct kwbp_arena *a, " : "",
+	       p->name, decl ? ";\n" : "");
 }
 
 void
@@ -373,7 +962,7 @@ void
 print_func_json_iterate(const struct strct *p, int decl)
 {
 
-	printf("void%sjson_%s_iterate(const struct %s *p, "
+	printf("int%sjson_%s_iterate(const struct %s *p, "
 	        "void *arg)%s\n",
 		decl ? " " : "\n", p->name, 
 		p->name, decl ? ";" : "");
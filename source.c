@@ -48,6 +48,19 @@ static	const char *const optypes[OPTYPE__MAX] = {
 	"NOTNULL", /* OPTYPE_NOTNULL */
 };
 
+/*
+ * Names of the pragmas for database settings.
+ */
+static	const char *const pragmas[PRAGMA__MAX] = {
+	"page_size", /* PRAGMA_PAGESIZE */
+	"journal_mode", /* PRAGMA_JOURNAL */
+	"synchronous", /* PRAGMA_SYNC */
+	"cache_size", /* PRAGMA_CACHESIZE */
+	"mmap_size", /* PRAGMA_MMAPSIZE */
+	"temp_store", /* PRAGMA_TEMPSTORE */
+	"busy_timeout", /* PRAGMA_BUSYTIMEOUT */
+};
+
 /*
  * Functions extracting from a statement.
  * Note that FTYPE_TEXT and FTYPE_PASSWORD need a surrounding strdup.
@@ -122,9 +135,10 @@ static	const char *const validbins[VALIDATE__MAX] = {
 
 /*
  * Fill an individual field from the database.
+ * If "arena" is non-zero, allocate from the arena "a".
  */
 static void
-gen_strct_fill_field(const struct field *f)
+gen_strct_fill_field(const struct field *f, int arena)
 {
 	size_t	 indent;
 
@@ -159,14 +173,16 @@ gen_strct_fill_field(const struct field *f)
 
 		print_src(indent,
 			"p->%s_sz = ksql_stmt_bytes(stmt, *pos);\n"
-		        "p->%s = malloc(p->%s_sz);\n"
+		        "p->%s = %sp->%s_sz);\n"
 		        "if (NULL == p->%s) {\n"
 		        "perror(NULL);\n"
 		        "exit(EXIT_FAILURE);\n"
 		        "}\n"
 			"memcpy(p->%s, %s(stmt, (*pos)++), p->%s_sz);",
-			f->name, f->name, f->name, f->name,
-			f->name, coltypes[f->type], f->name);
+			f->name, f->name, 
+			arena ? "db_arena_get(a, " : "malloc(",
+			f->name, f->name, f->name, 
+			coltypes[f->type], f->name);
 
 		if (FIELD_NULL & f->flags) 
 			puts("\t} else\n"
@@ -186,8 +202,9 @@ gen_strct_fill_field(const struct field *f)
 		if (FTYPE_TEXT == f->type || 
 		    FTYPE_PASSWORD == f->type ||
 		    FTYPE_EMAIL == f->type)
-			printf("strdup(%s(stmt, (*pos)++));\n", 
-				coltypes[f->type]);
+			printf("%s%s(stmt, (*pos)++));\n", 
+				arena ? "db_arena_strdup(a, " : 
+				"strdup(", coltypes[f->type]);
 		else
 			printf("%s(stmt, (*pos)++);\n", 
 				coltypes[f->type]);
@@ -215,6 +232,54 @@ gen_strct_fill_field(const struct field *f)
 	}
 }
 
+/*
+ * Fill an individual field from the database without copying.
+ * Strings and blobs point directly into the statement's current row,
+ * so they're only valid until the statement is next stepped or reset.
+ */
+static void
+gen_strct_borrow_field(const struct field *f)
+{
+
+	if (FTYPE_STRUCT == f->type)
+		return;
+
+	if (FIELD_NULL & f->flags)
+		printf("\tp->has_%s = ! "
+			"ksql_stmt_isnull(stmt, *pos);\n"
+		       "\tif (p->has_%s)%s\n",
+			f->name, f->name, 
+			FTYPE_BLOB == f->type ? " {" : "");
+
+	/* 
+	 * Fetch the blob before its size, as the size of a blob may
+	 * otherwise be computed from a converted value.
+	 */
+
+	if (FTYPE_BLOB == f->type)
+		print_src(FIELD_NULL & f->flags ? 2 : 1,
+			"p->%s = (void *)%s(stmt, *pos);\n"
+			"p->%s_sz = ksql_stmt_bytes(stmt, (*pos)++);",
+			f->name, coltypes[f->type], f->name);
+	else if (FTYPE_TEXT == f->type || 
+		 FTYPE_PASSWORD == f->type ||
+		 FTYPE_EMAIL == f->type)
+		print_src(FIELD_NULL & f->flags ? 2 : 1,
+			"p->%s = (char *)%s(stmt, (*pos)++);",
+			f->name, coltypes[f->type]);
+	else
+		print_src(FIELD_NULL & f->flags ? 2 : 1,
+			"p->%s = %s(stmt, (*pos)++);",
+			f->name, coltypes[f->type]);
+
+	if ((FIELD_NULL & f->flags) && FTYPE_BLOB == f->type) 
+		puts("\t} else\n"
+		     "\t\t(*pos)++;");
+	else if (FIELD_NULL & f->flags) 
+		puts("\telse\n"
+		     "\t\t(*pos)++;");
+}
+
 /*
  * Generate the binding for a field of type "t" at field "pos".
  * Set "ptr" to be non-zero if this is passed in as a pointer.
@@ -235,131 +300,247 @@ gen_bindfunc(enum ftype t, size_t pos, int ptr)
 }
 
 /*
- * Print out a search function for an STYPE_ITERATE.
- * This calls a function pointer with the retrieved data.
+ * Return the member expression (relative to the structure) of the
+ * field at the end of the chain "q", e.g., "user.company.name".
+ * Shared structures are dereferenced with "->".
+ * If "has" is non-zero, return the member of its null flag instead.
  */
-static void
-gen_strct_func_iter(const struct search *s, size_t num)
+static const char *
+sref_member(const struct srefq *q, int has)
 {
-	const struct sent *sent;
+	static char	 buf[1024];
 	const struct sref *sr;
-	size_t	 pos;
 
-	assert(STYPE_ITERATE == s->type);
+	buf[0] = '\0';
+	TAILQ_FOREACH(sr, q, entries) {
+		if (NULL == TAILQ_NEXT(sr, entries)) {
+			if (has)
+				strlcat(buf, "has_", sizeof(buf));
+			strlcat(buf, sr->name, sizeof(buf));
+			break;
+		}
+		strlcat(buf, sr->name, sizeof(buf));
+		strlcat(buf, FIELD_SHARED & sr->field->flags ?
+			"->" : ".", sizeof(buf));
+	}
+	return(buf);
+}
 
-	print_func_db_search(s, 0);
-	printf("\n"
-	       "{\n"
-	       "\tstruct ksqlstmt *stmt;\n"
-	       "\tstruct %s p;\n"
-	       "\n"
-	       "\tksql_stmt_alloc(db, &stmt,\n"
-	       "\t\tstmts[STMT_%s_BY_SEARCH_%zu],\n"
-	       "\t\tSTMT_%s_BY_SEARCH_%zu);\n",
-	       s->parent->name, s->parent->cname, num, 
-	       s->parent->cname, num);
+/*
+ * Whether "p" has nested structures filled along with it (by joins),
+ * which a RETURNING clause can't fill.
+ */
+static int
+has_nested(const struct strct *p)
+{
+	const struct field *f;
 
-	pos = 1;
-	TAILQ_FOREACH(sent, &s->sntq, entries)
-		if (OPTYPE_ISBINARY(sent->op)) {
-			sr = TAILQ_LAST(&sent->srq, srefq);
-			gen_bindfunc(sr->field->type, pos++, 0);
-		}
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags))
+			return(1);
+	return(0);
+}
 
-	printf("\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
-	       "\t\tdb_%s_fill_r(&p, stmt, NULL);\n",
-	       s->parent->name);
+/*
+ * Whether any function counts its modified rows with db_changes(): the
+ * set-based updates and deletes, and the deletes filling in the row of
+ * a structure with nested structures.
+ */
+static int
+has_changes(const struct strctq *q)
+{
+	const struct strct *p;
+	const struct update *u;
 
-	/*
-	 * If we have any hashes, we're going to need to do the hash
-	 * check after the field has already been extracted from the
-	 * database.
-	 * If the hash doesn't match, don't run the callback.
-	 */
+	TAILQ_FOREACH(p, q, entries) {
+		TAILQ_FOREACH(u, &p->uq, entries)
+			if (UPDATE_HAS_MANY & u->flags)
+				return(1);
+		TAILQ_FOREACH(u, &p->dq, entries)
+			if (UPDATE_HAS_MANY & u->flags || has_nested(p))
+				return(1);
+	}
+	return(0);
+}
+
+/*
+ * Return the suffix of the function filling the results of search
+ * "s" numbered "num": "r" for db_xxx_fill_r() and db_xxx_borrow_r(),
+ * or the number for projections (see gen_func_project()).
+ */
+static const char *
+fill_suffix(const struct search *s, size_t num)
+{
+	static char	 buf[32];
+
+	if (TAILQ_EMPTY(&s->fq))
+		return("r");
+	snprintf(buf, sizeof(buf), "%zu", num);
+	return(buf);
+}
+
+/*
+ * Return the de-duplication table argument "d" passed by search "s" to
+ * its fill function, if it takes one (see gen_func_share()).
+ */
+static const char *
+fill_dedup(const struct search *s, const char *d)
+{
+
+	if ( ! TAILQ_EMPTY(&s->fq) ||
+	    ! (STRCT_HAS_DEDUP & s->parent->flags))
+		return("");
+	return(d);
+}
+
+/*
+ * Print the statement identifier used by search "num" of "s".
+ * Searches with a keyset position ("after") select between the first
+ * page and subsequent pages at run-time.
+ */
+static void
+gen_search_stmtid(const struct search *s, size_t num)
+{
+
+	if (SEARCH_HAS_AFTER & s->flags)
+		printf("NULL == after ?\n"
+		       "\t\tSTMT_%s_BY_SEARCH_%zu : "
+		       "STMT_%s_BY_SEARCH_%zu_AFTER",
+		       s->parent->cname, num, 
+		       s->parent->cname, num);
+	else
+		printf("STMT_%s_BY_SEARCH_%zu", 
+			s->parent->cname, num);
+}
+
+/*
+ * Count the statement placeholders of the keyset position predicate
+ * printed by gen_stmt_keyset().
+ */
+static size_t
+count_keyset(const struct search *s)
+{
+	const struct ord *ord;
+	size_t	 sz = 0;
+
+	TAILQ_FOREACH(ord, &s->ordq, entries)
+		sz++;
+	return(1 == sz ? 1 : 1 + sz * (sz + 1) / 2);
+}
+
+/*
+ * Generate the bindings for the search parameters of "s": the search
+ * terms, then the keyset position, limit, and offset.
+ * These follow the placeholders printed by gen_stmt_search().
+ */
+static void
+gen_search_binds(const struct search *s)
+{
+	const struct sent *sent;
+	const struct ord *ord, *oo;
+	const struct sref *sr;
+	size_t	 pos, idx;
 
 	pos = 1;
+	idx = 0;
 	TAILQ_FOREACH(sent, &s->sntq, entries) {
 		if (OPTYPE_ISUNARY(sent->op))
 			continue;
 		sr = TAILQ_LAST(&sent->srq, srefq);
-		if (FTYPE_PASSWORD != sr->field->type) {
-			pos++;
-			continue;
+		if (FTYPE_PASSWORD != sr->field->type)
+			idx++;
+		gen_bindfunc(sr->field->type, pos++, 0);
+	}
+
+	/*
+	 * The keyset predicate binds the leading ordering field, then
+	 * each term of the lexicographic comparison, in which all but
+	 * the last field of the term are tested for equality.
+	 */
+
+	if (SEARCH_HAS_AFTER & s->flags) {
+		puts("\tif (NULL != after) {");
+		pos = idx;
+		ord = TAILQ_FIRST(&s->ordq);
+		if (NULL != TAILQ_NEXT(ord, entries)) {
+			sr = TAILQ_LAST(&ord->srq, srefq);
+			printf("\t\t%s(stmt, %zu, after->%s);\n",
+				bindtypes[sr->field->type], 
+				pos++, sref_member(&ord->srq, 0));
 		}
-		printf("\t\tif (crypt_checkpass(v%zu, p.%s) < 0) {\n"
-		       "\t\t\tdb_%s_unfill_r(&p);\n"
-		       "\t\t\tcontinue;\n"
-		       "\t\t}\n",
-		       pos, sent->fname, s->parent->name);
-		pos++;
+		TAILQ_FOREACH(ord, &s->ordq, entries)
+			TAILQ_FOREACH(oo, &s->ordq, entries) {
+				sr = TAILQ_LAST(&oo->srq, srefq);
+				printf("\t\t%s(stmt, %zu, after->%s);\n",
+					bindtypes[sr->field->type], 
+					pos++, sref_member(&oo->srq, 0));
+				if (oo == ord)
+					break;
+			}
+		puts("\t}");
 	}
 
-	printf("\t\t(*cb)(&p, arg);\n"
-	       "\t\tdb_%s_unfill_r(&p);\n"
-	       "\t}\n"
-	       "\tksql_stmt_free(stmt);\n"
-	       "}\n"
-	       "\n",
-	       s->parent->name);
+	if (SEARCH_HAS_LIMIT & s->flags) {
+		if (SEARCH_HAS_AFTER & s->flags)
+			printf("\tksql_bind_int(stmt, NULL == after ? "
+				"%zu : %zu, limit);\n", 
+				idx, idx + count_keyset(s));
+		else
+			printf("\tksql_bind_int(stmt, %zu, limit);\n", idx);
+		idx++;
+	}
+	if (SEARCH_HAS_OFFSET & s->flags) {
+		if (SEARCH_HAS_AFTER & s->flags)
+			printf("\tksql_bind_int(stmt, NULL == after ? "
+				"%zu : %zu, offset);\n", 
+				idx, idx + count_keyset(s));
+		else
+			printf("\tksql_bind_int(stmt, %zu, offset);\n", idx);
+	}
 }
 
 /*
- * Print out a search function for an STYPE_LIST.
- * This searches for a multiplicity of values.
+ * Print out a search function for an STYPE_ITERATE.
+ * This calls a function pointer with the retrieved data, which is filled
+ * in-place from the statement (see gen_func_borrow_r()) as it needn't
+ * outlive the callback.
+ * It returns zero if interrupted by the deadline.
  */
 static void
-gen_strct_func_list(const struct search *s, size_t num)
+gen_strct_func_iter(const struct search *s, size_t num, int arena)
 {
 	const struct sent *sent;
 	const struct sref *sr;
 	size_t	 pos;
 
-	assert(STYPE_LIST == s->type);
+	assert(STYPE_ITERATE == s->type);
 
-	print_func_db_search(s, 0);
+	print_func_db_search(s, arena, 0);
 	printf("\n"
 	       "{\n"
 	       "\tstruct ksqlstmt *stmt;\n"
-	       "\tstruct %s_q *q;\n"
-	       "\tstruct %s *p;\n"
-	       "\n"
-	       "\tq = malloc(sizeof(struct %s_q));\n"
-	       "\tif (NULL == q) {\n"
-	       "\t\tperror(NULL);\n"
-	       "\t\texit(EXIT_FAILURE);\n"
-	       "\t}\n"
-	       "\tTAILQ_INIT(q);\n"
+	       "\tstruct %s p;\n"
 	       "\n"
-	       "\tksql_stmt_alloc(db, &stmt,\n"
-	       "\t\tstmts[STMT_%s_BY_SEARCH_%zu],\n"
-	       "\t\tSTMT_%s_BY_SEARCH_%zu);\n",
-	       s->parent->name, s->parent->name, 
-	       s->parent->name, s->parent->cname, num, 
-	       s->parent->cname, num);
+	       "\tstmt = db_stmt_get(ctx, ",
+	       s->parent->name);
+	gen_search_stmtid(s, num);
+	puts(");\n"
+	     "\tdb_deadline_start(ctx);");
+
+	gen_search_binds(s);
+
+	printf("\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tdb_%s_borrow_%s(&p, stmt, NULL);\n",
+	       s->parent->name, fill_suffix(s, num));
 
 	/*
 	 * If we have any hashes, we're going to need to do the hash
 	 * check after the field has already been extracted from the
 	 * database.
-	 * If the hash doesn't match, don't insert into the tailq.
+	 * If the hash doesn't match, don't run the callback.
 	 */
 
-	pos = 1;
-	TAILQ_FOREACH(sent, &s->sntq, entries)
-		if (OPTYPE_ISBINARY(sent->op)) {
-			sr = TAILQ_LAST(&sent->srq, srefq);
-			gen_bindfunc(sr->field->type, pos++, 0);
-		}
-
-	printf("\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
-	       "\t\tp = malloc(sizeof(struct %s));\n"
-	       "\t\tif (NULL == p) {\n"
-	       "\t\t\tperror(NULL);\n"
-	       "\t\t\texit(EXIT_FAILURE);\n"
-	       "\t\t}\n"
-	       "\t\tdb_%s_fill_r(p, stmt, NULL);\n",
-	       s->parent->name, s->parent->name);
-
 	pos = 1;
 	TAILQ_FOREACH(sent, &s->sntq, entries) {
 		if (OPTYPE_ISUNARY(sent->op))
@@ -369,173 +550,2835 @@ gen_strct_func_list(const struct search *s, size_t num)
 			pos++;
 			continue;
 		}
-		printf("\t\tif (crypt_checkpass(v%zu, p->%s) < 0) {\n"
-		       "\t\t\tdb_%s_free(p);\n"
-		       "\t\t\tcontinue;\n"
-		       "\t\t}\n",
-		       pos, sent->fname, s->parent->name);
+		printf("\t\tif (crypt_checkpass(v%zu, p.%s) < 0)\n"
+		       "\t\t\tcontinue;\n",
+		       pos, sent->fname);
 		pos++;
 	}
 
-	puts("\t\tTAILQ_INSERT_TAIL(q, p, _entries);\n"
-	     "\t}\n"
-	     "\tksql_stmt_free(stmt);\n"
-	     "\treturn(q);\n"
+	printf("\t\tif ((*cb)(&p, arg))\n"
+	       "\t\t\tbreak;\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, ");
+	gen_search_stmtid(s, num);
+	puts(", stmt);\n"
+	     "\tdb_deadline_stop(ctx);\n"
+	     "\treturn( ! ctx->expired);\n"
 	     "}\n"
 	     "");
 }
 
-static void
-gen_func_open(void)
+/*
+ * Count the password fields checked by search "s".
+ * These are hash-verified after extraction, not bound.
+ */
+static size_t
+count_passwords(const struct search *s)
 {
+	const struct sent *sent;
+	const struct sref *sr;
+	size_t	 sz = 0;
 
-	print_func_db_open(0);
-	puts("{\n"
-	     "\tstruct ksqlcfg cfg;\n"
-	     "\tstruct ksql *sql;\n"
-	     "\n"
-	     "\tmemset(&cfg, 0, sizeof(struct ksqlcfg));\n"
-	     "\tcfg.flags = KSQL_EXIT_ON_ERR |\n"
-	     "\t\tKSQL_FOREIGN_KEYS | KSQL_SAFE_EXIT;\n"
-	     "\tcfg.err = ksqlitemsg;\n"
-	     "\tcfg.dberr = ksqlitedbmsg;\n"
-	     "\n"
-	     "\tif (NULL == (sql = ksql_alloc(&cfg)))\n"
-	     "\t\treturn(NULL);\n"
-	     "\tksql_open(sql, file);\n"
-	     "\treturn(sql);\n"
-	     "}\n"
-	     "");
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		if (OPTYPE_ISUNARY(sent->op))
+			continue;
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD == sr->field->type)
+			sz++;
+	}
+	return(sz);
 }
 
-static void
-gen_func_close(void)
+/*
+ * Return the most password fields checked by any iterator of "p".
+ * This is the number of password copies its cursors must hold.
+ */
+static size_t
+count_cursor_passwords(const struct strct *p)
 {
+	const struct search *s;
+	size_t	 sz, max = 0;
 
-	print_func_db_close(0);
-	puts("{\n"
-	     "\tif (NULL == p)\n"
-	     "\t\treturn;\n"
-	     "\tksql_free(p);\n"
-	     "}\n"
-	     "");
+	TAILQ_FOREACH(s, &p->sq, entries)
+		if (STYPE_ITERATE == s->type &&
+		    (sz = count_passwords(s)) > max)
+			max = sz;
+	return(max);
 }
 
 /*
- * Print out a search function for an STYPE_SEARCH.
- * This searches for a singular value.
+ * Print out the cursor-opening function for an STYPE_ITERATE.
+ * This binds the search parameters, retaining a copy of any passwords
+ * for verification as rows are stepped (see gen_func_cursor()), and
+ * computes its deadline, or inherits that of an enclosing search.
  */
 static void
-gen_strct_func_srch(const struct search *s, size_t num)
+gen_strct_func_cursor_open(const struct search *s, size_t num)
 {
 	const struct sent *sent;
 	const struct sref *sr;
-	size_t	 pos;
+	size_t	 pos, npass;
 
-	assert(STYPE_SEARCH == s->type);
+	assert(STYPE_ITERATE == s->type);
 
-	print_func_db_search(s, 0);
+	print_func_db_cursor_open(s, 0);
 	printf("\n"
 	       "{\n"
 	       "\tstruct ksqlstmt *stmt;\n"
-	       "\tstruct %s *p = NULL;\n"
+	       "\tstruct %s_cursor *c;\n"
 	       "\n"
-	       "\tksql_stmt_alloc(db, &stmt,\n"
-	       "\t\tstmts[STMT_%s_BY_SEARCH_%zu],\n"
-	       "\t\tSTMT_%s_BY_SEARCH_%zu);\n",
-	       s->parent->name, s->parent->cname, num, 
-	       s->parent->cname, num);
-
-	pos = 1;
-	TAILQ_FOREACH(sent, &s->sntq, entries) 
-		if (OPTYPE_ISBINARY(sent->op)) {
-			sr = TAILQ_LAST(&sent->srq, srefq);
-			gen_bindfunc(sr->field->type, pos++, 0);
-		}
-
-	printf("\tif (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
-	       "\t\tp = malloc(sizeof(struct %s));\n"
-	       "\t\tif (NULL == p) {\n"
-	       "\t\t\tperror(NULL);\n"
-	       "\t\t\texit(EXIT_FAILURE);\n"
-	       "\t\t}\n"
-	       "\t\tdb_%s_fill_r(p, stmt, NULL);\n",
+	       "\tif (NULL == (c = calloc(1, "
+	       "sizeof(struct %s_cursor)))) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tc->ctx = ctx;\n"
+	       "\tc->id = ",
 	       s->parent->name, s->parent->name);
-
-	/*
-	 * If we have any hashes, we're going to need to do the hash
-	 * check after the field has already been extracted from the
-	 * database.
-	 * If the hash doesn't match, nullify.
-	 */
+	gen_search_stmtid(s, num);
+	puts(";\n"
+	     "\tc->stmt = stmt = db_stmt_get(ctx, c->id);");
 
 	pos = 1;
+	npass = 0;
 	TAILQ_FOREACH(sent, &s->sntq, entries) {
 		if (OPTYPE_ISUNARY(sent->op))
 			continue;
 		sr = TAILQ_LAST(&sent->srq, srefq);
-		if (FTYPE_PASSWORD != sr->field->type) {
-			pos++;
-			continue;
-		}
-		printf("\t\tif (NULL != p && "
-			"crypt_checkpass(v%zu, p->%s) < 0) {\n"
-		       "\t\t\tdb_%s_free(p);\n"
-		       "\t\t\tp = NULL;\n"
-		       "\t\t}\n",
-		       pos, sent->fname, s->parent->name);
+		if (FTYPE_PASSWORD == sr->field->type)
+			printf("\tif (NULL == (c->pass[%zu] = "
+				"strdup(v%zu))) {\n"
+			       "\t\tperror(NULL);\n"
+			       "\t\texit(EXIT_FAILURE);\n"
+			       "\t}\n", npass++, pos);
 		pos++;
 	}
 
-	puts("\t}\n"
-	     "\tksql_stmt_free(stmt);\n"
-	     "\treturn(p);\n"
+	gen_search_binds(s);
+	puts("\tdb_deadline_start(ctx);\n"
+	     "\tc->deadline_at = ctx->deadline_at;\n"
+	     "\tdb_deadline_stop(ctx);\n"
+	     "\treturn(c);\n"
 	     "}\n"
 	     "");
 }
 
 /*
- * Generate the "freeq" function.
- * This must have STRCT_HAS_QUEUE defined in its flags, otherwise the
- * function does nothing.
+ * Print the test of whether a cursor is over search "s" numbered
+ * "num", i.e., whether it was opened with the search's statement.
+ * If "wrap" is non-zero, a disjunction is parenthesised.
  */
 static void
-gen_func_freeq(const struct strct *p)
+gen_cursor_id(const struct search *s, size_t num, int wrap)
 {
 
-	if ( ! (STRCT_HAS_QUEUE & p->flags))
-		return;
-
-	print_func_db_freeq(p, 0);
-	printf("\n"
-	       "{\n"
-	       "\tstruct %s *p;\n\n"
-	       "\tif (NULL == q)\n"
-	       "\t\treturn;\n"
-	       "\twhile (NULL != (p = TAILQ_FIRST(q))) {\n"
-	       "\t\tTAILQ_REMOVE(q, p, _entries);\n"
-	       "\t\tdb_%s_free(p);\n"
-	       "\t}\n\n"
-	       "\tfree(q);\n"
-	       "}\n"
-	       "\n", 
-	       p->name, p->name);
+	if (SEARCH_HAS_AFTER & s->flags)
+		printf("%sSTMT_%s_BY_SEARCH_%zu == c->id ||\n"
+		       "\t\t    %sSTMT_%s_BY_SEARCH_%zu_AFTER == c->id%s",
+		       wrap ? "(" : "", s->parent->cname, num, 
+		       wrap ? " " : "", s->parent->cname, num,
+		       wrap ? ")" : "");
+	else
+		printf("STMT_%s_BY_SEARCH_%zu == c->id",
+			s->parent->cname, num);
 }
 
 /*
- * Generate the "insert" function.
+ * Generate the cursor "next" and "close" functions.
+ * This must have STRCT_HAS_ITERATOR defined in its flags, otherwise the
+ * function does nothing.
+ * Rows are filled in-place as for iterators, so they're valid until
+ * the next call to either function.
+ * Each step resumes the deadline computed when the cursor was opened,
+ * as if the cursor's search were still running, unless it's stepped
+ * from within another search.
  */
 static void
-gen_func_insert(const struct strct *p)
+gen_func_cursor(const struct strct *p)
 {
-	const struct field *f;
-	size_t	 pos, npos;
+	const struct search *s;
+	const struct sent *sent;
+	const struct sref *sr;
+	size_t	 num, npass, ncase, i;
+	int	 nplain;
 
-	print_func_db_insert(p, 0);
-	printf("\n"
-	       "{\n"
-	       "\tstruct ksqlstmt *stmt;\n"
-	       "\tint64_t id = -1;\n");
+	if ( ! (STRCT_HAS_ITERATOR & p->flags))
+		return;
+
+	print_func_db_cursor_next(p, 0);
+	puts("\n"
+	     "{\n"
+	     "\n"
+	     "\tif (c->done)\n"
+	     "\t\treturn(NULL);\n"
+	     "\tif (0 == c->ctx->deadline_depth++) {\n"
+	     "\t\tc->ctx->expired = 0;\n"
+	     "\t\tc->ctx->deadline_at = c->deadline_at;\n"
+	     "\t}");
+
+	/* Only rows failing password checks are stepped over. */
+
+	printf("\t%s (KSQL_ROW == ksql_stmt_step(c->stmt)) {\n",
+		count_cursor_passwords(p) > 0 ? "while" : "if");
+
+	/*
+	 * Iterators with projections fill with their own function.
+	 * Select it by the statement in question.
+	 */
+
+	nplain = ncase = 0;
+	TAILQ_FOREACH(s, &p->sq, entries)
+		if (STYPE_ITERATE == s->type && TAILQ_EMPTY(&s->fq))
+			nplain = 1;
+		else if (STYPE_ITERATE == s->type)
+			ncase++;
+	ncase += nplain;
+
+	num = i = 0;
+	TAILQ_FOREACH(s, &p->sq, entries) {
+		if (STYPE_ITERATE != s->type || TAILQ_EMPTY(&s->fq)) {
+			num++;
+			continue;
+		}
+		if (ncase > 1 && i == ncase - 1)
+			puts("\t\telse");
+		else if (ncase > 1) {
+			printf("\t\t%sif (", i > 0 ? "else " : "");
+			gen_cursor_id(s, num, 0);
+			puts(")");
+		}
+		printf("\t\t%sdb_%s_borrow_%zu"
+		       "(&c->p, c->stmt, NULL);\n",
+		       ncase > 1 ? "\t" : "", p->name, num++);
+		i++;
+	}
+	if (nplain && ncase > 1)
+		printf("\t\telse\n"
+		       "\t\t\tdb_%s_borrow_r(&c->p, c->stmt, NULL);\n",
+		       p->name);
+	else if (nplain)
+		printf("\t\tdb_%s_borrow_r(&c->p, c->stmt, NULL);\n",
+			p->name);
+
+	/*
+	 * If any of our iterators have hashes, verify them against the
+	 * password copies for the statement in question.
+	 * Skip rows that don't match.
+	 */
+
+	num = 0;
+	TAILQ_FOREACH(s, &p->sq, entries) {
+		if (STYPE_ITERATE != s->type ||
+		    0 == count_passwords(s)) {
+			num++;
+			continue;
+		}
+		printf("\t\tif (");
+		gen_cursor_id(s, num++, 1);
+		printf(" && (");
+		npass = 0;
+		TAILQ_FOREACH(sent, &s->sntq, entries) {
+			if (OPTYPE_ISUNARY(sent->op))
+				continue;
+			sr = TAILQ_LAST(&sent->srq, srefq);
+			if (FTYPE_PASSWORD != sr->field->type)
+				continue;
+			printf("%s\n\t\t    crypt_checkpass"
+				"(c->pass[%zu], c->p.%s) < 0",
+				npass > 0 ? " ||" : "", 
+				npass, sent->fname);
+			npass++;
+		}
+		puts("))\n"
+		     "\t\t\tcontinue;");
+	}
+
+	puts("\t\tdb_deadline_stop(c->ctx);\n"
+	     "\t\treturn(&c->p);\n"
+	     "\t}\n"
+	     "\tdb_deadline_stop(c->ctx);\n"
+	     "\tc->done = 1;\n"
+	     "\treturn(NULL);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_cursor_close(p, 0);
+	puts("\n"
+	     "{");
+	if ((npass = count_cursor_passwords(p)) > 0)
+		puts("\tsize_t i;");
+	puts("\n"
+	     "\tif (NULL == c)\n"
+	     "\t\treturn;\n"
+	     "\tdb_stmt_put(c->ctx, c->id, c->stmt);");
+	if (npass > 0)
+		printf("\tfor (i = 0; i < %zu; i++)\n"
+		       "\t\tfree(c->pass[i]);\n", npass);
+	puts("\tfree(c);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Release the de-duplication table of a list or array search, if it
+ * has one, once its rows have been stepped.
+ * Arena-allocated shared structures are never freed, so this is only
+ * done without an arena.
+ */
+static void
+gen_dedup_free(const struct search *s, int arena)
+{
+
+	if ('\0' == *fill_dedup(s, "&d, "))
+		return;
+	if (arena)
+		puts("\tif (NULL == a)\n"
+		     "\t\tdb_dedup_free(&d);");
+	else
+		puts("\tdb_dedup_free(&d);");
+}
+
+/*
+ * Print out a search function for an STYPE_LIST.
+ * This searches for a multiplicity of values, or returns NULL if
+ * interrupted by the deadline rather than the rows so far.
+ * If "arena" is non-zero, the queue and its members are allocated from
+ * the arena "a", if not NULL.
+ */
+static void
+gen_strct_func_list(const struct search *s, size_t num, int arena)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	size_t	 pos;
+
+	assert(STYPE_LIST == s->type);
+
+	print_func_db_search(s, arena, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s_q *q;\n"
+	       "\tstruct %s *p;\n"
+	       "%s"
+	       "\n"
+	       "\tq = %ssizeof(struct %s_q));\n"
+	       "\tif (NULL == q) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tTAILQ_INIT(q);\n"
+	       "\n"
+	       "\tstmt = db_stmt_get(ctx, ",
+	       s->parent->name, s->parent->name, 
+	       '\0' != *fill_dedup(s, "&d, ") ?
+	       "\tstruct kwbp_dedup d;\n" : "",
+	       arena ? "db_arena_get(a, " : "malloc(",
+	       s->parent->name);
+	gen_search_stmtid(s, num);
+	puts(");\n"
+	     "\tdb_deadline_start(ctx);");
+	if ('\0' != *fill_dedup(s, "&d, "))
+		puts("\tmemset(&d, 0, sizeof(struct kwbp_dedup));");
+
+	/*
+	 * If we have any hashes, we're going to need to do the hash
+	 * check after the field has already been extracted from the
+	 * database.
+	 * If the hash doesn't match, don't insert into the tailq.
+	 */
+
+	gen_search_binds(s);
+
+	printf("\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tp = %ssizeof(struct %s));\n"
+	       "\t\tif (NULL == p) {\n"
+	       "\t\t\tperror(NULL);\n"
+	       "\t\t\texit(EXIT_FAILURE);\n"
+	       "\t\t}\n"
+	       "\t\tdb_%s_fill_%s(%s%sp, stmt, NULL);\n",
+	       arena ? "db_arena_get(a, " : "malloc(",
+	       s->parent->name, s->parent->name,
+	       fill_suffix(s, num), arena ? "a, " : "",
+	       fill_dedup(s, "&d, "));
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		if (OPTYPE_ISUNARY(sent->op))
+			continue;
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD != sr->field->type) {
+			pos++;
+			continue;
+		}
+		printf("\t\tif (crypt_checkpass(v%zu, p->%s) < 0) {\n"
+		       "%s"
+		       "\t\t\tdb_%s_free(p);\n"
+		       "\t\t\tcontinue;\n"
+		       "\t\t}\n",
+		       pos, sref_member(&sent->srq, 0), 
+		       arena ? "\t\t\tif (NULL == a)\n\t" : "",
+		       s->parent->name);
+		pos++;
+	}
+
+	printf("\t\tTAILQ_INSERT_TAIL(q, p, _entries);\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, ");
+	gen_search_stmtid(s, num);
+	puts(", stmt);\n"
+	     "\tdb_deadline_stop(ctx);");
+	gen_dedup_free(s, arena);
+	printf("\tif (ctx->expired) {\n"
+	       "\t\t%sdb_%s_freeq(q);\n"
+	       "\t\treturn(NULL);\n"
+	       "\t}\n"
+	       "\treturn(q);\n"
+	       "}\n"
+	       "\n", arena ? "if (NULL == a)\n\t\t\t" : "",
+	       s->parent->name);
+}
+
+/*
+ * Print out a search function for an STYPE_ARRAY.
+ * This searches for a multiplicity of values, filling them into a
+ * contiguous buffer grown as rows are retrieved, or returns NULL if
+ * interrupted by the deadline.
+ * If "arena" is non-zero, the array and its members are allocated from
+ * the arena "a", if not NULL: the buffer is built on the heap, then
+ * copied into the arena once its size is known.
+ */
+static void
+gen_strct_func_array(const struct search *s, size_t num, int arena)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	size_t	 pos;
+
+	assert(STYPE_ARRAY == s->type);
+
+	print_func_db_search(s, arena, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s_array *q;\n"
+	       "\tstruct %s *pp;\n"
+	       "\tsize_t max = 0;\n"
+	       "%s"
+	       "\n"
+	       "\tq = %ssizeof(struct %s_array));\n"
+	       "\tif (NULL == q) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tq->count = 0;\n"
+	       "\tq->items = NULL;\n"
+	       "\n"
+	       "\tstmt = db_stmt_get(ctx, ",
+	       s->parent->name, s->parent->name, 
+	       '\0' != *fill_dedup(s, "&d, ") ?
+	       "\tstruct kwbp_dedup d;\n" : "",
+	       arena ? "db_arena_get(a, " : "malloc(",
+	       s->parent->name);
+	gen_search_stmtid(s, num);
+	puts(");\n"
+	     "\tdb_deadline_start(ctx);");
+	if ('\0' != *fill_dedup(s, "&d, "))
+		puts("\tmemset(&d, 0, sizeof(struct kwbp_dedup));");
+
+	gen_search_binds(s);
+
+	printf("\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tif (q->count == max) {\n"
+	       "\t\t\tmax = 0 == max ? 16 : max * 2;\n"
+	       "\t\t\tpp = realloc(q->items, "
+	       "max * sizeof(struct %s));\n"
+	       "\t\t\tif (NULL == pp) {\n"
+	       "\t\t\t\tperror(NULL);\n"
+	       "\t\t\t\texit(EXIT_FAILURE);\n"
+	       "\t\t\t}\n"
+	       "\t\t\tq->items = pp;\n"
+	       "\t\t}\n"
+	       "\t\tpp = &q->items[q->count];\n"
+	       "\t\tdb_%s_fill_%s(%s%spp, stmt, NULL);\n",
+	       s->parent->name, s->parent->name,
+	       fill_suffix(s, num), arena ? "a, " : "",
+	       fill_dedup(s, "&d, "));
+
+	/*
+	 * If we have any hashes, we're going to need to do the hash
+	 * check after the field has already been extracted from the
+	 * database.
+	 * If the hash doesn't match, don't keep the element.
+	 */
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		if (OPTYPE_ISUNARY(sent->op))
+			continue;
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD != sr->field->type) {
+			pos++;
+			continue;
+		}
+		printf("\t\tif (crypt_checkpass(v%zu, pp->%s) < 0) {\n"
+		       "%s"
+		       "\t\t\tdb_%s_unfill_r(pp);\n"
+		       "\t\t\tcontinue;\n"
+		       "\t\t}\n",
+		       pos, sref_member(&sent->srq, 0), 
+		       arena ? "\t\t\tif (NULL == a)\n\t" : "",
+		       s->parent->name);
+		pos++;
+	}
+
+	printf("\t\tq->count++;\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, ");
+	gen_search_stmtid(s, num);
+	puts(", stmt);\n"
+	     "\tdb_deadline_stop(ctx);");
+	gen_dedup_free(s, arena);
+
+	if (arena)
+		printf("\tif (ctx->expired) {\n"
+		       "\t\tif (NULL == a)\n"
+		       "\t\t\tdb_%s_freearray(q);\n"
+		       "\t\telse\n"
+		       "\t\t\tfree(q->items);\n"
+		       "\t\treturn(NULL);\n"
+		       "\t}\n", s->parent->name);
+	else
+		printf("\tif (ctx->expired) {\n"
+		       "\t\tdb_%s_freearray(q);\n"
+		       "\t\treturn(NULL);\n"
+		       "\t}\n", s->parent->name);
+
+	if (arena)
+		printf("\tif (NULL != a && q->count > 0) {\n"
+		       "\t\tpp = db_arena_get(a, "
+		       "q->count * sizeof(struct %s));\n"
+		       "\t\tif (NULL == pp) {\n"
+		       "\t\t\tperror(NULL);\n"
+		       "\t\t\texit(EXIT_FAILURE);\n"
+		       "\t\t}\n"
+		       "\t\tmemcpy(pp, q->items, "
+		       "q->count * sizeof(struct %s));\n"
+		       "\t\tfree(q->items);\n"
+		       "\t\tq->items = pp;\n"
+		       "\t} else if (NULL != a) {\n"
+		       "\t\tfree(q->items);\n"
+		       "\t\tq->items = NULL;\n"
+		       "\t}\n",
+		       s->parent->name, s->parent->name);
+
+	puts("\treturn(q);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the busy handler, which waits for locks held by other
+ * connections with randomised exponential backoff until the handle's
+ * timeout, counting the waits.
+ * The randomness is seeded for each handle by db_open(), so processes
+ * waiting for the same lock don't retry in step.
+ * Write and transaction functions bracket their statements with
+ * db_write_start() and db_write_stop(), within which the error handlers
+ * (see gen_func_deadline()) don't exit when the lock isn't acquired, but
+ * flag the write as having failed for db_busy_expired().
+ * It's installed on the connection opened by ksql(3) only if DB_SQLITE
+ * yields it: otherwise, SQLite's own busy timeout is set instead.
+ */
+static void
+gen_func_busy(void)
+{
+
+	puts("static int\n"
+	     "db_busy(void *arg, int count)\n"
+	     "{\n"
+	     "\tstruct kwbp *ctx = arg;\n"
+	     "\tstruct timespec now;\n"
+	     "\tint64_t waited, limit, us;\n"
+	     "\n"
+	     "\tclock_gettime(CLOCK_MONOTONIC, &now);\n"
+	     "\tif (0 == count) {\n"
+	     "\t\tctx->busy_start = now;\n"
+	     "\t\tctx->busystats.waits++;\n"
+	     "\t}\n"
+	     "\twaited = (now.tv_sec - ctx->busy_start.tv_sec) * 1000000 +\n"
+	     "\t\t(now.tv_nsec - ctx->busy_start.tv_nsec) / 1000;\n"
+	     "\tlimit = ctx->busy_timeout * 1000;\n"
+	     "\tif (waited >= limit) {\n"
+	     "\t\tctx->busystats.timeouts++;\n"
+	     "\t\treturn(0);\n"
+	     "\t}\n"
+	     "\tfor (us = BUSY_BACKOFF_MIN; "
+	     "count > 0 && us < BUSY_BACKOFF_MAX; count--)\n"
+	     "\t\tus *= 2;\n"
+	     "\tif (us > BUSY_BACKOFF_MAX)\n"
+	     "\t\tus = BUSY_BACKOFF_MAX;\n"
+	     "\tus = us / 2 + nrand48(ctx->busy_seed) % (us / 2 + 1);\n"
+	     "\tif (us > limit - waited)\n"
+	     "\t\tus = limit - waited;\n"
+	     "\tusleep(us);\n"
+	     "\tctx->busystats.retries++;\n"
+	     "\tctx->busystats.waited += us;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_busy_set(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\tchar\t buf[64];\n"
+	     "\n"
+	     "\tif (NULL != ctx->sqlite) {\n"
+	     "\t\tsqlite3_busy_handler(ctx->sqlite, db_busy, ctx);\n"
+	     "\t\treturn;\n"
+	     "\t}\n"
+	     "\tsnprintf(buf, sizeof(buf), "
+	     "\"PRAGMA busy_timeout = %lld\",\n"
+	     "\t\t(long long)ctx->busy_timeout);\n"
+	     "\tksql_exec(ctx->db, buf, STMT__MAX);\n"
+	     "}\n"
+	     "");
+
+	puts("static void\n"
+	     "db_write_start(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\n"
+	     "\tif (0 == ctx->write_depth++)\n"
+	     "\t\tctx->busy_expired = 0;\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_write_stop(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\n"
+	     "\tctx->write_depth--;\n"
+	     "}\n"
+	     "");
+
+	print_func_db_busy_expired(0);
+	puts("{\n"
+	     "\n"
+	     "\treturn(ctx->busy_expired);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_busy_stats(0);
+	puts("{\n"
+	     "\n"
+	     "\t*p = ctx->busystats;\n"
+	     "}\n"
+	     "");
+
+	print_func_db_busy_timeout(0);
+	puts("{\n"
+	     "\n"
+	     "\tctx->busy_timeout = ms < 0 ? 0 : ms;\n"
+	     "\tif (NULL == ctx->sqlite)\n"
+	     "\t\tdb_busy_set(ctx);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the deadline of searches, which is enforced by a progress
+ * handler interrupting statements once it passes.
+ * Searches bracket their statements with db_deadline_start() and
+ * db_deadline_stop(), so searches nested within others (e.g., from
+ * iterator callbacks) run under the outermost deadline.
+ * As statements don't exit on error (see gen_func_open()), the error
+ * handlers exit where KSQL_EXIT_ON_ERR would have: for all errors but
+ * these interruptions, writes giving up on a locked database (see
+ * gen_func_busy()), and those reported while closing the handle,
+ * either by db_close() or when exiting (KSQL_SAFE_EXIT), which ksql(3)
+ * never exits for.
+ * Cursors step outside of their search functions, so they keep the
+ * deadline in effect when opened (see gen_func_cursor()).
+ */
+static void
+gen_func_deadline(void)
+{
+
+	puts("static int\n"
+	     "db_progress(void *arg)\n"
+	     "{\n"
+	     "\tstruct kwbp *ctx = arg;\n"
+	     "\tstruct timespec now;\n"
+	     "\n"
+	     "\tif (0 == ctx->deadline_depth ||\n"
+	     "\t    (0 == ctx->deadline_at.tv_sec &&\n"
+	     "\t     0 == ctx->deadline_at.tv_nsec))\n"
+	     "\t\treturn(0);\n"
+	     "\tclock_gettime(CLOCK_MONOTONIC, &now);\n"
+	     "\tif (now.tv_sec < ctx->deadline_at.tv_sec ||\n"
+	     "\t    (now.tv_sec == ctx->deadline_at.tv_sec &&\n"
+	     "\t     now.tv_nsec < ctx->deadline_at.tv_nsec))\n"
+	     "\t\treturn(0);\n"
+	     "\tctx->expired = 1;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_deadline_start(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\n"
+	     "\tif (ctx->deadline_depth++ > 0)\n"
+	     "\t\treturn;\n"
+	     "\tctx->expired = 0;\n"
+	     "\tmemset(&ctx->deadline_at, 0, sizeof(struct timespec));\n"
+	     "\tif (0 == ctx->deadline)\n"
+	     "\t\treturn;\n"
+	     "\tclock_gettime(CLOCK_MONOTONIC, &ctx->deadline_at);\n"
+	     "\tctx->deadline_at.tv_sec += ctx->deadline / 1000;\n"
+	     "\tctx->deadline_at.tv_nsec += "
+	     "(ctx->deadline % 1000) * 1000000;\n"
+	     "\tif (ctx->deadline_at.tv_nsec >= 1000000000) {\n"
+	     "\t\tctx->deadline_at.tv_sec++;\n"
+	     "\t\tctx->deadline_at.tv_nsec -= 1000000000;\n"
+	     "\t}\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_deadline_stop(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\n"
+	     "\tctx->deadline_depth--;\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_err(void *arg, enum ksqlc code, "
+	     "const char *file, const char *msg)\n"
+	     "{\n"
+	     "\tstruct kwbp *ctx = arg;\n"
+	     "\n"
+	     "\tif (KSQL_EXIT == code)\n"
+	     "\t\tctx->closing = 1;\n"
+	     "\tif (KSQL_DB == code && "
+	     "ctx->expired && ctx->deadline_depth > 0)\n"
+	     "\t\treturn;\n"
+	     "\tif (KSQL_DB == code && "
+	     "ctx->busy_expired && ctx->write_depth > 0)\n"
+	     "\t\treturn;\n"
+	     "\tksqlitemsg(NULL, code, file, msg);\n"
+	     "\tif ( ! ctx->closing)\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_dberr(void *arg, int sqlerr, int sqlexterr, "
+	     "const char *file, const char *msg)\n"
+	     "{\n"
+	     "\tstruct kwbp *ctx = arg;\n"
+	     "\n"
+	     "\tif (SQLITE_INTERRUPT == sqlerr && "
+	     "ctx->expired && ctx->deadline_depth > 0)\n"
+	     "\t\treturn;\n"
+	     "\tif (SQLITE_BUSY == (sqlerr & 0xff) && "
+	     "ctx->write_depth > 0) {\n"
+	     "\t\tctx->busy_expired = 1;\n"
+	     "\t\treturn;\n"
+	     "\t}\n"
+	     "\tksqlitedbmsg(NULL, sqlerr, sqlexterr, file, msg);\n"
+	     "\tif ( ! ctx->closing)\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_deadline(0);
+	puts("{\n"
+	     "\n"
+	     "\tctx->deadline = ms < 0 ? 0 : ms;\n"
+	     "\tif (NULL != ctx->sqlite)\n"
+	     "\t\tsqlite3_progress_handler(ctx->sqlite,\n"
+	     "\t\t\tctx->deadline > 0 ? DEADLINE_STEPS : 0,\n"
+	     "\t\t\tctx->deadline > 0 ? db_progress : NULL, ctx);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_deadline_expired(0);
+	puts("{\n"
+	     "\n"
+	     "\treturn(ctx->expired);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the function opening the database, which then applies the
+ * database settings of "cfg" (if any).
+ * Errors exit from the handle's error handlers (see gen_func_deadline())
+ * rather than from ksql(3) itself.
+ */
+static void
+gen_func_open(const struct config *cfg)
+{
+	const struct strct *p;
+	size_t	 i;
+
+	print_func_db_open(0);
+	puts("{\n"
+	     "\tstruct ksqlcfg cfg;\n"
+	     "\tstruct ksql *sql;\n"
+	     "\tstruct kwbp *ctx;\n"
+	     "\tstruct timespec ts;\n"
+	     "\tuint64_t seed;\n"
+	     "\n"
+	     "\tif (NULL == (ctx = calloc(1, sizeof(struct kwbp))))\n"
+	     "\t\treturn(NULL);\n"
+	     "\n"
+	     "\tmemset(&cfg, 0, sizeof(struct ksqlcfg));\n"
+	     "\tcfg.flags = KSQL_FOREIGN_KEYS | KSQL_SAFE_EXIT;\n"
+	     "\tcfg.err = db_err;\n"
+	     "\tcfg.dberr = db_dberr;\n"
+	     "\tcfg.arg = ctx;\n"
+	     "\n"
+	     "\tif (NULL == (sql = ksql_alloc(&cfg))) {\n"
+	     "\t\tfree(ctx);\n"
+	     "\t\treturn(NULL);\n"
+	     "\t}\n"
+	     "\tctx->db = sql;");
+	TAILQ_FOREACH(p, &cfg->sq, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			printf("\tTAILQ_INIT(&ctx->lru_%s);\n"
+			       "\tctx->lru_%s_version = -1;\n",
+			       p->name, p->name);
+	if (NULL != cfg->pragmas[PRAGMA_BUSYTIMEOUT])
+		printf("\tctx->busy_timeout = %s;\n",
+			cfg->pragmas[PRAGMA_BUSYTIMEOUT]);
+	else
+		puts("\tctx->busy_timeout = BUSY_TIMEOUT;");
+	puts("\tclock_gettime(CLOCK_REALTIME, &ts);\n"
+	     "\tseed = (uint64_t)getpid() << 32 ^ (uint64_t)ts.tv_sec ^\n"
+	     "\t\t(uint64_t)ts.tv_nsec << 16 ^ (uintptr_t)ctx;\n"
+	     "\tctx->busy_seed[0] = seed;\n"
+	     "\tctx->busy_seed[1] = seed >> 16;\n"
+	     "\tctx->busy_seed[2] = seed >> 32 ^ seed >> 48;\n"
+	     "\tksql_open(sql, file);\n"
+	     "\tctx->sqlite = DB_SQLITE(sql);\n"
+	     "\tdb_busy_set(ctx);");
+	for (i = 0; i < PRAGMA__MAX; i++)
+		if (NULL != cfg->pragmas[i] && PRAGMA_BUSYTIMEOUT != i)
+			printf("\tksql_exec(sql, \"PRAGMA %s = %s\", "
+				"STMT__MAX);\n", 
+				pragmas[i], cfg->pragmas[i]);
+	puts("\treturn(ctx);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the function returning the database's data version, which
+ * changes when another connection commits a write.
+ * Row caches are flushed when this doesn't match their own.
+ */
+static void
+gen_func_data_version(void)
+{
+
+	puts("static int64_t\n"
+	     "db_data_version(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;\n"
+	     "\tint64_t v = -1;\n"
+	     "\n"
+	     "\tstmt = db_stmt_get(ctx, STMT_DATA_VERSION);\n"
+	     "\tif (KSQL_ROW == ksql_stmt_step(stmt))\n"
+	     "\t\tv = ksql_stmt_int(stmt, 0);\n"
+	     "\tdb_stmt_put(ctx, STMT_DATA_VERSION, stmt);\n"
+	     "\treturn(v);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the function returning the number of rows modified by the
+ * last statement, which is read from the connection if DB_SQLITE
+ * exposes it and otherwise queried.
+ */
+static void
+gen_func_changes(void)
+{
+
+	puts("static int64_t\n"
+	     "db_changes(struct kwbp *ctx)\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;\n"
+	     "\tint64_t n = 0;\n"
+	     "\n"
+	     "\tif (NULL != ctx->sqlite)\n"
+	     "\t\treturn(sqlite3_changes(ctx->sqlite));\n"
+	     "\tstmt = db_stmt_get(ctx, STMT_CHANGES);\n"
+	     "\tif (KSQL_ROW == ksql_stmt_step(stmt))\n"
+	     "\t\tn = ksql_stmt_int(stmt, 0);\n"
+	     "\tdb_stmt_put(ctx, STMT_CHANGES, stmt);\n"
+	     "\treturn(n);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the function ending the savepoint "ret" around a write
+ * that fills in the written row of a structure with nested structures
+ * (see gen_func_fill_rowid()).
+ * It's rolled back to unless "ok", and if it can't be released, the
+ * transaction is rolled back.
+ * Returns whether the write took.
+ */
+static void
+gen_func_ret_release(void)
+{
+
+	puts("static int\n"
+	     "db_ret_release(struct kwbp *ctx, int ok)\n"
+	     "{\n"
+	     "\n"
+	     "\tif ( ! ok)\n"
+	     "\t\tksql_exec(ctx->db, \"ROLLBACK TO ret\", STMT__MAX);\n"
+	     "\tif (KSQL_OK == ksql_exec(ctx->db, "
+	     "\"RELEASE ret\", STMT__MAX))\n"
+	     "\t\treturn(ok);\n"
+	     "\tksql_exec(ctx->db, \"ROLLBACK\", STMT__MAX);\n"
+	     "\treturn(0);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Hash (FNV-1a) the string "v", with its terminator, into "h".
+ */
+static uint64_t
+hash_str(uint64_t h, const char *v)
+{
+
+	do {
+		h ^= (unsigned char)*v;
+		h *= 1099511628211ULL;
+	} while ('\0' != *v++);
+	return(h);
+}
+
+/*
+ * Hash the layout packed by db_xxx_pack_r() for "p" into "h": the
+ * names, types, and nullity of its fields, recursing into those of
+ * nested structures.
+ */
+static uint64_t
+shm_layout_r(uint64_t h, const struct strct *p)
+{
+	const struct field *f;
+	char	 buf[32];
+
+	h = hash_str(h, p->name);
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT == f->type && FIELD_LAZY & f->flags)
+			continue;
+		snprintf(buf, sizeof(buf), "%d:%d:%d", f->type,
+			0 != (FIELD_NULL & f->flags),
+			0 != (FIELD_SHARED & f->flags));
+		h = hash_str(hash_str(h, f->name), buf);
+		if (FTYPE_STRUCT == f->type)
+			h = shm_layout_r(h, f->ref->target->parent);
+	}
+	return(h);
+}
+
+/*
+ * Hash the layout of the shared-memory row caches of "q", which is that
+ * of each structure with cached searches, in order.
+ * This includes our version, as the packing itself may change.
+ */
+static uint64_t
+shm_layout(const struct strctq *q)
+{
+	const struct strct *p;
+	uint64_t h;
+
+	h = hash_str(14695981039346656037ULL, VERSION);
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			h = shm_layout_r(h, p);
+	return(h);
+}
+
+/*
+ * Generate the functions managing shared-memory row caches: one region
+ * per structure of "q" with cached searches, each a hashtable of slots
+ * keyed by the packed search number and values.
+ * Slots are guarded by a sequence lock, odd while being written:
+ * readers miss if it's odd or changes while copying out, and writers
+ * skip the slot if they can't take it, unless the process writing it
+ * has died without releasing it.
+ * Rows are valid only if stamped with the region's current generation,
+ * and are unpacked within the bounds of their slot.
+ * The file starts with a header identifying the packed layout, so that
+ * processes built from other configurations can't attach it.
+ */
+static void
+gen_func_shm(const struct strctq *q)
+{
+	const struct strct *p;
+	size_t	 i;
+
+	puts("static uint64_t\n"
+	     "db_shm_hash(const char *buf, size_t sz)\n"
+	     "{\n"
+	     "\tuint64_t h = 14695981039346656037ULL;\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\tfor (i = 0; i < sz; i++) {\n"
+	     "\t\th ^= (unsigned char)buf[i];\n"
+	     "\t\th *= 1099511628211ULL;\n"
+	     "\t}\n"
+	     "\treturn(h);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_shm_get(struct kwbp_shm_region *r, int64_t gen,\n"
+	     "\tchar *buf, size_t ksz, size_t *sz)\n"
+	     "{\n"
+	     "\tstruct kwbp_shm_slot *s;\n"
+	     "\tuint64_t seq;\n"
+	     "\n"
+	     "\ts = &r->slots[db_shm_hash(buf, ksz) % SHM_SLOTS];\n"
+	     "\tseq = s->seq;\n"
+	     "\t__sync_synchronize();\n"
+	     "\t*sz = s->sz;\n"
+	     "\tif ((seq & 1) || s->gen != (uint64_t)gen ||\n"
+	     "\t    s->ksz != ksz || *sz > SHM_SLOT_SIZE || *sz < ksz ||\n"
+	     "\t    0 != memcmp(s->data, buf, ksz))\n"
+	     "\t\treturn(0);\n"
+	     "\tmemcpy(buf + ksz, s->data + ksz, *sz - ksz);\n"
+	     "\t__sync_synchronize();\n"
+	     "\treturn(seq == s->seq);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_shm_put(struct kwbp_shm_region *r, int64_t gen,\n"
+	     "\tconst char *buf, size_t ksz, size_t sz)\n"
+	     "{\n"
+	     "\tstruct kwbp_shm_slot *s;\n"
+	     "\tuint64_t seq;\n"
+	     "\n"
+	     "\ts = &r->slots[db_shm_hash(buf, ksz) % SHM_SLOTS];\n"
+	     "\tseq = s->seq;\n"
+	     "\tif (seq & 1) {\n"
+	     "\t\tif (0 == s->pid || 0 == kill(s->pid, 0) || "
+	     "ESRCH != errno)\n"
+	     "\t\t\treturn;\n"
+	     "\t\tif ( ! __sync_bool_compare_and_swap"
+	     "(&s->seq, seq, seq + 2))\n"
+	     "\t\t\treturn;\n"
+	     "\t\tseq++;\n"
+	     "\t} else if ( ! __sync_bool_compare_and_swap"
+	     "(&s->seq, seq, seq + 1))\n"
+	     "\t\treturn;\n"
+	     "\ts->pid = getpid();\n"
+	     "\ts->gen = (uint64_t)gen;\n"
+	     "\ts->ksz = ksz;\n"
+	     "\ts->sz = sz;\n"
+	     "\tmemcpy(s->data, buf, sz);\n"
+	     "\t__sync_synchronize();\n"
+	     "\t__sync_bool_compare_and_swap"
+	     "(&s->seq, seq + 1, seq + 2);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_pack(char *buf, size_t *pos, size_t max, "
+	     "const void *v, size_t sz)\n"
+	     "{\n"
+	     "\n"
+	     "\tif (sz > max - *pos)\n"
+	     "\t\treturn(0);\n"
+	     "\tmemcpy(buf + *pos, v, sz);\n"
+	     "\t*pos += sz;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_pack_str(char *buf, size_t *pos, size_t max, "
+	     "const char *v)\n"
+	     "{\n"
+	     "\tsize_t sz = strlen(v);\n"
+	     "\n"
+	     "\treturn(db_pack(buf, pos, max, &sz, sizeof(size_t)) &&\n"
+	     "\t    db_pack(buf, pos, max, v, sz));\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_unpack(const char *buf, size_t *pos, size_t max, "
+	     "void *v, size_t sz)\n"
+	     "{\n"
+	     "\n"
+	     "\tif (sz > max - *pos)\n"
+	     "\t\treturn(0);\n"
+	     "\tmemcpy(v, buf + *pos, sz);\n"
+	     "\t*pos += sz;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_unpack_blob(const char *buf, size_t *pos, size_t max, "
+	     "void **v, size_t *sz)\n"
+	     "{\n"
+	     "\n"
+	     "\tif ( ! db_unpack(buf, pos, max, sz, sizeof(size_t)) ||\n"
+	     "\t    *sz > max - *pos)\n"
+	     "\t\treturn(0);\n"
+	     "\tif (NULL == (*v = malloc(*sz + 1))) {\n"
+	     "\t\tperror(NULL);\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "\t}\n"
+	     "\tmemcpy(*v, buf + *pos, *sz);\n"
+	     "\t*pos += *sz;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_unpack_str(const char *buf, size_t *pos, size_t max, "
+	     "char **v)\n"
+	     "{\n"
+	     "\tsize_t sz;\n"
+	     "\n"
+	     "\tif ( ! db_unpack_blob(buf, pos, max, (void **)v, &sz))\n"
+	     "\t\treturn(0);\n"
+	     "\t(*v)[sz] = '\\0';\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "");
+
+	i = 0;
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			i++;
+
+	print_func_db_shm_attach(0);
+	printf("{\n"
+	       "\tstruct kwbp_shm_header *h;\n"
+	       "\tstruct stat st;\n"
+	       "\tsize_t sz;\n"
+	       "\tvoid *p;\n"
+	       "\tint fd;\n"
+	       "\n"
+	       "\tsz = sizeof(struct kwbp_shm_header) +\n"
+	       "\t\t%zu * sizeof(struct kwbp_shm_region);\n"
+	       "\tif (-1 == (fd = open(file, O_RDWR | O_CREAT, 0600)))\n"
+	       "\t\treturn(0);\n"
+	       "\tif (-1 == fstat(fd, &st) ||\n"
+	       "\t    (0 == st.st_size && -1 == ftruncate(fd, sz)) ||\n"
+	       "\t    (0 != st.st_size && (size_t)st.st_size != sz)) {\n"
+	       "\t\tclose(fd);\n"
+	       "\t\treturn(0);\n"
+	       "\t}\n"
+	       "\tp = mmap(NULL, sz, PROT_READ | PROT_WRITE, "
+	       "MAP_SHARED, fd, 0);\n"
+	       "\tclose(fd);\n"
+	       "\tif (MAP_FAILED == p)\n"
+	       "\t\treturn(0);\n"
+	       "\th = p;\n"
+	       "\t__sync_bool_compare_and_swap(&h->magic, 0, SHM_MAGIC);\n"
+	       "\t__sync_bool_compare_and_swap(&h->layout, 0, SHM_LAYOUT);\n"
+	       "\tif (SHM_MAGIC != h->magic || SHM_LAYOUT != h->layout) {\n"
+	       "\t\tmunmap(p, sz);\n"
+	       "\t\treturn(0);\n"
+	       "\t}\n"
+	       "\tif (NULL != ctx->shm)\n"
+	       "\t\tmunmap(ctx->shm, ctx->shm_sz);\n"
+	       "\tctx->shm = p;\n"
+	       "\tctx->shm_sz = sz;\n", i);
+	i = 0;
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			printf("\tctx->shm_%s = "
+			       "(struct kwbp_shm_region *)(h + 1) + %zu;\n"
+			       "\tctx->lru_%s_version = -1;\n",
+			       p->name, i++, p->name);
+	puts("\treturn(1);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the arena functions.
+ * Arenas are a list of chunks from which we carve out allocations,
+ * moving to the next (or a new) chunk when the current one is full.
+ * Resetting simply rewinds to the first chunk.
+ * The internal allocators fall back to the heap when the arena is NULL.
+ */
+static void
+gen_func_arena(void)
+{
+
+	puts("static void *\n"
+	     "db_arena_get(struct kwbp_arena *a, size_t sz)\n"
+	     "{\n"
+	     "\tstruct kwbp_arena_chunk *c;\n"
+	     "\tchar *v;\n"
+	     "\n"
+	     "\tif (NULL == a)\n"
+	     "\t\treturn(malloc(sz));\n"
+	     "\tsz = ARENA_ALIGN(sz);\n"
+	     "\twhile (NULL != a->cur && "
+	     "a->cur->sz - a->cur->used < sz)\n"
+	     "\t\ta->cur = a->cur->next;\n"
+	     "\tif (NULL == a->cur) {\n"
+	     "\t\tc = malloc(ARENA_ALIGN(sizeof("
+	     "struct kwbp_arena_chunk)) +\n"
+	     "\t\t\t(sz > ARENA_CHUNK ? sz : ARENA_CHUNK));\n"
+	     "\t\tif (NULL == c)\n"
+	     "\t\t\treturn(NULL);\n"
+	     "\t\tc->next = NULL;\n"
+	     "\t\tc->sz = sz > ARENA_CHUNK ? sz : ARENA_CHUNK;\n"
+	     "\t\tc->used = 0;\n"
+	     "\t\tif (NULL == a->last)\n"
+	     "\t\t\ta->first = c;\n"
+	     "\t\telse\n"
+	     "\t\t\ta->last->next = c;\n"
+	     "\t\ta->last = a->cur = c;\n"
+	     "\t}\n"
+	     "\tv = (char *)a->cur + ARENA_ALIGN(sizeof("
+	     "struct kwbp_arena_chunk)) +\n"
+	     "\t\ta->cur->used;\n"
+	     "\ta->cur->used += sz;\n"
+	     "\treturn(v);\n"
+	     "}\n"
+	     "\n"
+	     "static char *\n"
+	     "db_arena_strdup(struct kwbp_arena *a, const char *s)\n"
+	     "{\n"
+	     "\tchar *cp;\n"
+	     "\tsize_t sz;\n"
+	     "\n"
+	     "\tif (NULL == a)\n"
+	     "\t\treturn(strdup(s));\n"
+	     "\tsz = strlen(s) + 1;\n"
+	     "\tif (NULL != (cp = db_arena_get(a, sz)))\n"
+	     "\t\tmemcpy(cp, s, sz);\n"
+	     "\treturn(cp);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_arena_alloc(0);
+	puts("{\n"
+	     "\n"
+	     "\treturn(calloc(1, sizeof(struct kwbp_arena)));\n"
+	     "}\n"
+	     "");
+
+	print_func_db_arena_reset(0);
+	puts("{\n"
+	     "\tstruct kwbp_arena_chunk *c;\n"
+	     "\n"
+	     "\tfor (c = a->first; NULL != c; c = c->next)\n"
+	     "\t\tc->used = 0;\n"
+	     "\ta->cur = a->first;\n"
+	     "}\n"
+	     "");
+
+	print_func_db_arena_free(0);
+	puts("{\n"
+	     "\tstruct kwbp_arena_chunk *c;\n"
+	     "\n"
+	     "\tif (NULL == a)\n"
+	     "\t\treturn;\n"
+	     "\twhile (NULL != (c = a->first)) {\n"
+	     "\t\ta->first = c->next;\n"
+	     "\t\tfree(c);\n"
+	     "\t}\n"
+	     "\tfree(a);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the functions managing our per-handle statement cache.
+ * Statements are prepared on first use and reset when released.
+ * A statement already in use (e.g., a search invoked from within an
+ * iterator's callback on the same query) is instead prepared and
+ * freed as a one-off.
+ * If "metrics" is non-zero, each use is measured from the one to the
+ * other (see gen_func_metrics()).
+ */
+static void
+gen_func_stmt_cache(int metrics)
+{
+
+	puts("static struct ksqlstmt *\n"
+	     "db_stmt_get(struct kwbp *ctx, enum stmt id)\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;\n"
+	     "\n"
+	     "\tif (ctx->busy[id]) {\n"
+	     "\t\tksql_stmt_alloc(ctx->db, &stmt, stmts[id], id);");
+	if (metrics)
+		puts("\t\tdb_metrics_start(ctx, id, "
+		     "DB_SQLITE_STMT(stmt));");
+	puts("\t\treturn(stmt);\n"
+	     "\t}");
+	if (metrics)
+		puts("\tif (NULL == ctx->cache[id]) {\n"
+		     "\t\tksql_stmt_alloc(ctx->db, "
+		     "&ctx->cache[id], stmts[id], id);\n"
+		     "\t\tctx->sqlstmt[id] = "
+		     "DB_SQLITE_STMT(ctx->cache[id]);\n"
+		     "\t}\n"
+		     "\tdb_metrics_start(ctx, id, ctx->sqlstmt[id]);");
+	else
+		puts("\tif (NULL == ctx->cache[id])\n"
+		     "\t\tksql_stmt_alloc(ctx->db, "
+		     "&ctx->cache[id], stmts[id], id);");
+	puts("\tctx->busy[id] = 1;\n"
+	     "\treturn(ctx->cache[id]);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_stmt_put(struct kwbp *ctx, "
+	     "enum stmt id, struct ksqlstmt *stmt)\n"
+	     "{");
+	if (metrics)
+		puts("\n"
+		     "\tdb_metrics_stop(ctx, id);");
+	puts("\tif (stmt != ctx->cache[id]) {\n"
+	     "\t\tksql_stmt_free(stmt);\n"
+	     "\t\treturn;\n"
+	     "\t}\n"
+	     "\tksql_stmt_reset(stmt);\n"
+	     "\tctx->busy[id] = 0;\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the per-statement metrics, which are written to the file
+ * mapped by db_metrics_attach().
+ * Each statement is timed from db_stmt_get() to db_stmt_put(), and its
+ * rows and their bytes are counted by a trace callback on the
+ * connection as they're stepped.
+ * The connection's statements are those of ours, taken when they're
+ * prepared (see DB_SQLITE_STMT), and rows are matched to runs by them.
+ * The file is refused if it was created for other statements, as told
+ * by a hash of their names.
+ * Counters are shared between processes by atomic addition, and the
+ * slowest runs are guarded by sequence numbers as with the row cache's
+ * slots (see gen_func_shm()).
+ */
+static void
+gen_func_metrics(void)
+{
+
+	puts("static uint64_t\n"
+	     "db_metrics_layout(void)\n"
+	     "{\n"
+	     "\tuint64_t h = 14695981039346656037ULL;\n"
+	     "\tconst char *cp;\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\tfor (i = 0; i < STMT__MAX; i++) {\n"
+	     "\t\tcp = stmtnames[i];\n"
+	     "\t\tdo {\n"
+	     "\t\t\th ^= (unsigned char)*cp;\n"
+	     "\t\t\th *= 1099511628211ULL;\n"
+	     "\t\t} while ('\\0' != *cp++);\n"
+	     "\t}\n"
+	     "\treturn(h);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_metrics_start(struct kwbp *ctx, "
+	     "enum stmt id, sqlite3_stmt *stmt)\n"
+	     "{\n"
+	     "\tstruct kwbp_metrics_run *r;\n"
+	     "\n"
+	     "\tif (NULL == ctx->metrics)\n"
+	     "\t\treturn;\n"
+	     "\tif (ctx->runsz == ctx->runmax) {\n"
+	     "\t\tr = realloc(ctx->runs, (ctx->runmax + 8) *\n"
+	     "\t\t\tsizeof(struct kwbp_metrics_run));\n"
+	     "\t\tif (NULL == r) {\n"
+	     "\t\t\tperror(NULL);\n"
+	     "\t\t\texit(EXIT_FAILURE);\n"
+	     "\t\t}\n"
+	     "\t\tctx->runs = r;\n"
+	     "\t\tctx->runmax += 8;\n"
+	     "\t}\n"
+	     "\tr = &ctx->runs[ctx->runsz++];\n"
+	     "\tr->stmt = stmt;\n"
+	     "\tr->id = id;\n"
+	     "\tr->rows = r->bytes = 0;\n"
+	     "\tclock_gettime(CLOCK_MONOTONIC, &r->start);\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_metrics_slow(struct kwbp_metrics_stmt *m, "
+	     "uint64_t ns, sqlite3_stmt *stmt)\n"
+	     "{\n"
+	     "\tstruct kwbp_metrics_slow *s, *min;\n"
+	     "\tuint64_t seq;\n"
+	     "\tchar *sql;\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\tfor (min = &m->slow[0], i = 1; i < METRICS_SLOW; i++)\n"
+	     "\t\tif ((s = &m->slow[i])->ns < min->ns)\n"
+	     "\t\t\tmin = s;\n"
+	     "\tseq = min->seq;\n"
+	     "\tif (ns <= min->ns || (seq & 1) ||\n"
+	     "\t    ! __sync_bool_compare_and_swap"
+	     "(&min->seq, seq, seq + 1))\n"
+	     "\t\treturn;\n"
+	     "\tmin->ns = ns;\n"
+	     "\tsql = sqlite3_expanded_sql(stmt);\n"
+	     "\tsnprintf(min->sql, sizeof(min->sql), "
+	     "\"%s\", NULL == sql ? \"\" : sql);\n"
+	     "\tsqlite3_free(sql);\n"
+	     "\t__sync_synchronize();\n"
+	     "\tmin->seq = seq + 2;\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_metrics_stop(struct kwbp *ctx, enum stmt id)\n"
+	     "{\n"
+	     "\tstruct kwbp_metrics_stmt *m;\n"
+	     "\tstruct kwbp_metrics_run *r;\n"
+	     "\tstruct timespec now;\n"
+	     "\tuint64_t ns;\n"
+	     "\tsize_t i, b;\n"
+	     "\n"
+	     "\tif (NULL == ctx->metrics)\n"
+	     "\t\treturn;\n"
+	     "\tfor (i = ctx->runsz; i > 0; i--)\n"
+	     "\t\tif (id == ctx->runs[i - 1].id)\n"
+	     "\t\t\tbreak;\n"
+	     "\tif (0 == i)\n"
+	     "\t\treturn;\n"
+	     "\tr = &ctx->runs[i - 1];\n"
+	     "\tclock_gettime(CLOCK_MONOTONIC, &now);\n"
+	     "\tns = (now.tv_sec - r->start.tv_sec) * 1000000000LL +\n"
+	     "\t\t(now.tv_nsec - r->start.tv_nsec);\n"
+	     "\tfor (b = 0; b < METRICS_BUCKETS - 1; b++)\n"
+	     "\t\tif (ns < 1000ULL << b)\n"
+	     "\t\t\tbreak;\n"
+	     "\tm = &ctx->metrics->stmts[id];\n"
+	     "\t__sync_fetch_and_add(&m->calls, 1);\n"
+	     "\t__sync_fetch_and_add(&m->ns, ns);\n"
+	     "\t__sync_fetch_and_add(&m->rows, r->rows);\n"
+	     "\t__sync_fetch_and_add(&m->bytes, r->bytes);\n"
+	     "\t__sync_fetch_and_add(&m->hist[b], 1);\n"
+	     "\tif (NULL != r->stmt) {\n"
+	     "\t\t__sync_fetch_and_add(&m->fullscans, "
+	     "sqlite3_stmt_status(r->stmt,\n"
+	     "\t\t\tSQLITE_STMTSTATUS_FULLSCAN_STEP, 1));\n"
+	     "\t\t__sync_fetch_and_add(&m->sorts, "
+	     "sqlite3_stmt_status(r->stmt,\n"
+	     "\t\t\tSQLITE_STMTSTATUS_SORT, 1));\n"
+	     "\t\t__sync_fetch_and_add(&m->autoindexes, "
+	     "sqlite3_stmt_status(r->stmt,\n"
+	     "\t\t\tSQLITE_STMTSTATUS_AUTOINDEX, 1));\n"
+	     "\t\tdb_metrics_slow(m, ns, r->stmt);\n"
+	     "\t}\n"
+	     "\tmemmove(r, r + 1, (ctx->runsz - i) * "
+	     "sizeof(struct kwbp_metrics_run));\n"
+	     "\tctx->runsz--;\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_metrics_row(unsigned int type, void *arg, "
+	     "void *p, void *x)\n"
+	     "{\n"
+	     "\tstruct kwbp *ctx = arg;\n"
+	     "\tstruct kwbp_metrics_run *r;\n"
+	     "\tsqlite3_stmt *stmt = p;\n"
+	     "\tsize_t i;\n"
+	     "\tint col;\n"
+	     "\n"
+	     "\tfor (i = ctx->runsz; i > 0; i--)\n"
+	     "\t\tif (stmt == ctx->runs[i - 1].stmt)\n"
+	     "\t\t\tbreak;\n"
+	     "\tif (0 == i)\n"
+	     "\t\treturn(0);\n"
+	     "\tr = &ctx->runs[i - 1];\n"
+	     "\tr->rows++;\n"
+	     "\tfor (col = 0; col < sqlite3_column_count(stmt); col++)\n"
+	     "\t\tswitch (sqlite3_column_type(stmt, col)) {\n"
+	     "\t\tcase (SQLITE_NULL):\n"
+	     "\t\t\tbreak;\n"
+	     "\t\tcase (SQLITE_TEXT):\n"
+	     "\t\tcase (SQLITE_BLOB):\n"
+	     "\t\t\tr->bytes += sqlite3_column_bytes(stmt, col);\n"
+	     "\t\t\tbreak;\n"
+	     "\t\tdefault:\n"
+	     "\t\t\tr->bytes += sizeof(int64_t);\n"
+	     "\t\t\tbreak;\n"
+	     "\t\t}\n"
+	     "\treturn(0);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_metrics_attach(0);
+	puts("{\n"
+	     "\tstruct kwbp_metrics *m;\n"
+	     "\tstruct stat st;\n"
+	     "\tuint64_t layout;\n"
+	     "\tsize_t i, sz;\n"
+	     "\tvoid *p;\n"
+	     "\tint fd;\n"
+	     "\n"
+	     "\tsz = sizeof(struct kwbp_metrics) +\n"
+	     "\t\tSTMT__MAX * sizeof(struct kwbp_metrics_stmt);\n"
+	     "\tif (-1 == (fd = open(file, O_RDWR | O_CREAT, 0600)))\n"
+	     "\t\treturn(0);\n"
+	     "\tif (-1 == fstat(fd, &st) ||\n"
+	     "\t    (0 == st.st_size && -1 == ftruncate(fd, sz)) ||\n"
+	     "\t    (0 != st.st_size && (size_t)st.st_size != sz)) {\n"
+	     "\t\tclose(fd);\n"
+	     "\t\treturn(0);\n"
+	     "\t}\n"
+	     "\tp = mmap(NULL, sz, PROT_READ | PROT_WRITE, "
+	     "MAP_SHARED, fd, 0);\n"
+	     "\tclose(fd);\n"
+	     "\tif (MAP_FAILED == p)\n"
+	     "\t\treturn(0);\n"
+	     "\tm = p;\n"
+	     "\tlayout = db_metrics_layout();\n"
+	     "\tif (__sync_bool_compare_and_swap(&m->layout, 0, layout)) {\n"
+	     "\t\tfor (i = 0; i < STMT__MAX; i++)\n"
+	     "\t\t\tsnprintf(m->stmts[i].name, METRICS_NAME_SIZE,\n"
+	     "\t\t\t\t\"%s\", stmtnames[i]);\n"
+	     "\t\tm->nstmts = STMT__MAX;\n"
+	     "\t\t__sync_synchronize();\n"
+	     "\t\tm->magic = METRICS_MAGIC;\n"
+	     "\t}\n"
+	     "\tif (layout != m->layout) {\n"
+	     "\t\tmunmap(p, sz);\n"
+	     "\t\treturn(0);\n"
+	     "\t}\n"
+	     "\tif (NULL != ctx->metrics)\n"
+	     "\t\tmunmap(ctx->metrics, ctx->metrics_sz);\n"
+	     "\tctx->metrics = m;\n"
+	     "\tctx->metrics_sz = sz;\n"
+	     "\tctx->runsz = 0;\n"
+	     "\tif (NULL != ctx->sqlite)\n"
+	     "\t\tsqlite3_trace_v2(ctx->sqlite, SQLITE_TRACE_ROW, "
+	     "db_metrics_row, ctx);\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate db_close().
+ * This also frees all lazily-loaded structures and row caches, and
+ * detaches from shared memory and (if "metrics" is non-zero) the
+ * per-statement metrics.
+ */
+static void
+gen_func_close(const struct strctq *q, int metrics)
+{
+	const struct strct *p;
+
+	print_func_db_close(0);
+	puts("{\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\tif (NULL == p)\n"
+	     "\t\treturn;");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			break;
+	if (NULL != p)
+		puts("\tdb_unload(p);");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			break;
+	if (NULL != p) 
+		puts("\tif (NULL != p->shm)\n"
+		     "\t\tmunmap(p->shm, p->shm_sz);");
+	if (metrics)
+		puts("\tif (NULL != p->metrics)\n"
+		     "\t\tmunmap(p->metrics, p->metrics_sz);\n"
+		     "\tfree(p->runs);");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			printf("\tdb_%s_lru_flush(p);\n", p->name);
+	puts("\tp->closing = 1;\n"
+	     "\tfor (i = 0; i < STMT__MAX; i++)\n"
+	     "\t\tif (NULL != p->cache[i])\n"
+	     "\t\t\tksql_stmt_free(p->cache[i]);\n"
+	     "\tksql_free(p->db);\n"
+	     "\tfree(p);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Return the number of columns filled by db_xxx_fill_r() for "p".
+ * If "rowid" is non-zero, instead return the position of the rowid.
+ */
+static size_t
+fill_cols(const struct strct *p, int rowid)
+{
+	const struct field *f;
+	size_t	 cols = 0;
+
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (rowid && FIELD_ROWID & f->flags)
+			return(cols);
+		else if (FTYPE_STRUCT != f->type)
+			cols++;
+
+	assert(0 == rowid);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags))
+			cols += fill_cols(f->ref->target->parent, 0);
+	return(cols);
+}
+
+/*
+ * Generate the function deep-copying a structure (and its nested
+ * structures) out of the row cache.
+ * Shared structures gain a reference unless copied into an arena.
+ * Lazy fields and children are never loaded in cached rows, so they
+ * remain NULL.
+ * This must have STRCT_HAS_COPY (or, with arenas, STRCT_HAS_ACOPY)
+ * defined in its flags, otherwise the function does nothing.
+ */
+static void
+gen_func_copy_r(const struct strct *p, int arena)
+{
+	const struct field *f;
+	const char	*ap = arena ? "a, " : "";
+
+	if ( ! (STRCT_HAS_COPY & p->flags) &&
+	    ! (arena && STRCT_HAS_ACOPY & p->flags))
+		return;
+
+	printf("static void\n"
+	       "db_%s_copy_r(%sstruct %s *p, const struct %s *o)\n"
+	       "{\n"
+	       "\n"
+	       "\t*p = *o;\n",
+	       p->name, arena ? "struct kwbp_arena *a, " : "", 
+	       p->name, p->name);
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		switch (f->type) {
+		case (FTYPE_STRUCT):
+			if (FIELD_LAZY & f->flags)
+				break;
+			if ( ! (FIELD_SHARED & f->flags)) {
+				printf("\tdb_%s_copy_r(%s&p->%s, "
+					"&o->%s);\n", f->ref->tstrct, 
+					ap, f->name, f->name);
+				break;
+			}
+			if ( ! arena) {
+				printf("\t((struct %s_shared *)"
+					"p->%s)->refs++;\n",
+					f->ref->tstrct, f->name);
+				break;
+			}
+			printf("\tif (NULL == a)\n"
+			       "\t\t((struct %s_shared *)"
+				"p->%s)->refs++;\n"
+			       "\telse {\n"
+			       "\t\tp->%s = db_arena_get"
+				"(a, sizeof(struct %s));\n"
+			       "\t\tif (NULL == p->%s) {\n"
+			       "\t\t\tperror(NULL);\n"
+			       "\t\t\texit(EXIT_FAILURE);\n"
+			       "\t\t}\n"
+			       "\t\tdb_%s_copy_r(a, p->%s, o->%s);\n"
+			       "\t}\n",
+			       f->ref->tstrct, f->name, f->name, 
+			       f->ref->tstrct, f->name, 
+			       f->ref->tstrct, f->name, f->name);
+			break;
+		case (FTYPE_BLOB):
+			if (FIELD_NULL & f->flags)
+				printf("\tif (p->has_%s) {\n", f->name);
+			print_src(FIELD_NULL & f->flags ? 2 : 1,
+				"p->%s = %so->%s_sz);\n"
+				"if (NULL == p->%s) {\n"
+				"perror(NULL);\n"
+				"exit(EXIT_FAILURE);\n"
+				"}\n"
+				"memcpy(p->%s, o->%s, o->%s_sz);",
+				f->name, arena ? 
+				"db_arena_get(a, " : "malloc(", 
+				f->name, f->name, f->name, 
+				f->name, f->name);
+			if (FIELD_NULL & f->flags)
+				puts("\t}");
+			break;
+		case (FTYPE_TEXT):
+			/* FALLTHROUGH */
+		case (FTYPE_PASSWORD):
+			/* FALLTHROUGH */
+		case (FTYPE_EMAIL):
+			if (FIELD_NULL & f->flags)
+				printf("\tif (p->has_%s) {\n", f->name);
+			print_src(FIELD_NULL & f->flags ? 2 : 1,
+				"p->%s = %so->%s);\n"
+				"if (NULL == p->%s) {\n"
+				"perror(NULL);\n"
+				"exit(EXIT_FAILURE);\n"
+				"}",
+				f->name, arena ? 
+				"db_arena_strdup(a, " : "strdup(", 
+				f->name, f->name);
+			if (FIELD_NULL & f->flags)
+				puts("\t}");
+			break;
+		default:
+			break;
+		}
+	}
+
+	puts("}\n"
+	     "");
+}
+
+/*
+ * Generate the functions emptying the row cache of "p" and adding an
+ * (unfilled) row to it, evicting the least recently used if full.
+ * This must have STRCT_HAS_CACHE defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_lru_flush(const struct strct *p)
+{
+
+	if ( ! (STRCT_HAS_CACHE & p->flags))
+		return;
+
+	printf("static void\n"
+	       "db_%s_lru_flush(struct kwbp *ctx)\n"
+	       "{\n"
+	       "\tstruct %s_cache *c;\n"
+	       "\n"
+	       "\twhile (NULL != (c = TAILQ_FIRST(&ctx->lru_%s))) {\n"
+	       "\t\tTAILQ_REMOVE(&ctx->lru_%s, c, entries);\n"
+	       "\t\tdb_%s_unfill_r(&c->obj);\n"
+	       "\t\tfree(c);\n"
+	       "\t}\n"
+	       "\tctx->lru_%s_sz = 0;\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, 
+	       p->name, p->name);
+
+	printf("static struct %s_cache *\n"
+	       "db_%s_lru_add(struct kwbp *ctx)\n"
+	       "{\n"
+	       "\tstruct %s_cache *c;\n"
+	       "\n"
+	       "\tif (++ctx->lru_%s_sz > CACHE_SIZE) {\n"
+	       "\t\tc = TAILQ_LAST(&ctx->lru_%s, %s_cacheq);\n"
+	       "\t\tTAILQ_REMOVE(&ctx->lru_%s, c, entries);\n"
+	       "\t\tdb_%s_unfill_r(&c->obj);\n"
+	       "\t\tfree(c);\n"
+	       "\t\tctx->lru_%s_sz--;\n"
+	       "\t}\n"
+	       "\tif (NULL == (c = malloc(sizeof(struct %s_cache)))) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tTAILQ_INSERT_HEAD(&ctx->lru_%s, c, entries);\n"
+	       "\treturn(c);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, p->name, 
+	       p->name, p->name, p->name, p->name, p->name, 
+	       p->name);
+}
+
+/*
+ * Generate the functions packing a structure (and its nested
+ * structures) into a shared-memory slot buffer and unpacking it.
+ * Unpacked shared structures aren't de-duplicated.
+ * Packing returns zero if the buffer is too small, and unpacking if
+ * the slot is truncated, leaving what was unpacked to be freed with
+ * db_xxx_unfill_r().
+ * This must have STRCT_HAS_COPY or STRCT_HAS_ACOPY defined in its
+ * flags, otherwise the function does nothing.
+ */
+static void
+gen_func_pack_r(const struct strct *p)
+{
+	const struct field *f;
+	const char	*sep = "";
+
+	if ( ! ((STRCT_HAS_COPY | STRCT_HAS_ACOPY) & p->flags))
+		return;
+
+	printf("static int\n"
+	       "db_%s_pack_r(const struct %s *p, "
+	       "char *buf, size_t *pos, size_t max)\n"
+	       "{\n"
+	       "\n"
+	       "\treturn(", p->name, p->name);
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT == f->type && 
+		    FIELD_LAZY & f->flags)
+			continue;
+		printf("%s", sep);
+		sep = " &&\n\t    ";
+		if (FTYPE_STRUCT == f->type) {
+			printf("db_%s_pack_r(%sp->%s, buf, pos, max)", 
+				f->ref->tstrct, FIELD_SHARED & 
+				f->flags ? "" : "&", f->name);
+			continue;
+		}
+		if (FIELD_NULL & f->flags)
+			printf("db_pack(buf, pos, max, &p->has_%s, "
+			       "sizeof(p->has_%s)) &&\n"
+			       "\t    ( ! p->has_%s || ", 
+			       f->name, f->name, f->name);
+		if (FTYPE_BLOB == f->type)
+			printf("(db_pack(buf, pos, max, &p->%s_sz, "
+			       "sizeof(size_t)) &&\n"
+			       "\t     db_pack(buf, pos, max, p->%s, "
+			       "p->%s_sz))", f->name, f->name, f->name);
+		else if (FTYPE_TEXT == f->type ||
+		    FTYPE_PASSWORD == f->type ||
+		    FTYPE_EMAIL == f->type)
+			printf("db_pack_str(buf, pos, max, p->%s)", 
+				f->name);
+		else
+			printf("db_pack(buf, pos, max, &p->%s, "
+			       "sizeof(p->%s))", f->name, f->name);
+		if (FIELD_NULL & f->flags)
+			putchar(')');
+	}
+
+	puts(");\n"
+	     "}\n"
+	     "");
+
+	printf("static int\n"
+	       "db_%s_unpack_r(struct %s *p, "
+	       "const char *buf, size_t *pos, size_t max)\n"
+	       "{\n", p->name, p->name);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FIELD_SHARED & f->flags)
+			printf("\tstruct %s_shared *%s;\n", 
+				f->ref->tstrct, f->name);
+	puts("\n"
+	     "\tmemset(p, 0, sizeof(*p));");
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT == f->type) {
+			if (FIELD_LAZY & f->flags)
+				continue;
+			if ( ! (FIELD_SHARED & f->flags)) {
+				printf("\tif ( ! db_%s_unpack_r(&p->%s, "
+					"buf, pos, max))\n"
+					"\t\treturn(0);\n", 
+					f->ref->tstrct, f->name);
+				continue;
+			}
+			print_src(1, 
+				"%s = malloc(sizeof(struct %s_shared));\n"
+				"if (NULL == %s) {\n"
+				"perror(NULL);\n"
+				"exit(EXIT_FAILURE);\n"
+				"}\n"
+				"%s->refs = 1;\n"
+				"%s->next = NULL;\n"
+				"p->%s = &%s->obj;\n"
+				"if ( ! db_%s_unpack_r(&%s->obj, "
+				"buf, pos, max))\n"
+				"\treturn(0);",
+				f->name, f->ref->tstrct, f->name,
+				f->name, f->name, f->name, f->name, 
+				f->ref->tstrct, f->name);
+			continue;
+		}
+		if (FIELD_NULL & f->flags)
+			printf("\tif ( ! db_unpack(buf, pos, max, "
+			       "&p->has_%s, sizeof(p->has_%s)))\n"
+			       "\t\treturn(0);\n",
+			       f->name, f->name);
+		if (FIELD_NULL & f->flags)
+			printf("\tif (p->has_%s &&\n\t    ", f->name);
+		else
+			fputs("\tif ( ", stdout);
+		if (FTYPE_BLOB == f->type)
+			printf("! db_unpack_blob(buf, pos, max, "
+			       "&p->%s, &p->%s_sz))\n", f->name, f->name);
+		else if (FTYPE_TEXT == f->type ||
+		    FTYPE_PASSWORD == f->type ||
+		    FTYPE_EMAIL == f->type)
+			printf("! db_unpack_str(buf, pos, max, "
+			       "&p->%s))\n", f->name);
+		else
+			printf("! db_unpack(buf, pos, max, "
+			       "&p->%s, sizeof(p->%s)))\n", 
+			       f->name, f->name);
+		puts("\t\treturn(0);");
+	}
+
+	puts("\treturn(1);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the functions managing shared (FIELD_SHARED) objects.
+ * Objects are looked up by rowid in the de-duplication table "d" of
+ * the current result set, if not NULL: if found, its reference count
+ * is bumped and its columns are skipped.
+ * Otherwise, the object is filled and added to the table, which holds
+ * its own reference until released by db_dedup_free(), so results
+ * freed while stepping (e.g., failing a password check) don't free
+ * objects still in the table.
+ * Objects are freed when their last reference is released.
+ * This must have STRCT_HAS_SHARED defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_share(const struct strct *p, int arena)
+{
+
+	if ( ! (STRCT_HAS_SHARED & p->flags))
+		return;
+
+	assert(NULL != p->rowid);
+	printf("static struct %s *\n"
+	       "db_%s_share(%sstruct kwbp_dedup *d, "
+	       "struct ksqlstmt *stmt, size_t *pos)\n"
+	       "{\n"
+	       "\tstruct %s_shared *n = NULL;\n"
+	       "\tint64_t id;\n"
+	       "\tsize_t h;\n"
+	       "\n"
+	       "\tid = ksql_stmt_int(stmt, *pos + %zu);\n"
+	       "\th = (size_t)id %% SHARED_BUCKETS;\n"
+	       "\tif (NULL != d)\n"
+	       "\t\tfor (n = d->%s[h]; NULL != n; n = n->next)\n"
+	       "\t\t\tif (id == n->obj.%s)\n"
+	       "\t\t\t\tbreak;\n"
+	       "\tif (NULL != n) {\n"
+	       "\t\tn->refs++;\n"
+	       "\t\t*pos += %zu;\n"
+	       "\t\treturn(&n->obj);\n"
+	       "\t}\n"
+	       "\tn = %ssizeof(struct %s_shared));\n"
+	       "\tif (NULL == n) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tdb_%s_fill_r(%s%s&n->obj, stmt, pos);\n"
+	       "\tn->refs = 1;\n"
+	       "\tn->next = NULL;\n"
+	       "\tif (NULL != d) {\n"
+	       "\t\tn->refs++;\n"
+	       "\t\tn->next = d->%s[h];\n"
+	       "\t\td->%s[h] = n;\n"
+	       "\t}\n"
+	       "\treturn(&n->obj);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, 
+	       arena ? "struct kwbp_arena *a, " : "",
+	       p->name, fill_cols(p, 1), p->name, 
+	       p->rowid->name, fill_cols(p, 0),
+	       arena ? "db_arena_get(a, " : "malloc(",
+	       p->name, p->name, arena ? "a, " : "",
+	       STRCT_HAS_DEDUP & p->flags ? "d, " : "",
+	       p->name, p->name);
+
+	printf("static void\n"
+	       "db_%s_unshare(struct %s *p)\n"
+	       "{\n"
+	       "\tstruct %s_shared *n = (struct %s_shared *)p;\n"
+	       "\n"
+	       "\tif (NULL == p || --n->refs > 0)\n"
+	       "\t\treturn;\n"
+	       "\tdb_%s_unfill_r(p);\n"
+	       "\tfree(n);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, p->name);
+}
+
+/*
+ * Whether any list or array search, or any children loader, steps over
+ * its result set with a de-duplication table.
+ */
+static int
+has_dedup(const struct strctq *q)
+{
+	const struct strct *p;
+	const struct search *s;
+	const struct field *f;
+
+	TAILQ_FOREACH(p, q, entries) {
+		TAILQ_FOREACH(s, &p->sq, entries)
+			if ((STYPE_LIST == s->type ||
+			     STYPE_ARRAY == s->type) &&
+			    '\0' != *fill_dedup(s, "&d, "))
+				return(1);
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FIELD_CHILDREN & f->flags &&
+			    STRCT_HAS_DEDUP & 
+			    f->ref->target->parent->flags)
+				return(1);
+	}
+	return(0);
+}
+
+/*
+ * Generate db_dedup_free(), which releases the references held by a
+ * de-duplication table (see gen_func_share()) once its result set has
+ * been stepped.
+ * This is only generated if a table is used (see has_dedup()).
+ */
+static void
+gen_func_dedup(const struct strctq *q)
+{
+	const struct strct *p;
+
+	if ( ! has_dedup(q))
+		return;
+
+	puts("static void\n"
+	     "db_dedup_free(struct kwbp_dedup *d)\n"
+	     "{");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_SHARED & p->flags)
+			printf("\tstruct %s_shared *%s_n;\n", 
+				p->name, p->name);
+	puts("\tsize_t i;\n"
+	     "\n"
+	     "\tfor (i = 0; i < SHARED_BUCKETS; i++) {");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_SHARED & p->flags)
+			printf("\t\twhile (NULL != (%s_n = d->%s[i])) {\n"
+			       "\t\t\td->%s[i] = %s_n->next;\n"
+			       "\t\t\tdb_%s_unshare(&%s_n->obj);\n"
+			       "\t\t}\n",
+			       p->name, p->name, p->name, p->name,
+			       p->name, p->name);
+	puts("\t}\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the functions loading a structure "p", the target of lazy
+ * fields, by its rowid.
+ * Loaded structures are kept in a per-handle hashtable so that each is
+ * loaded (and allocated) only once, and are freed by db_unload().
+ * If STRCT_HAS_LAZY_IN is set, also generate db_xxx_lazy_in(), which
+ * loads up to LAZY_BATCH rowids with one statement.
+ * This must have STRCT_HAS_LAZY defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_lazy(const struct strct *p, int arena)
+{
+
+	if ( ! (STRCT_HAS_LAZY & p->flags))
+		return;
+
+	assert(NULL != p->rowid);
+	printf("static struct %s *\n"
+	       "db_%s_lazy_find(struct kwbp *ctx, int64_t id)\n"
+	       "{\n"
+	       "\tstruct %s_lazy *n;\n"
+	       "\n"
+	       "\tn = ctx->lazy_%s[(size_t)id %% LAZY_BUCKETS];\n"
+	       "\tfor ( ; NULL != n; n = n->next)\n"
+	       "\t\tif (id == n->obj.%s)\n"
+	       "\t\t\treturn(&n->obj);\n"
+	       "\treturn(NULL);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, 
+	       p->rowid->name);
+
+	printf("static struct %s *\n"
+	       "db_%s_lazy_add(struct kwbp *ctx, struct ksqlstmt *stmt)\n"
+	       "{\n"
+	       "\tstruct %s_lazy *n;\n"
+	       "\tsize_t h;\n"
+	       "\n"
+	       "\tif (NULL == (n = malloc(sizeof(struct %s_lazy)))) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tdb_%s_fill_r(%s%s&n->obj, stmt, NULL);\n"
+	       "\th = (size_t)n->obj.%s %% LAZY_BUCKETS;\n"
+	       "\tn->next = ctx->lazy_%s[h];\n"
+	       "\tctx->lazy_%s[h] = n;\n"
+	       "\treturn(&n->obj);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, 
+	       p->name, arena ? "NULL, " : "", 
+	       STRCT_HAS_DEDUP & p->flags ? "NULL, " : "",
+	       p->rowid->name, p->name, p->name);
+
+	printf("static struct %s *\n"
+	       "db_%s_lazy(struct kwbp *ctx, int64_t id)\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s *p;\n"
+	       "\n"
+	       "\tif (NULL != (p = db_%s_lazy_find(ctx, id)))\n"
+	       "\t\treturn(p);\n"
+	       "\tstmt = db_stmt_get(ctx, STMT_%s_LAZY);\n"
+	       "\tksql_bind_int(stmt, 0, id);\n"
+	       "\tif (KSQL_ROW == ksql_stmt_step(stmt))\n"
+	       "\t\tp = db_%s_lazy_add(ctx, stmt);\n"
+	       "\tdb_stmt_put(ctx, STMT_%s_LAZY, stmt);\n"
+	       "\treturn(p);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->name, p->name, 
+	       p->cname, p->name, p->cname);
+
+	if ( ! (STRCT_HAS_LAZY_IN & p->flags))
+		return;
+
+	/* 
+	 * The statement has a fixed number of parameters, so repeat
+	 * the last rowid in those left over.
+	 * Rowids already loaded are never passed in.
+	 */
+
+	printf("static void\n"
+	       "db_%s_lazy_in(struct kwbp *ctx, "
+	       "const int64_t *ids, size_t sz)\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tsize_t i;\n"
+	       "\n"
+	       "\tstmt = db_stmt_get(ctx, STMT_%s_LAZY_IN);\n"
+	       "\tfor (i = 0; i < LAZY_BATCH; i++)\n"
+	       "\t\tksql_bind_int(stmt, i, "
+	       "ids[i < sz ? i : sz - 1]);\n"
+	       "\twhile (KSQL_ROW == ksql_stmt_step(stmt))\n"
+	       "\t\tdb_%s_lazy_add(ctx, stmt);\n"
+	       "\tdb_stmt_put(ctx, STMT_%s_LAZY_IN, stmt);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->cname, p->name, p->cname);
+}
+
+/*
+ * Generate the batched accessor loading the lazy field "f" of all
+ * members of a queue or, if "array" is non-zero, an array.
+ * Rowids not already loaded are collected and loaded LAZY_BATCH at a
+ * time, then the members are set from the loaded structures.
+ */
+static void
+gen_func_load_many(const struct field *f, int array)
+{
+	char	 skip[128], need[128];
+
+	skip[0] = need[0] = '\0';
+	if (FIELD_NULL & f->ref->source->flags) {
+		snprintf(skip, sizeof(skip), 
+			" || ! p->has_%s", f->ref->sfield);
+		snprintf(need, sizeof(need), 
+			" && p->has_%s", f->ref->sfield);
+	}
+
+	if (array)
+		print_func_db_load_array(f, 0, 0);
+	else
+		print_func_db_load_q(f, 0, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct %s *p;\n"
+	       "\tint64_t ids[LAZY_BATCH];\n"
+	       "\tsize_t sz = 0;\n",
+	       f->parent->name);
+	if (array)
+		puts("\tsize_t i;");
+	puts("");
+
+	if (array)
+		puts("\tfor (i = 0; i < q->count; i++) {\n"
+		     "\t\tp = &q->items[i];");
+	else
+		puts("\tTAILQ_FOREACH(p, q, _entries) {");
+	printf("\t\tif (NULL != p->%s%s)\n"
+	       "\t\t\tcontinue;\n"
+	       "\t\tp->%s = db_%s_lazy_find(ctx, p->%s);\n"
+	       "\t\tif (NULL != p->%s)\n"
+	       "\t\t\tcontinue;\n"
+	       "\t\tids[sz++] = p->%s;\n"
+	       "\t\tif (LAZY_BATCH == sz) {\n"
+	       "\t\t\tdb_%s_lazy_in(ctx, ids, sz);\n"
+	       "\t\t\tsz = 0;\n"
+	       "\t\t}\n"
+	       "\t}\n"
+	       "\tif (sz > 0)\n"
+	       "\t\tdb_%s_lazy_in(ctx, ids, sz);\n"
+	       "\n",
+	       f->name, skip, f->name, f->ref->tstrct, 
+	       f->ref->sfield, f->name, f->ref->sfield, 
+	       f->ref->tstrct, f->ref->tstrct);
+
+	if (array)
+		puts("\tfor (i = 0; i < q->count; i++) {\n"
+		     "\t\tp = &q->items[i];");
+	else
+		puts("\tTAILQ_FOREACH(p, q, _entries) {");
+	printf("\t\tif (NULL == p->%s%s)\n"
+	       "\t\t\tp->%s = db_%s_lazy_find(ctx, p->%s);\n"
+	       "\t}\n"
+	       "}\n"
+	       "\n",
+	       f->name, need, f->name, 
+	       f->ref->tstrct, f->ref->sfield);
+}
+
+/*
+ * Generate the accessors loading the lazy fields of "p".
+ * These only load (see gen_func_lazy()) if not already set.
+ * Children are generated by gen_func_children().
+ */
+static void
+gen_func_load(const struct strct *p)
+{
+	const struct field *f;
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if ( ! (FIELD_LAZY & f->flags) ||
+		    FIELD_CHILDREN & f->flags)
+			continue;
+		print_func_db_load(f, 0, 0);
+		printf("\n"
+		       "{\n"
+		       "\n"
+		       "\tif (NULL == p->%s", f->name);
+		if (FIELD_NULL & f->ref->source->flags)
+			printf(" && p->has_%s", f->ref->sfield);
+		printf(")\n"
+		       "\t\tp->%s = db_%s_lazy(ctx, p->%s);\n"
+		       "\treturn(p->%s);\n"
+		       "}\n"
+		       "\n",
+		       f->name, f->ref->tstrct, 
+		       f->ref->sfield, f->name);
+		if (STRCT_HAS_QUEUE & p->flags)
+			gen_func_load_many(f, 0);
+		if (STRCT_HAS_ARRAY & p->flags)
+			gen_func_load_many(f, 1);
+	}
+}
+
+/*
+ * Generate the functions loading the children (FIELD_CHILDREN) "f",
+ * numbered "num" amongst those of its structure.
+ * Children are loaded for up to LAZY_BATCH parents of distinct keys
+ * at a time, then grouped into the queue of each parent by key.
+ * Shared fields of the children are de-duplicated over the batch.
+ */
+static void
+gen_func_children(const struct field *f, size_t num, int arena)
+{
+	const struct strct *p = f->parent;
+	const char	*ap = arena ? "a, " : "",
+	     		*alloc = arena ? "db_arena_get(a, " : "malloc(";
+	int		 many, dedup;
+
+	dedup = STRCT_HAS_DEDUP & f->ref->target->parent->flags;
+
+	printf("static void\n"
+	       "db_%s_children_%zu(struct kwbp *ctx, %s"
+	       "struct %s **ps, size_t sz)\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s *c;\n"
+	       "\tsize_t i;\n"
+	       "%s"
+	       "\n"
+	       "\tfor (i = 0; i < sz; i++) {\n"
+	       "\t\tps[i]->%s = %ssizeof(struct %s_q));\n"
+	       "\t\tif (NULL == ps[i]->%s) {\n"
+	       "\t\t\tperror(NULL);\n"
+	       "\t\t\texit(EXIT_FAILURE);\n"
+	       "\t\t}\n"
+	       "\t\tTAILQ_INIT(ps[i]->%s);\n"
+	       "\t}\n"
+	       "\n"
+	       "%s"
+	       "\tstmt = db_stmt_get(ctx, STMT_%s_CHILDREN_%zu);\n"
+	       "\tfor (i = 0; i < LAZY_BATCH; i++)\n"
+	       "\t\tksql_bind_int(stmt, i, "
+	       "ps[i < sz ? i : sz - 1]->%s);\n"
+	       "\twhile (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tc = %ssizeof(struct %s));\n"
+	       "\t\tif (NULL == c) {\n"
+	       "\t\t\tperror(NULL);\n"
+	       "\t\t\texit(EXIT_FAILURE);\n"
+	       "\t\t}\n"
+	       "\t\tdb_%s_fill_r(%s%sc, stmt, NULL);\n"
+	       "\t\tfor (i = 0; i < sz - 1; i++)\n"
+	       "\t\t\tif (ps[i]->%s == c->%s)\n"
+	       "\t\t\t\tbreak;\n"
+	       "\t\tTAILQ_INSERT_TAIL(ps[i]->%s, c, _entries);\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, STMT_%s_CHILDREN_%zu, stmt);\n"
+	       "%s"
+	       "}\n"
+	       "\n",
+	       p->name, num, arena ? "struct kwbp_arena *a, " : "",
+	       p->name, f->ref->tstrct, 
+	       dedup ? "\tstruct kwbp_dedup d;\n" : "",
+	       f->name, alloc, f->ref->tstrct, f->name, f->name,
+	       dedup ? "\tmemset(&d, 0, "
+	       "sizeof(struct kwbp_dedup));\n" : "",
+	       p->cname, num, f->ref->sfield,
+	       alloc, f->ref->tstrct, f->ref->tstrct, ap,
+	       dedup ? "&d, " : "", f->ref->sfield, f->ref->tfield, f->name,
+	       p->cname, num, ! dedup ? "" : arena ?
+	       "\tif (NULL == a)\n\t\tdb_dedup_free(&d);\n" :
+	       "\tdb_dedup_free(&d);\n");
+
+	print_func_db_load(f, arena, 0);
+	printf("\n"
+	       "{\n"
+	       "\n"
+	       "\tif (NULL == p->%s)\n"
+	       "\t\tdb_%s_children_%zu(ctx, %s&p, 1);\n"
+	       "\treturn(p->%s);\n"
+	       "}\n"
+	       "\n",
+	       f->name, p->name, num, ap, f->name);
+
+	/*
+	 * Parents sharing a key can't share children, so those with a
+	 * key already being loaded are left to a subsequent batch.
+	 */
+
+	for (many = 0; many < 2; many++) {
+		if (0 == many && ! (STRCT_HAS_QUEUE & p->flags))
+			continue;
+		if (1 == many && ! (STRCT_HAS_ARRAY & p->flags))
+			continue;
+		if (many)
+			print_func_db_load_array(f, arena, 0);
+		else
+			print_func_db_load_q(f, arena, 0);
+		printf("\n"
+		       "{\n"
+		       "\tstruct %s *p, *ps[LAZY_BATCH];\n"
+		       "\tsize_t sz, i;\n", p->name);
+		if (many)
+			puts("\tsize_t j;");
+		puts("\n"
+		     "\tdo {\n"
+		     "\t\tsz = 0;");
+		if (many)
+			puts("\t\tfor (j = 0; j < q->count; j++) {\n"
+			     "\t\t\tp = &q->items[j];");
+		else
+			puts("\t\tTAILQ_FOREACH(p, q, _entries) {");
+		printf("\t\t\tif (NULL != p->%s)\n"
+		       "\t\t\t\tcontinue;\n"
+		       "\t\t\tfor (i = 0; i < sz; i++)\n"
+		       "\t\t\t\tif (ps[i]->%s == p->%s)\n"
+		       "\t\t\t\t\tbreak;\n"
+		       "\t\t\tif (i < sz)\n"
+		       "\t\t\t\tcontinue;\n"
+		       "\t\t\tps[sz++] = p;\n"
+		       "\t\t\tif (LAZY_BATCH == sz)\n"
+		       "\t\t\t\tbreak;\n"
+		       "\t\t}\n"
+		       "\t\tif (sz > 0)\n"
+		       "\t\t\tdb_%s_children_%zu(ctx, %sps, sz);\n"
+		       "\t} while (sz > 0);\n"
+		       "}\n"
+		       "\n",
+		       f->name, f->ref->sfield, f->ref->sfield,
+		       p->name, num, ap);
+	}
+}
+
+/*
+ * Generate db_unload(), freeing all structures loaded by
+ * gen_func_lazy().
+ * This does nothing if there are no lazy fields.
+ */
+static void
+gen_func_unload(const struct strctq *q)
+{
+	const struct strct *p;
+
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			break;
+	if (NULL == p)
+		return;
+
+	print_func_db_unload(0);
+	puts("{\n"
+	     "\tsize_t i;");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			printf("\tstruct %s_lazy *%s;\n", 
+				p->name, p->name);
+	puts("\n"
+	     "\tfor (i = 0; i < LAZY_BUCKETS; i++) {");
+	TAILQ_FOREACH(p, q, entries) {
+		if ( ! (STRCT_HAS_LAZY & p->flags))
+			continue;
+		printf("\t\twhile (NULL != (%s = ctx->lazy_%s[i])) {\n"
+		       "\t\t\tctx->lazy_%s[i] = %s->next;\n"
+		       "\t\t\tdb_%s_unfill_r(&%s->obj);\n"
+		       "\t\t\tfree(%s);\n"
+		       "\t\t}\n",
+		       p->name, p->name, p->name, p->name,
+		       p->name, p->name, p->name);
+	}
+	puts("\t}\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Print out a search function for an STYPE_COUNT or STYPE_EXISTS.
+ * These return the single value selected by the statement, or -1 if
+ * interrupted by the deadline.
+ */
+static void
+gen_strct_func_count(const struct search *s, size_t num)
+{
+
+	assert(STYPE_COUNT == s->type || STYPE_EXISTS == s->type);
+
+	print_func_db_search(s, 0, 0);
+	puts("\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;\n"
+	     "\tint64_t val = 0;\n");
+	printf("\tstmt = db_stmt_get(ctx, ");
+	gen_search_stmtid(s, num);
+	puts(");\n"
+	     "\tdb_deadline_start(ctx);");
+	gen_search_binds(s);
+	printf("\tif (KSQL_ROW == ksql_stmt_step(stmt))\n"
+	       "\t\tval = ksql_stmt_int(stmt, 0);\n"
+	       "\tdb_stmt_put(ctx, ");
+	gen_search_stmtid(s, num);
+	printf(", stmt);\n"
+	       "\tdb_deadline_stop(ctx);\n"
+	       "\treturn(ctx->expired ? -1 : %s);\n"
+	       "}\n"
+	       "\n",
+	       STYPE_COUNT == s->type ? "val" : "val > 0");
+}
+
+/*
+ * Print out a search function for an STYPE_SEARCH marked as cached.
+ * Rows are first looked up by value in the structure's row cache,
+ * which is flushed if the database's data version (or, if attached,
+ * the shared-memory generation) has changed.
+ * Otherwise, the row is unpacked from shared memory, if found, or
+ * filled from the database and packed into shared memory.
+ * Shared memory isn't used within transactions, whose rows may not be
+ * committed.
+ * Either way, the caller gets a copy of the cached row.
+ */
+static void
+gen_strct_func_cached(const struct search *s, size_t num, int arena)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	const struct strct *p = s->parent;
+	size_t	 pos;
+
+	assert(STYPE_SEARCH == s->type);
+	assert(TAILQ_EMPTY(&s->fq));
+
+	print_func_db_search(s, arena, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s_cache *c;\n"
+	       "\tstruct %s *p, obj;\n"
+	       "\tchar buf[SHM_SLOT_SIZE];\n"
+	       "\tsize_t ksz = 0, sz, pos, num = %zu;\n"
+	       "\tint64_t v;\n"
+	       "\tint key;\n"
+	       "\n"
+	       "\tv = NULL != ctx->shm_%s ?\n"
+	       "\t\t(int64_t)ctx->shm_%s->gen : "
+	       "db_data_version(ctx);\n"
+	       "\tif (v != ctx->lru_%s_version) {\n"
+	       "\t\tdb_%s_lru_flush(ctx);\n"
+	       "\t\tctx->lru_%s_version = v;\n"
+	       "\t}\n"
+	       "\tTAILQ_FOREACH(c, &ctx->lru_%s, entries)\n"
+	       "\t\tif (",
+	       p->name, p->name, num, p->name, p->name, 
+	       p->name, p->name, p->name, p->name);
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		assert(OPTYPE_EQUAL == sent->op);
+		if (pos > 1)
+			printf(" &&\n"
+			       "\t\t    ");
+		if (FIELD_NULL & sr->field->flags)
+			printf("c->obj.%s && ", 
+				sref_member(&sent->srq, 1));
+		if (FTYPE_TEXT == sr->field->type ||
+		    FTYPE_EMAIL == sr->field->type)
+			printf("0 == strcmp(c->obj.%s, v%zu)",
+				sref_member(&sent->srq, 0), pos);
+		else
+			printf("c->obj.%s == v%zu", 
+				sref_member(&sent->srq, 0), pos);
+		pos++;
+	}
+
+	printf(")\n"
+	       "\t\t\tbreak;\n"
+	       "\tif (NULL != c) {\n"
+	       "\t\tTAILQ_REMOVE(&ctx->lru_%s, c, entries);\n"
+	       "\t\tTAILQ_INSERT_HEAD(&ctx->lru_%s, c, entries);\n"
+	       "\t} else {\n"
+	       "\t\tkey = 0 == ctx->trans && NULL != ctx->shm_%s &&\n"
+	       "\t\t    db_pack(buf, &ksz, sizeof(buf), "
+	       "&num, sizeof(size_t))",
+	       p->name, p->name, p->name);
+
+	/* The key is the search number and its values. */
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_TEXT == sr->field->type ||
+		    FTYPE_EMAIL == sr->field->type)
+			printf(" &&\n"
+			       "\t\t    db_pack_str(buf, &ksz, "
+			       "sizeof(buf), v%zu)", pos);
+		else
+			printf(" &&\n"
+			       "\t\t    db_pack(buf, &ksz, sizeof(buf), "
+			       "&v%zu, sizeof(v%zu))", pos, pos);
+		pos++;
+	}
+
+	printf(";\n"
+	       "\t\tif (key && db_shm_get(ctx->shm_%s, v, "
+	       "buf, ksz, &sz)) {\n"
+	       "\t\t\tpos = ksz;\n"
+	       "\t\t\tif (db_%s_unpack_r(&obj, buf, &pos, sz)) {\n"
+	       "\t\t\t\tc = db_%s_lru_add(ctx);\n"
+	       "\t\t\t\tc->obj = obj;\n"
+	       "\t\t\t} else\n"
+	       "\t\t\t\tdb_%s_unfill_r(&obj);\n"
+	       "\t\t}\n"
+	       "\t\tif (NULL == c) {\n"
+	       "\t\t\tstmt = db_stmt_get(ctx, "
+	       "STMT_%s_BY_SEARCH_%zu);\n"
+	       "\t\t\tdb_deadline_start(ctx);\n",
+	       p->name, p->name, p->name, p->name, p->cname, num);
+
+	/* Bindings are as in gen_search_binds(), indented. */
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		fputs("\t\t", stdout);
+		gen_bindfunc(sr->field->type, pos++, 0);
+	}
+
+	printf("\t\t\tif (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\t\t\tc = db_%s_lru_add(ctx);\n"
+	       "\t\t\t\tdb_%s_fill_r(%s%s&c->obj, stmt, NULL);\n"
+	       "\t\t\t}\n"
+	       "\t\t\tdb_stmt_put(ctx, "
+	       "STMT_%s_BY_SEARCH_%zu, stmt);\n"
+	       "\t\t\tdb_deadline_stop(ctx);\n"
+	       "\t\t\tsz = ksz;\n"
+	       "\t\t\tif (NULL != c && key && "
+	       "db_%s_pack_r(&c->obj, buf, &sz, sizeof(buf)))\n"
+	       "\t\t\t\tdb_shm_put(ctx->shm_%s, v, "
+	       "buf, ksz, sz);\n"
+	       "\t\t}\n"
+	       "\t\tif (NULL == c)\n"
+	       "\t\t\treturn(NULL);\n"
+	       "\t}\n"
+	       "\n"
+	       "\tp = %ssizeof(struct %s));\n"
+	       "\tif (NULL == p) {\n"
+	       "\t\tperror(NULL);\n"
+	       "\t\texit(EXIT_FAILURE);\n"
+	       "\t}\n"
+	       "\tdb_%s_copy_r(%sp, &c->obj);\n"
+	       "\treturn(p);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, arena ? "NULL, " : "",
+	       fill_dedup(s, "NULL, "), p->cname, num, 
+	       p->name, p->name,
+	       arena ? "db_arena_get(a, " : "malloc(", p->name,
+	       p->name, arena ? "a, " : "");
+}
+
+/*
+ * Print out a search function for an STYPE_SEARCH.
+ * This searches for a singular value.
+ */
+static void
+gen_strct_func_srch(const struct search *s, size_t num, int arena)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	size_t	 pos;
+
+	assert(STYPE_SEARCH == s->type);
+
+	print_func_db_search(s, arena, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tstruct %s *p = NULL;\n"
+	       "\n"
+	       "\tstmt = db_stmt_get(ctx, ",
+	       s->parent->name);
+	gen_search_stmtid(s, num);
+	puts(");\n"
+	     "\tdb_deadline_start(ctx);");
+
+	gen_search_binds(s);
+
+	printf("\tif (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tp = %ssizeof(struct %s));\n"
+	       "\t\tif (NULL == p) {\n"
+	       "\t\t\tperror(NULL);\n"
+	       "\t\t\texit(EXIT_FAILURE);\n"
+	       "\t\t}\n"
+	       "\t\tdb_%s_fill_%s(%s%sp, stmt, NULL);\n",
+	       arena ? "db_arena_get(a, " : "malloc(",
+	       s->parent->name, s->parent->name,
+	       fill_suffix(s, num), arena ? "a, " : "",
+	       fill_dedup(s, "NULL, "));
+
+	/*
+	 * If we have any hashes, we're going to need to do the hash
+	 * check after the field has already been extracted from the
+	 * database.
+	 * If the hash doesn't match, nullify.
+	 */
+
+	pos = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		if (OPTYPE_ISUNARY(sent->op))
+			continue;
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD != sr->field->type) {
+			pos++;
+			continue;
+		}
+		printf("\t\tif (NULL != p && "
+			"crypt_checkpass(v%zu, p->%s) < 0) {\n"
+		       "%s"
+		       "\t\t\tdb_%s_free(p);\n"
+		       "\t\t\tp = NULL;\n"
+		       "\t\t}\n",
+		       pos, sref_member(&sent->srq, 0), 
+		       arena ? "\t\t\tif (NULL == a)\n\t" : "",
+		       s->parent->name);
+		pos++;
+	}
+
+	printf("\t}\n"
+	       "\tdb_stmt_put(ctx, ");
+	gen_search_stmtid(s, num);
+	puts(", stmt);\n"
+	     "\tdb_deadline_stop(ctx);\n"
+	     "\treturn(p);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the "freeq" function.
+ * This must have STRCT_HAS_QUEUE defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_freeq(const struct strct *p)
+{
+
+	if ( ! (STRCT_HAS_QUEUE & p->flags))
+		return;
+
+	print_func_db_freeq(p, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct %s *p;\n\n"
+	       "\tif (NULL == q)\n"
+	       "\t\treturn;\n"
+	       "\twhile (NULL != (p = TAILQ_FIRST(q))) {\n"
+	       "\t\tTAILQ_REMOVE(q, p, _entries);\n"
+	       "\t\tdb_%s_free(p);\n"
+	       "\t}\n\n"
+	       "\tfree(q);\n"
+	       "}\n"
+	       "\n", 
+	       p->name, p->name);
+}
+
+/*
+ * Generate the "freearray" function.
+ * This must have STRCT_HAS_ARRAY defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_freearray(const struct strct *p)
+{
+
+	if ( ! (STRCT_HAS_ARRAY & p->flags))
+		return;
+
+	print_func_db_freearray(p, 0);
+	printf("\n"
+	       "{\n"
+	       "\tsize_t i;\n\n"
+	       "\tif (NULL == q)\n"
+	       "\t\treturn;\n"
+	       "\tfor (i = 0; i < q->count; i++)\n"
+	       "\t\tdb_%s_unfill_r(&q->items[i]);\n"
+	       "\tfree(q->items);\n"
+	       "\tfree(q);\n"
+	       "}\n"
+	       "\n", 
+	       p->name);
+}
+
+/*
+ * Return non-zero if "p" is "x" or joins it (not lazily) into its
+ * results.
+ */
+static int
+strct_joins(const struct strct *p, const struct strct *x)
+{
+	const struct field *f;
+
+	if (p == x)
+		return(1);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags) &&
+		    strct_joins(f->ref->target->parent, x))
+			return(1);
+	return(0);
+}
+
+/*
+ * Invalidate the row caches of all structures in "q" that might contain
+ * rows of "x", having just been modified, or all if "x" is NULL.
+ * This bumps the generation of shared-memory caches, too.
+ * Modifications within a transaction mark it as dirty, so caches are
+ * invalidated again once it's committed (see gen_func_trans()).
+ */
+static void
+gen_cache_invalidate(const struct strctq *q, const struct strct *x)
+{
+	const struct strct *p;
+	int	 dirty = 0;
+
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags &&
+		    (NULL == x || strct_joins(p, x))) {
+			printf("\tctx->lru_%s_version = -1;\n"
+			       "\tif (NULL != ctx->shm_%s)\n"
+			       "\t\t__sync_fetch_and_add"
+			       "(&ctx->shm_%s->gen, 1);\n",
+			       p->name, p->name, p->name);
+			dirty = 1;
+		}
+
+	if (dirty && NULL != x)
+		puts("\tif (ctx->trans > 0)\n"
+		     "\t\tctx->trans_dirty = 1;");
+}
+
+/*
+ * Generate the function re-reading the row "id" of a structure with
+ * nested structures, which the RETURNING clause of a write filling in
+ * its row can't fill, into "p" with its joins.
+ * Returns zero if the row isn't found.
+ */
+static void
+gen_func_fill_rowid(const struct strct *p, int arena)
+{
+
+	if ( ! has_nested(p))
+		return;
+
+	printf("static int\n"
+	       "db_%s_fill_rowid(struct kwbp *ctx, "
+	       "struct %s *p, int64_t id)\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tint rc = 0;\n"
+	       "\n"
+	       "\tstmt = db_stmt_get(ctx, STMT_%s_RET);\n"
+	       "\tksql_bind_int(stmt, 0, id);\n"
+	       "\tif (KSQL_ROW == ksql_stmt_step(stmt)) {\n"
+	       "\t\tdb_%s_fill_r(%s%sp, stmt, NULL);\n"
+	       "\t\trc = 1;\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, STMT_%s_RET, stmt);\n"
+	       "\treturn(rc);\n"
+	       "}\n"
+	       "\n",
+	       p->name, p->name, p->cname, p->name, 
+	       arena ? "NULL, " : "", 
+	       STRCT_HAS_DEDUP & p->flags ? "NULL, " : "",
+	       p->cname);
+}
+
+/*
+ * Generate the "insert" function or, if "up" is not NULL, the upsert
+ * function "num", which binds the same values.
+ * If "ret" is non-zero, generate the insert variant filling in the new
+ * row with db_xxx_fill(), which takes an arena if "arena" is non-zero,
+ * or for structures with nested structures, with db_xxx_fill_rowid()
+ * in a savepoint rolled back if the row can't be filled.
+ */
+static void
+gen_func_insert(const struct strctq *q, const struct strct *p,
+	const struct update *up, size_t num, int ret, int arena)
+{
+	const struct field *f;
+	size_t	 pos, npos;
+	int	 nested;
+	char	 stmt[64];
+
+	if (NULL != up) {
+		snprintf(stmt, sizeof(stmt), 
+			"STMT_%s_UPSERT_%zu", p->cname, num);
+		print_func_db_upsert(up, 0);
+	} else {
+		snprintf(stmt, sizeof(stmt), 
+			"STMT_%s_INSERT%s", p->cname, ret ? "_RET" : "");
+		print_func_db_insert(p, ret, 0);
+	}
+	nested = ret && has_nested(p);
+	puts("\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;");
+	if (ret)
+		puts("\tenum ksqlc c;");
+	if ( ! ret || nested)
+		puts("\tint64_t id = -1;");
 
 	/* We need temporary space for hash generation. */
 
@@ -568,10 +3411,11 @@ gen_func_insert(const struct strct *p)
 	if (pos > 1)
 		puts("");
 
-	printf("\tksql_stmt_alloc(db, &stmt,\n"
-	       "\t\tstmts[STMT_%s_INSERT],\n"
-	       "\t\tSTMT_%s_INSERT);\n",
-	       p->cname, p->cname);
+	puts("\tdb_write_start(ctx);");
+	if (nested)
+		puts("\tksql_exec(ctx->db, "
+		     "\"SAVEPOINT ret\", STMT__MAX);");
+	printf("\tstmt = db_stmt_get(ctx, %s);\n", stmt);
 
 	pos = npos = 1;
 	TAILQ_FOREACH(f, &p->fq, entries) {
@@ -594,12 +3438,36 @@ gen_func_insert(const struct strct *p)
 			gen_bindfunc(f->type, 
 				npos++, FIELD_NULL & f->flags);
 	}
-	puts("\tif (KSQL_DONE == ksql_stmt_cstep(stmt))\n"
-	     "\t\tksql_lastid(db, &id);\n"
-	     "\tksql_stmt_free(stmt);\n"
-	     "\treturn(id);\n"
-	     "}\n"
-	     "");
+	if (nested)
+		printf("\tif (KSQL_ROW == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\tid = ksql_stmt_int(stmt, 0);\n"
+		       "\tdb_stmt_put(ctx, %s, stmt);\n"
+		       "\tif (KSQL_ROW == c && "
+		       "! db_%s_fill_rowid(ctx, p, id))\n"
+		       "\t\tc = KSQL_DB;\n"
+		       "\tif ( ! db_ret_release(ctx, KSQL_ROW == c) &&\n"
+		       "\t    KSQL_ROW == c) {\n"
+		       "\t\tdb_%s_unfill(p);\n"
+		       "\t\tc = KSQL_DB;\n"
+		       "\t}\n", stmt, p->name, p->name);
+	else if (ret)
+		printf("\tif (KSQL_ROW == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\tdb_%s_fill(%sp, stmt, NULL);\n",
+		       p->name, arena ? "NULL, " : "");
+	else if (NULL != up)
+		puts("\tif (KSQL_ROW == ksql_stmt_cstep(stmt))\n"
+		     "\t\tid = ksql_stmt_int(stmt, 0);");
+	else
+		puts("\tif (KSQL_DONE == ksql_stmt_cstep(stmt))\n"
+		     "\t\tksql_lastid(ctx->db, &id);");
+	if ( ! nested)
+		printf("\tdb_stmt_put(ctx, %s, stmt);\n", stmt);
+	puts("\tdb_write_stop(ctx);");
+	gen_cache_invalidate(q, p);
+	printf("\treturn(%s);\n"
+	       "}\n"
+	       "\n", ret ? "KSQL_ROW == c" : 
+	       "ctx->busy_expired ? -2 : id");
 }
 
 /*
@@ -620,18 +3488,35 @@ gen_func_free(const struct strct *p)
 }
 
 /*
- * Generate the "unfill" function.
+ * Generate the "unfill" function, which frees nested structures too.
  */
 static void
 gen_func_unfill(const struct strct *p)
 {
-	const struct field *f;
 
 	print_func_db_unfill(p, 0);
-	puts("\n"
-	     "{\n"
-	     "\tif (NULL == p)\n"
-	     "\t\treturn;");
+	printf("\n"
+	       "{\n"
+	       "\tdb_%s_unfill_r(p);\n"
+	       "}\n"
+	       "\n", p->name);
+}
+
+/*
+ * Generate the nested "unfill" function.
+ */
+static void
+gen_func_unfill_r(const struct strct *p)
+{
+	const struct field *f;
+
+	printf("static void\n"
+	       "db_%s_unfill_r(struct %s *p)\n"
+	       "{\n"
+	       "\tif (NULL == p)\n"
+	       "\t\treturn;\n"
+	       "\n",
+	       p->name, p->name);
 	TAILQ_FOREACH(f, &p->fq, entries)
 		switch(f->type) {
 		case (FTYPE_BLOB):
@@ -640,6 +3525,19 @@ gen_func_unfill(const struct strct *p)
 		case (FTYPE_EMAIL):
 			printf("\tfree(p->%s);\n", f->name);
 			break;
+		case (FTYPE_STRUCT):
+			if (FIELD_CHILDREN & f->flags)
+				printf("\tdb_%s_freeq(p->%s);\n", 
+					f->ref->tstrct, f->name);
+			else if (FIELD_LAZY & f->flags)
+				break;
+			else if (FIELD_SHARED & f->flags)
+				printf("\tdb_%s_unshare(p->%s);\n",
+					f->ref->tstrct, f->name);
+			else
+				printf("\tdb_%s_unfill_r(&p->%s);\n",
+					f->ref->tstrct, f->name);
+			break;
 		default:
 			break;
 		}
@@ -648,25 +3546,83 @@ gen_func_unfill(const struct strct *p)
 }
 
 /*
- * Generate the nested "unfill" function.
+ * Generate the nested "fill" function.
+ * This must have STRCT_HAS_FILL defined in its flags, otherwise the
+ * function does nothing.
  */
 static void
-gen_func_unfill_r(const struct strct *p)
+gen_func_fill_r(const struct strct *p, int arena)
 {
 	const struct field *f;
+	const char	*ap = arena ? "a, " : "";
+
+	if ( ! (STRCT_HAS_FILL & p->flags))
+		return;
 
 	printf("static void\n"
-	       "db_%s_unfill_r(struct %s *p)\n"
+	       "db_%s_fill_r(%s%sstruct %s *p, "
+	       "struct ksqlstmt *stmt, size_t *pos)\n"
 	       "{\n"
-	       "\tif (NULL == p)\n"
-	       "\t\treturn;\n"
+	       "\tsize_t i = 0;\n"
 	       "\n"
-	       "\tdb_%s_unfill(p);\n",
-	       p->name, p->name, p->name);
+	       "\tif (NULL == pos)\n"
+	       "\t\tpos = &i;\n"
+	       "\tdb_%s_fill(%sp, stmt, pos);\n",
+	       p->name, arena ? "struct kwbp_arena *a, " : "", 
+	       STRCT_HAS_DEDUP & p->flags ? 
+	       "struct kwbp_dedup *d, " : "",
+	       p->name, p->name, ap);
 	TAILQ_FOREACH(f, &p->fq, entries)
-		if (FTYPE_STRUCT == f->type)
-			printf("\tdb_%s_unfill_r(&p->%s);\n",
-				f->ref->tstrct, f->name);
+		if (FTYPE_STRUCT != f->type ||
+		    FIELD_LAZY & f->flags)
+			continue;
+		else if (FIELD_SHARED & f->flags)
+			printf("\tp->%s = db_%s_share(%sd, "
+				"stmt, pos);\n", 
+				f->name, f->ref->tstrct, ap);
+		else
+			printf("\tdb_%s_fill_r(%s%s&p->%s, "
+				"stmt, pos);\n", f->ref->tstrct, ap, 
+				STRCT_HAS_DEDUP & 
+				f->ref->target->parent->flags ?
+				"d, " : "", f->name);
+	puts("}\n"
+	     "");
+}
+
+/*
+ * Generate the function filling only the projected fields of search
+ * "s" numbered "num", zeroing the rest.
+ * Iterators fill in-place as with gen_func_borrow_r().
+ * This does nothing if the search has no projection.
+ */
+static void
+gen_func_project(const struct search *s, size_t num, int arena)
+{
+	const struct sref *sr;
+	const char	*type;
+
+	if (TAILQ_EMPTY(&s->fq))
+		return;
+
+	type = STYPE_ITERATE == s->type ? "borrow" : "fill";
+	printf("static void\n"
+	       "db_%s_%s_%zu(%sstruct %s *p, "
+	       "struct ksqlstmt *stmt, size_t *pos)\n"
+	       "{\n"
+	       "\tsize_t i = 0;\n"
+	       "\n"
+	       "\tif (NULL == pos)\n"
+	       "\t\tpos = &i;\n"
+	       "\tmemset(p, 0, sizeof(*p));\n",
+	       s->parent->name, type, num, 
+	       arena && STYPE_ITERATE != s->type ?
+	       "struct kwbp_arena *a, " : "", s->parent->name);
+	TAILQ_FOREACH(sr, &s->fq, entries)
+		if (STYPE_ITERATE == s->type)
+			gen_strct_borrow_field(sr->field);
+		else
+			gen_strct_fill_field(sr->field, arena);
 	puts("}\n"
 	     "");
 }
@@ -675,66 +3631,477 @@ gen_func_unfill_r(const struct strct *p)
  * Generate the "fill" function.
  */
 static void
-gen_func_fill_r(const struct strct *p)
+gen_func_fill(const struct strct *p, int arena)
+{
+	const struct field *f;
+
+	print_func_db_fill(p, arena, 0);
+	puts("\n"
+	     "{\n"
+	     "\tsize_t i = 0;\n"
+	     "\n"
+	     "\tif (NULL == pos)\n"
+	     "\t\tpos = &i;\n"
+	     "\tmemset(p, 0, sizeof(*p));");
+	TAILQ_FOREACH(f, &p->fq, entries)
+		gen_strct_fill_field(f, arena);
+	puts("}\n"
+	     "");
+}
+
+/*
+ * Generate the in-place "fill" function used by iterators.
+ * This must have STRCT_HAS_BORROW defined in its flags, otherwise the
+ * function does nothing.
+ */
+static void
+gen_func_borrow_r(const struct strct *p)
+{
+	const struct field *f;
+
+	if ( ! (STRCT_HAS_BORROW & p->flags))
+		return;
+
+	printf("static void\n"
+	       "db_%s_borrow_r(struct %s *p, "
+	       "struct ksqlstmt *stmt, size_t *pos)\n"
+	       "{\n"
+	       "\tsize_t i = 0;\n"
+	       "\n"
+	       "\tif (NULL == pos)\n"
+	       "\t\tpos = &i;\n"
+	       "\tmemset(p, 0, sizeof(*p));\n",
+	       p->name, p->name);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		gen_strct_borrow_field(f);
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_STRUCT == f->type &&
+		    ! (FIELD_LAZY & f->flags))
+			printf("\tdb_%s_borrow_r(&p->%s, "
+				"stmt, pos);\n", 
+				f->ref->tstrct, f->name);
+	puts("}\n"
+	     "");
+}
+
+/*
+ * Generate the "insert_many" function.
+ * This binds each row's members to the insert statement within a
+ * savepoint, which opens a transaction if none is open, so that there's
+ * only one commit.
+ * Passwords are hashed from their own arrays rather than the members,
+ * which hold hashes when filled.
+ * On failure, the identifiers are reset.
+ */
+static void
+gen_func_insert_many(const struct strctq *q, const struct strct *p)
 {
 	const struct field *f;
+	const char	*ind;
+	size_t	 pos, hpos;
+
+	print_func_db_insert_many(p, 0);
+	puts("\n"
+	     "{\n"
+	     "\tstruct ksqlstmt *stmt;\n"
+	     "\tenum ksqlc c = KSQL_DONE;\n"
+	     "\tsize_t i;");
+
+	/* 
+	 * Hashes are bound statically, so each password needs its own
+	 * buffer until the row is stepped.
+	 */
+
+	hpos = 1;
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FTYPE_PASSWORD == f->type)
+			printf("\tchar hash%zu[64];\n", hpos++);
+
+	printf("\n"
+	       "\tdb_write_start(ctx);\n"
+	       "\tksql_exec(ctx->db, "
+	       "\"SAVEPOINT insert_many\", STMT__MAX);\n"
+	       "\tstmt = db_stmt_get(ctx, STMT_%s_INSERT);\n"
+	       "\tfor (i = 0; i < sz && KSQL_DONE == c; i++) {\n",
+	       p->cname);
+
+	pos = 0;
+	hpos = 1;
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT == f->type ||
+		    FIELD_ROWID & f->flags)
+			continue;
+		ind = "\t\t";
+		if (FIELD_NULL & f->flags && 
+		    FTYPE_PASSWORD == f->type) {
+			printf("\t\tif (NULL == pw%zu[i])\n"
+			       "\t\t\tksql_bind_null(stmt, %zu);\n"
+			       "\t\telse {\n", hpos, pos);
+			ind = "\t\t\t";
+		} else if (FIELD_NULL & f->flags) {
+			printf("\t\tif ( ! v[i].has_%s)\n"
+			       "\t\t\tksql_bind_null(stmt, %zu);\n"
+			       "\t\telse\n", f->name, pos);
+			ind = "\t\t\t";
+		}
+		if (FTYPE_PASSWORD == f->type) {
+			printf("%scrypt_newhash(pw%zu[i], "
+			       "\"blowfish,a\", hash%zu, "
+			       "sizeof(hash%zu));\n"
+			       "%sksql_bind_str(stmt, %zu, hash%zu);\n"
+			       "%s", ind, hpos, hpos, hpos, 
+			       ind, pos, hpos,
+			       FIELD_NULL & f->flags ? "\t\t}\n" : "");
+			hpos++;
+		} else if (FTYPE_BLOB == f->type)
+			printf("%s%s(stmt, %zu, v[i].%s, v[i].%s_sz);\n",
+				ind, bindtypes[f->type], pos, 
+				f->name, f->name);
+		else
+			printf("%s%s(stmt, %zu, v[i].%s);\n",
+				ind, bindtypes[f->type], pos, f->name);
+		pos++;
+	}
+
+	printf("\t\tif (KSQL_DONE == "
+	       "(c = ksql_stmt_cstep(stmt)) && NULL != ids)\n"
+	       "\t\t\tksql_lastid(ctx->db, &ids[i]);\n"
+	       "\t\tksql_stmt_reset(stmt);\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, STMT_%s_INSERT, stmt);\n"
+	       "\tif (KSQL_DONE != c)\n"
+	       "\t\tksql_exec(ctx->db, "
+	       "\"ROLLBACK TO insert_many\", STMT__MAX);\n"
+	       "\tif (KSQL_OK != ksql_exec(ctx->db, "
+	       "\"RELEASE insert_many\", STMT__MAX)) {\n"
+	       "\t\tksql_exec(ctx->db, \"ROLLBACK\", STMT__MAX);\n"
+	       "\t\tc = KSQL_DB;\n"
+	       "\t}\n"
+	       "\tif (KSQL_DONE != c && NULL != ids)\n"
+	       "\t\tfor (i = 0; i < sz; i++)\n"
+	       "\t\t\tids[i] = -1;\n"
+	       "\tdb_write_stop(ctx);\n",
+	       p->cname);
+	gen_cache_invalidate(q, p);
+	puts("\treturn(KSQL_DONE == c);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the transaction functions.
+ * Transactions opened within others are savepoints named by their depth.
+ * Rows read into caches within a transaction may be rolled back, and
+ * other processes may fill shared caches with prior rows until it's
+ * committed, so caches are invalidated on rollback and on the final
+ * commit of a transaction having modified cached rows, whether opened
+ * for reading or writing.
+ */
+static void
+gen_func_trans(const struct strctq *q)
+{
+	const struct strct *p;
+
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			break;
+
+	puts("static int\n"
+	     "db_trans_exec(struct kwbp *ctx, const char *sql)\n"
+	     "{\n"
+	     "\tenum ksqlc c;\n"
+	     "\n"
+	     "\tdb_write_start(ctx);\n"
+	     "\tc = ksql_exec(ctx->db, sql, STMT__MAX);\n"
+	     "\tdb_write_stop(ctx);\n"
+	     "\treturn(KSQL_OK == c);\n"
+	     "}\n"
+	     "\n"
+	     "static int\n"
+	     "db_trans_open(struct kwbp *ctx, const char *sql)\n"
+	     "{\n"
+	     "\tchar buf[64];\n"
+	     "\n"
+	     "\tif (ctx->trans > 0) {\n"
+	     "\t\tsnprintf(buf, sizeof(buf), "
+	     "\"SAVEPOINT trans%zu\", ctx->trans);\n"
+	     "\t\tsql = buf;\n"
+	     "\t}\n"
+	     "\tif ( ! db_trans_exec(ctx, sql))\n"
+	     "\t\treturn(0);\n"
+	     "\tif (0 == ctx->trans++)\n"
+	     "\t\tctx->trans_dirty = 0;\n"
+	     "\treturn(1);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_trans_open(0, 0);
+	puts("\n"
+	     "{\n"
+	     "\n"
+	     "\treturn(db_trans_open(ctx, \"BEGIN DEFERRED\"));\n"
+	     "}\n"
+	     "");
+	print_func_db_trans_open(1, 0);
+	puts("\n"
+	     "{\n"
+	     "\n"
+	     "\treturn(db_trans_open(ctx, \"BEGIN IMMEDIATE\"));\n"
+	     "}\n"
+	     "");
+
+	print_func_db_trans_close(0, 0);
+	puts("\n"
+	     "{\n"
+	     "\tconst char *sql = \"COMMIT\";\n"
+	     "\tchar buf[64];\n"
+	     "\n"
+	     "\tif (0 == ctx->trans)\n"
+	     "\t\treturn(0);\n"
+	     "\tif (ctx->trans > 1) {\n"
+	     "\t\tsnprintf(buf, sizeof(buf), "
+	     "\"RELEASE trans%zu\", ctx->trans - 1);\n"
+	     "\t\tsql = buf;\n"
+	     "\t}\n"
+	     "\tif ( ! db_trans_exec(ctx, sql))\n"
+	     "\t\treturn(0);");
+	if (NULL != p) {
+		puts("\tif (--ctx->trans > 0 || ! ctx->trans_dirty)\n"
+		     "\t\treturn(1);");
+		gen_cache_invalidate(q, NULL);
+	} else
+		puts("\tctx->trans--;");
+	puts("\treturn(1);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_trans_close(1, 0);
+	puts("\n"
+	     "{\n"
+	     "\tconst char *sql = \"ROLLBACK\";\n"
+	     "\tchar buf[64];\n"
+	     "\n"
+	     "\tif (0 == ctx->trans)\n"
+	     "\t\treturn(0);\n"
+	     "\tif (ctx->trans > 1) {\n"
+	     "\t\tsnprintf(buf, sizeof(buf), "
+	     "\"ROLLBACK TO trans%zu; RELEASE trans%zu\",\n"
+	     "\t\t\tctx->trans - 1, ctx->trans - 1);\n"
+	     "\t\tsql = buf;\n"
+	     "\t}\n"
+	     "\tif ( ! db_trans_exec(ctx, sql))\n"
+	     "\t\treturn(0);\n"
+	     "\tctx->trans--;");
+	gen_cache_invalidate(q, NULL);
+	puts("\treturn(1);\n"
+	     "}\n"
+	     "");
+}
+
+/*
+ * Generate the connection pool functions.
+ * Each connection is a handle as returned by db_open(), so each has its
+ * own statements and caches, with readers set to refuse writes.
+ * Handles are checked out under the pool's mutex, waiting on its
+ * condition if none are free.
+ */
+static void
+gen_func_pool(const struct strctq *q, int metrics)
+{
+	const struct strct *p;
+
+	puts("static void\n"
+	     "db_pool_lock(struct kwbp_pool *pool)\n"
+	     "{\n"
+	     "\tint er;\n"
+	     "\n"
+	     "\tif (0 != (er = pthread_mutex_lock(&pool->mutex))) {\n"
+	     "\t\terrno = er;\n"
+	     "\t\tperror(NULL);\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "\t}\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_pool_unlock(struct kwbp_pool *pool)\n"
+	     "{\n"
+	     "\tint er;\n"
+	     "\n"
+	     "\tif (0 != (er = pthread_mutex_unlock(&pool->mutex))) {\n"
+	     "\t\terrno = er;\n"
+	     "\t\tperror(NULL);\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "\t}\n"
+	     "}\n"
+	     "\n"
+	     "static void\n"
+	     "db_pool_wait(struct kwbp_pool *pool)\n"
+	     "{\n"
+	     "\tint er;\n"
+	     "\n"
+	     "\tif (0 != (er = pthread_cond_wait"
+	     "(&pool->cond, &pool->mutex))) {\n"
+	     "\t\terrno = er;\n"
+	     "\t\tperror(NULL);\n"
+	     "\t\texit(EXIT_FAILURE);\n"
+	     "\t}\n"
+	     "}\n"
+	     "");
+
+	print_func_db_pool_open(0);
+	puts("{\n"
+	     "\tstruct kwbp_pool *pool;\n"
+	     "\n"
+	     "\tif (NULL == (pool = calloc(1, sizeof(struct kwbp_pool))))\n"
+	     "\t\treturn(NULL);\n"
+	     "\tif (0 != pthread_mutex_init(&pool->mutex, NULL)) {\n"
+	     "\t\tfree(pool);\n"
+	     "\t\treturn(NULL);\n"
+	     "\t} else if (0 != pthread_cond_init(&pool->cond, NULL)) {\n"
+	     "\t\tpthread_mutex_destroy(&pool->mutex);\n"
+	     "\t\tfree(pool);\n"
+	     "\t\treturn(NULL);\n"
+	     "\t}\n"
+	     "\tif (nreaders > 0 &&\n"
+	     "\t    NULL == (pool->readers = "
+	     "calloc(nreaders, sizeof(struct kwbp *)))) {\n"
+	     "\t\tdb_pool_close(pool);\n"
+	     "\t\treturn(NULL);\n"
+	     "\t}\n"
+	     "\tif (NULL == (pool->writer = db_open(file))) {\n"
+	     "\t\tdb_pool_close(pool);\n"
+	     "\t\treturn(NULL);\n"
+	     "\t}\n"
+	     "\tfor ( ; pool->nreaders < nreaders; pool->nreaders++) {\n"
+	     "\t\tpool->readers[pool->nreaders] = db_open(file);\n"
+	     "\t\tif (NULL == pool->readers[pool->nreaders]) {\n"
+	     "\t\t\tdb_pool_close(pool);\n"
+	     "\t\t\treturn(NULL);\n"
+	     "\t\t}\n"
+	     "\t\tksql_exec(pool->readers[pool->nreaders]->db,\n"
+	     "\t\t\t\"PRAGMA query_only = 1\", STMT__MAX);\n"
+	     "\t}\n"
+	     "\tpool->nfree = pool->nreaders;\n"
+	     "\treturn(pool);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_pool_close(0);
+	puts("{\n"
+	     "\tsize_t i;\n"
+	     "\n"
+	     "\tif (NULL == pool)\n"
+	     "\t\treturn;\n"
+	     "\tfor (i = 0; i < pool->nreaders; i++)\n"
+	     "\t\tdb_close(pool->readers[i]);\n"
+	     "\tdb_close(pool->writer);\n"
+	     "\tpthread_cond_destroy(&pool->cond);\n"
+	     "\tpthread_mutex_destroy(&pool->mutex);\n"
+	     "\tfree(pool->readers);\n"
+	     "\tfree(pool);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_pool_get(0, 0);
+	puts("{\n"
+	     "\tstruct kwbp *ctx;\n"
+	     "\n"
+	     "\tif (0 == pool->nreaders)\n"
+	     "\t\treturn(db_pool_get_write(pool));\n"
+	     "\tdb_pool_lock(pool);\n"
+	     "\twhile (0 == pool->nfree)\n"
+	     "\t\tdb_pool_wait(pool);\n"
+	     "\tctx = pool->readers[--pool->nfree];\n"
+	     "\tdb_pool_unlock(pool);\n"
+	     "\treturn(ctx);\n"
+	     "}\n"
+	     "");
+
+	print_func_db_pool_get(1, 0);
+	puts("{\n"
+	     "\n"
+	     "\tdb_pool_lock(pool);\n"
+	     "\twhile (pool->writing)\n"
+	     "\t\tdb_pool_wait(pool);\n"
+	     "\tpool->writing = 1;\n"
+	     "\tdb_pool_unlock(pool);\n"
+	     "\treturn(pool->writer);\n"
+	     "}\n"
+	     "");
 
-	printf("static void\n"
-	       "db_%s_fill_r(struct %s *p, "
-	       "struct ksqlstmt *stmt, size_t *pos)\n"
-	       "{\n"
-	       "\tsize_t i = 0;\n"
-	       "\n"
-	       "\tif (NULL == pos)\n"
-	       "\t\tpos = &i;\n"
-	       "\tdb_%s_fill(p, stmt, pos);\n",
-	       p->name, p->name, p->name);
-	TAILQ_FOREACH(f, &p->fq, entries)
-		if (FTYPE_STRUCT == f->type)
-			printf("\tdb_%s_fill_r(&p->%s, "
-				"stmt, pos);\n", 
-				f->ref->tstrct, f->name);
-	puts("}\n"
+	print_func_db_pool_put(0);
+	puts("{\n"
+	     "\n"
+	     "\tif (NULL == ctx)\n"
+	     "\t\treturn;\n"
+	     "\twhile (ctx->trans > 0 && db_trans_rollback(ctx))\n"
+	     "\t\tcontinue;\n"
+	     "\tdb_pool_lock(pool);\n"
+	     "\tif (ctx == pool->writer)\n"
+	     "\t\tpool->writing = 0;\n"
+	     "\telse\n"
+	     "\t\tpool->readers[pool->nfree++] = ctx;\n"
+	     "\tpthread_cond_broadcast(&pool->cond);\n"
+	     "\tdb_pool_unlock(pool);\n"
+	     "}\n"
 	     "");
-}
 
-/*
- * Generate the "fill" function.
- */
-static void
-gen_func_fill(const struct strct *p)
-{
-	const struct field *f;
+	if (metrics) {
+		print_func_db_pool_metrics_attach(0);
+		puts("{\n"
+		     "\tsize_t i;\n"
+		     "\tint rc = 0;\n"
+		     "\n"
+		     "\tdb_pool_lock(pool);\n"
+		     "\tif (pool->nfree == pool->nreaders && "
+		     "! pool->writing) {\n"
+		     "\t\trc = db_metrics_attach(pool->writer, file);\n"
+		     "\t\tfor (i = 0; rc && i < pool->nreaders; i++)\n"
+		     "\t\t\trc = db_metrics_attach"
+		     "(pool->readers[i], file);\n"
+		     "\t}\n"
+		     "\tdb_pool_unlock(pool);\n"
+		     "\treturn(rc);\n"
+		     "}\n"
+		     "");
+	}
 
-	print_func_db_fill(p, 0);
-	puts("\n"
-	     "{\n"
-	     "\tsize_t i = 0;\n"
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			break;
+	if (NULL == p)
+		return;
+
+	print_func_db_pool_shm_attach(0);
+	puts("{\n"
+	     "\tsize_t i;\n"
+	     "\tint rc = 0;\n"
 	     "\n"
-	     "\tif (NULL == pos)\n"
-	     "\t\tpos = &i;\n"
-	     "\tmemset(p, 0, sizeof(*p));");
-	TAILQ_FOREACH(f, &p->fq, entries)
-		gen_strct_fill_field(f);
-	puts("}\n"
+	     "\tdb_pool_lock(pool);\n"
+	     "\tif (pool->nfree == pool->nreaders && "
+	     "! pool->writing) {\n"
+	     "\t\trc = db_shm_attach(pool->writer, file);\n"
+	     "\t\tfor (i = 0; rc && i < pool->nreaders; i++)\n"
+	     "\t\t\trc = db_shm_attach(pool->readers[i], file);\n"
+	     "\t}\n"
+	     "\tdb_pool_unlock(pool);\n"
+	     "\treturn(rc);\n"
+	     "}\n"
 	     "");
 }
 
 /*
- * Generate an update or delete function.
+ * Declare buffers for, then create, the hashes of the passwords set by
+ * an update.
+ * This finishes the function's declarations.
+ * If "many" is non-zero, this first returns if there are no values.
  */
 static void
-gen_func_update(const struct update *up, size_t num)
+gen_func_update_hash(const struct update *up, int many)
 {
 	const struct uref *ref;
 	size_t	 pos, npos;
 
-	print_func_db_update(up, 0);
-	printf("\n"
-	       "{\n"
-	       "\tstruct ksqlstmt *stmt;\n"
-	       "\tenum ksqlc c;\n");
-
 	/* Create hash buffer for modifying hashes. */
 
 	pos = 1;
@@ -742,6 +4109,9 @@ gen_func_update(const struct update *up, size_t num)
 		if (FTYPE_PASSWORD == ref->field->type)
 			printf("\tchar hash%zu[64];\n", pos++);
 	puts("");
+	if (many)
+		puts("\tif (0 == sz)\n"
+		     "\t\treturn(0);");
 
 	/* Create hash from password. */
 
@@ -762,19 +4132,17 @@ gen_func_update(const struct update *up, size_t num)
 
 	if (pos > 1)
 		puts("");
+}
 
-	if (UP_MODIFY == up->type)
-		printf("\tksql_stmt_alloc(db, &stmt,\n"
-		       "\t\tstmts[STMT_%s_UPDATE_%zu],\n"
-		       "\t\tSTMT_%s_UPDATE_%zu);\n",
-		       up->parent->cname, num, 
-		       up->parent->cname, num);
-	else
-		printf("\tksql_stmt_alloc(db, &stmt,\n"
-		       "\t\tstmts[STMT_%s_DELETE_%zu],\n"
-		       "\t\tSTMT_%s_DELETE_%zu);\n",
-		       up->parent->cname, num, 
-		       up->parent->cname, num);
+/*
+ * Bind the values (or hashes) set by an update to "stmt".
+ * Returns the position (from one) of the first constraint value.
+ */
+static size_t
+gen_func_update_bind(const struct update *up)
+{
+	const struct uref *ref;
+	size_t	 pos, npos;
 
 	npos = pos = 1;
 	TAILQ_FOREACH(ref, &up->mrq, entries) {
@@ -793,19 +4161,184 @@ gen_func_update(const struct update *up, size_t num)
 				FIELD_NULL & ref->field->flags);
 		npos++;
 	}
+	return(npos);
+}
+
+/*
+ * Bind the constraint values of an update or delete to "stmt", from
+ * the position "npos" (from one) returned by gen_func_update_bind().
+ * If "nest" is non-zero, this is within a block.
+ */
+static void
+gen_func_update_bindc(const struct update *up, size_t npos, int nest)
+{
+	const struct uref *ref;
+
 	TAILQ_FOREACH(ref, &up->crq, entries) {
 		assert(FTYPE_STRUCT != ref->field->type);
 		assert(FTYPE_PASSWORD != ref->field->type);
 		if (OPTYPE_ISUNARY(ref->op))
 			continue;
-		printf("\t%s(stmt, %zu, v%zu);\n", 
-			bindtypes[ref->field->type],
+		printf("\t%s%s(stmt, %zu, v%zu);\n", 
+			nest ? "\t" : "", bindtypes[ref->field->type],
 			npos - 1, npos);
 		npos++;
 	}
-	puts("\tc = ksql_stmt_cstep(stmt);\n"
-	     "\tksql_stmt_free(stmt);\n"
-	     "\treturn(KSQL_CONSTRAINT != c);\n"
+}
+
+/*
+ * Generate an update or delete function.
+ * This invalidates the row caches that might contain the modified rows.
+ * The variants filling in the modified row of a structure with nested
+ * structures run in a savepoint with the query re-reading the row (or,
+ * for deletes, first reading it), which is rolled back if the row
+ * can't be filled.
+ */
+static void
+gen_func_update(const struct strctq *q, 
+	const struct update *up, size_t num, int ret, int arena)
+{
+	const struct strct *p = up->parent;
+	size_t	 npos;
+	int	 nested = ret && has_nested(p);
+	char	 stmt[64], del[64], fill[128];
+
+	snprintf(stmt, sizeof(stmt), "STMT_%s_%s_%zu%s", 
+		p->cname, UP_MODIFY == up->type ? "UPDATE" : "DELETE", 
+		num, ret ? "_RET" : "");
+	snprintf(del, sizeof(del), "STMT_%s_DELETE_%zu", p->cname, num);
+	snprintf(fill, sizeof(fill), "db_%s_fill_r(%s%sp, stmt, NULL)", 
+		p->name, arena ? "NULL, " : "", 
+		STRCT_HAS_DEDUP & p->flags ? "NULL, " : "");
+	print_func_db_update(up, ret, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tenum ksqlc c;\n"
+	       "%s%s", ret ? "\tint n = 0;\n" : "", 
+	       nested && UP_MODIFY == up->type ? 
+	       "\tint64_t id = -1;\n" : "");
+
+	gen_func_update_hash(up, 0);
+	puts("\tdb_write_start(ctx);");
+	if (nested)
+		puts("\tksql_exec(ctx->db, "
+		     "\"SAVEPOINT ret\", STMT__MAX);");
+	printf("\tstmt = db_stmt_get(ctx, %s);\n", stmt);
+	npos = gen_func_update_bind(up);
+	gen_func_update_bindc(up, npos, 0);
+	if (nested && UP_MODIFY == up->type)
+		printf("\twhile (KSQL_ROW == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\tif (0 == n++)\n"
+		       "\t\t\tid = ksql_stmt_int(stmt, 0);\n"
+		       "\tdb_stmt_put(ctx, %s, stmt);\n"
+		       "\tif (KSQL_DONE == c && n > 0 &&\n"
+		       "\t    ! db_%s_fill_rowid(ctx, p, id)) {\n"
+		       "\t\tn = 0;\n"
+		       "\t\tc = KSQL_DB;\n"
+		       "\t}\n", stmt, p->name);
+	else if (nested) {
+		printf("\tif (KSQL_ROW == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\t%s;\n"
+		       "\tdb_stmt_put(ctx, %s, stmt);\n"
+		       "\tif (KSQL_ROW == c) {\n"
+		       "\t\tstmt = db_stmt_get(ctx, %s);\n", 
+		       fill, stmt, del);
+		assert(TAILQ_EMPTY(&up->mrq));
+		gen_func_update_bindc(up, 1, 1);
+		printf("\t\tif (KSQL_DONE == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\t\tn = db_changes(ctx);\n"
+		       "\t\telse\n"
+		       "\t\t\tdb_%s_unfill(p);\n"
+		       "\t\tdb_stmt_put(ctx, %s, stmt);\n"
+		       "\t}\n", p->name, del);
+	} else if (ret)
+		printf("\twhile (KSQL_ROW == (c = ksql_stmt_cstep(stmt)))\n"
+		       "\t\tif (0 == n++)\n"
+		       "\t\t\tdb_%s_fill(%sp, stmt, NULL);\n"
+		       "\tdb_stmt_put(ctx, %s, stmt);\n",
+		       p->name, arena ? "NULL, " : "", stmt);
+	else
+		printf("\tc = ksql_stmt_cstep(stmt);\n"
+		       "\tdb_stmt_put(ctx, %s, stmt);\n", stmt);
+	if (nested)
+		printf("\tif ( ! db_ret_release(ctx, KSQL_DONE == c) &&\n"
+		       "\t    KSQL_DONE == c) {\n"
+		       "\t\tif (n > 0)\n"
+		       "\t\t\tdb_%s_unfill(p);\n"
+		       "\t\tc = KSQL_DB;\n"
+		       "\t}\n", p->name);
+	puts("\tdb_write_stop(ctx);");
+	gen_cache_invalidate(q, p);
+	printf("\treturn(%s);\n"
+	       "}\n"
+	       "\n", ret ? "KSQL_DONE == c ? n :\n"
+	       "\t    ctx->busy_expired ? -2 : -1" :
+	       "KSQL_DONE == c");
+}
+
+/*
+ * Generate the set-based variant of an update or delete function.
+ * Its constraint values are bound MANY_BATCH at a time, with the last
+ * value repeated to fill the final batch, all within a savepoint.
+ * Modified rows are counted with db_changes() after each batch.
+ */
+static void
+gen_func_update_many(const struct strctq *q, 
+	const struct update *up, size_t num)
+{
+	const struct uref *ref;
+	size_t	 npos;
+	char	 stmt[64];
+	const char *save = UP_MODIFY == up->type ?
+		"update_many" : "delete_many";
+
+	snprintf(stmt, sizeof(stmt), "STMT_%s_%s_%zu_MANY", 
+		up->parent->cname, 
+		UP_MODIFY == up->type ? "UPDATE" : "DELETE", num);
+	print_func_db_update_many(up, 0);
+	printf("\n"
+	       "{\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tenum ksqlc c = KSQL_DONE;\n"
+	       "\tsize_t i, j;\n"
+	       "\tint64_t n = 0;\n");
+	gen_func_update_hash(up, 1);
+
+	printf("\tdb_write_start(ctx);\n"
+	       "\tksql_exec(ctx->db, "
+	       "\"SAVEPOINT %s\", STMT__MAX);\n"
+	       "\tstmt = db_stmt_get(ctx, %s);\n", save, stmt);
+	npos = gen_func_update_bind(up);
+
+	ref = TAILQ_FIRST(&up->crq);
+	assert(NULL != ref && NULL == TAILQ_NEXT(ref, entries));
+	assert(FTYPE_STRUCT != ref->field->type);
+	assert(FTYPE_PASSWORD != ref->field->type);
+	printf("\tfor (i = 0; i < sz && KSQL_DONE == c; "
+		"i += MANY_BATCH) {\n"
+	       "\t\tfor (j = 0; j < MANY_BATCH; j++)\n"
+	       "\t\t\t%s(stmt, %zu + j,\n"
+	       "\t\t\t\tv%zu[i + j < sz ? i + j : sz - 1]);\n"
+	       "\t\tif (KSQL_DONE == (c = ksql_stmt_cstep(stmt)))\n"
+	       "\t\t\tn += db_changes(ctx);\n"
+	       "\t\tksql_stmt_reset(stmt);\n"
+	       "\t}\n"
+	       "\tdb_stmt_put(ctx, %s, stmt);\n"
+	       "\tif (KSQL_DONE != c)\n"
+	       "\t\tksql_exec(ctx->db, "
+	       "\"ROLLBACK TO %s\", STMT__MAX);\n"
+	       "\tif (KSQL_OK != ksql_exec(ctx->db, "
+	       "\"RELEASE %s\", STMT__MAX)) {\n"
+	       "\t\tksql_exec(ctx->db, \"ROLLBACK\", STMT__MAX);\n"
+	       "\t\tc = KSQL_DB;\n"
+	       "\t}\n"
+	       "\tdb_write_stop(ctx);\n",
+	       bindtypes[ref->field->type], npos - 1, npos, 
+	       stmt, save, save);
+	gen_cache_invalidate(q, up->parent);
+	puts("\treturn(KSQL_DONE == c ? n :\n"
+	     "\t    ctx->busy_expired ? -2 : -1);\n"
 	     "}\n"
 	     "");
 }
@@ -919,6 +4452,7 @@ gen_func_json_obj(const struct strct *p)
 		       "\tkjson_obj_open(r);\n"
 		       "\tjson_%s_data(r, p);\n"
 		       "\tkjson_obj_close(r);\n"
+		       "\treturn(0);\n"
 		       "}\n\n", p->name);
 	}
 }
@@ -927,7 +4461,7 @@ static void
 gen_func_json_data(const struct strct *p)
 {
 	const struct field *f;
-	size_t	 pos;
+	size_t	 pos, cpos;
 
 	print_func_json_data(p, 0);
 	puts("\n"
@@ -941,8 +4475,19 @@ gen_func_json_data(const struct strct *p)
 		    ! (FIELD_NOEXPORT & f->flags)) 
 			printf("\tchar *buf%zu;\n", ++pos);
 
+	/* Declare our iterators over children. */
+
+	cpos = 0;
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FIELD_CHILDREN & f->flags &&
+		    ! (FIELD_NOEXPORT & f->flags)) 
+			printf("\tconst struct %s *c%zu;\n", 
+				f->ref->tstrct, ++cpos);
+
 	if (pos > 0)
 		puts("\tsize_t sz;\n");
+	else if (cpos > 0)
+		puts("");
 
 	pos = 0;
 	TAILQ_FOREACH(f, &p->fq, entries) {
@@ -966,7 +4511,7 @@ gen_func_json_data(const struct strct *p)
 	if (pos > 0)
 		puts("");
 
-	pos = 0;
+	pos = cpos = 0;
 	TAILQ_FOREACH(f, &p->fq, entries) {
 		if (FIELD_NOEXPORT & f->flags) {
 			print_commentv(1, COMMENT_C, "Omitting %s: "
@@ -986,6 +4531,28 @@ gen_func_json_data(const struct strct *p)
 		if (FTYPE_BLOB == f->type)
 			printf("\t%s(r, \"%s\", buf%zu);\n",
 				puttypes[f->type], f->name, ++pos);
+		else if (FIELD_CHILDREN & f->flags) {
+			cpos++;
+			printf("\tif (NULL == p->%s)\n"
+			       "\t\tkjson_putnullp(r, \"%s\");\n"
+			       "\telse {\n"
+			       "\t\tkjson_arrayp_open(r, \"%s\");\n"
+			       "\t\tTAILQ_FOREACH(c%zu, p->%s, _entries) {\n"
+			       "\t\t\tkjson_obj_open(r);\n"
+			       "\t\t\tjson_%s_data(r, c%zu);\n"
+			       "\t\t\tkjson_obj_close(r);\n"
+			       "\t\t}\n"
+			       "\t\tkjson_array_close(r);\n"
+			       "\t}\n",
+			       f->name, f->name, f->name, cpos, 
+			       f->name, f->ref->tstrct, cpos);
+		} else if ((FIELD_LAZY | FIELD_SHARED) & f->flags)
+			printf("\tif (NULL == p->%s)\n"
+			       "\t\tkjson_putnullp(r, \"%s\");\n"
+			       "\telse\n"
+			       "\t\tjson_%s_obj(r, p->%s);\n",
+				f->name, f->ref->tstrct, 
+				f->ref->tstrct, f->name);
 		else if (FTYPE_STRUCT == f->type)
 			printf("\tjson_%s_obj(r, &p->%s);\n",
 				f->ref->tstrct, f->name);
@@ -1012,22 +4579,38 @@ gen_func_json_data(const struct strct *p)
 
 /*
  * Generate all of the functions we've defined in our header for the
- * given structure "s".
+ * given structure "p" amongst all structures "q".
  */
 static void
-gen_funcs(const struct strct *p, int json, int valids)
+gen_funcs(const struct strctq *q, const struct strct *p, 
+	int json, int valids, int arena)
 {
 	const struct search *s;
 	const struct update *u;
 	size_t	 pos;
 
-	gen_func_fill_r(p);
-	gen_func_fill(p);
+	gen_func_fill_r(p, arena);
+	gen_func_fill(p, arena);
+	gen_func_borrow_r(p);
+	pos = 0;
+	TAILQ_FOREACH(s, &p->sq, entries)
+		gen_func_project(s, pos++, arena);
 	gen_func_unfill_r(p);
 	gen_func_unfill(p);
+	gen_func_share(p, arena);
+	gen_func_copy_r(p, arena);
+	gen_func_pack_r(p);
+	gen_func_lru_flush(p);
+	gen_func_lazy(p, arena);
+	gen_func_load(p);
 	gen_func_free(p);
 	gen_func_freeq(p);
-	gen_func_insert(p);
+	gen_func_freearray(p);
+	gen_func_cursor(p);
+	gen_func_fill_rowid(p, arena);
+	gen_func_insert(q, p, NULL, 0, 0, arena);
+	gen_func_insert(q, p, NULL, 0, 1, arena);
+	gen_func_insert_many(q, p);
 
 	if (json) {
 		gen_func_json_data(p);
@@ -1039,43 +4622,107 @@ gen_funcs(const struct strct *p, int json, int valids)
 
 	pos = 0;
 	TAILQ_FOREACH(s, &p->sq, entries)
-		if (STYPE_SEARCH == s->type)
-			gen_strct_func_srch(s, pos++);
+		if (SEARCH_IS_CACHED & s->flags)
+			gen_strct_func_cached(s, pos++, arena);
+		else if (STYPE_SEARCH == s->type)
+			gen_strct_func_srch(s, pos++, arena);
 		else if (STYPE_LIST == s->type)
-			gen_strct_func_list(s, pos++);
-		else
-			gen_strct_func_iter(s, pos++);
+			gen_strct_func_list(s, pos++, arena);
+		else if (STYPE_ARRAY == s->type)
+			gen_strct_func_array(s, pos++, arena);
+		else if (STYPE_COUNT == s->type ||
+		    STYPE_EXISTS == s->type)
+			gen_strct_func_count(s, pos++);
+		else {
+			gen_strct_func_iter(s, pos, arena);
+			gen_strct_func_cursor_open(s, pos++);
+		}
 
 	pos = 0;
-	TAILQ_FOREACH(u, &p->uq, entries)
-		gen_func_update(u, pos++);
+	TAILQ_FOREACH(u, &p->uq, entries) {
+		gen_func_update(q, u, pos, 0, arena);
+		gen_func_update(q, u, pos, 1, arena);
+		if (UPDATE_HAS_MANY & u->flags)
+			gen_func_update_many(q, u, pos);
+		pos++;
+	}
+	pos = 0;
+	TAILQ_FOREACH(u, &p->dq, entries) {
+		gen_func_update(q, u, pos, 0, arena);
+		gen_func_update(q, u, pos, 1, arena);
+		if (UPDATE_HAS_MANY & u->flags)
+			gen_func_update_many(q, u, pos);
+		pos++;
+	}
 	pos = 0;
-	TAILQ_FOREACH(u, &p->dq, entries)
-		gen_func_update(u, pos++);
+	TAILQ_FOREACH(u, &p->pq, entries)
+		gen_func_insert(q, p, u, pos++, 0, arena);
 }
 
 /*
  * Generate a set of statements that will be used for this structure.
+ * If "names" is non-zero, these are printed as strings instead, which
+ * name the statements in the per-statement metrics.
  */
 static void
-gen_enum(const struct strct *p)
+gen_enum(const struct strct *p, int names)
 {
 	const struct search *s;
 	const struct update *u;
+	const struct field *f;
+	const char *qt = names ? "\"" : "";
 	size_t	 pos;
 
 	pos = 0;
-	TAILQ_FOREACH(s, &p->sq, entries)
-		printf("\tSTMT_%s_BY_SEARCH_%zu,\n", p->cname, pos++);
+	TAILQ_FOREACH(s, &p->sq, entries) {
+		printf("\t%sSTMT_%s_BY_SEARCH_%zu%s,\n", 
+			qt, p->cname, pos, qt);
+		if (SEARCH_HAS_AFTER & s->flags)
+			printf("\t%sSTMT_%s_BY_SEARCH_%zu_AFTER%s,\n", 
+				qt, p->cname, pos, qt);
+		pos++;
+	}
 
-	printf("\tSTMT_%s_INSERT,\n", p->cname);
+	if (STRCT_HAS_LAZY & p->flags)
+		printf("\t%sSTMT_%s_LAZY%s,\n", qt, p->cname, qt);
+	if (STRCT_HAS_LAZY_IN & p->flags)
+		printf("\t%sSTMT_%s_LAZY_IN%s,\n", qt, p->cname, qt);
+	pos = 0;
+	TAILQ_FOREACH(f, &p->fq, entries)
+		if (FIELD_CHILDREN & f->flags)
+			printf("\t%sSTMT_%s_CHILDREN_%zu%s,\n", 
+				qt, p->cname, pos++, qt);
+	printf("\t%sSTMT_%s_INSERT%s,\n", qt, p->cname, qt);
+	printf("\t%sSTMT_%s_INSERT_RET%s,\n", qt, p->cname, qt);
+	if (has_nested(p))
+		printf("\t%sSTMT_%s_RET%s,\n", qt, p->cname, qt);
 
 	pos = 0;
-	TAILQ_FOREACH(u, &p->uq, entries)
-		printf("\tSTMT_%s_UPDATE_%zu,\n", p->cname, pos++);
+	TAILQ_FOREACH(u, &p->uq, entries) {
+		printf("\t%sSTMT_%s_UPDATE_%zu%s,\n", 
+			qt, p->cname, pos, qt);
+		printf("\t%sSTMT_%s_UPDATE_%zu_RET%s,\n", 
+			qt, p->cname, pos, qt);
+		if (UPDATE_HAS_MANY & u->flags)
+			printf("\t%sSTMT_%s_UPDATE_%zu_MANY%s,\n", 
+				qt, p->cname, pos, qt);
+		pos++;
+	}
+	pos = 0;
+	TAILQ_FOREACH(u, &p->dq, entries) {
+		printf("\t%sSTMT_%s_DELETE_%zu%s,\n", 
+			qt, p->cname, pos, qt);
+		printf("\t%sSTMT_%s_DELETE_%zu_RET%s,\n", 
+			qt, p->cname, pos, qt);
+		if (UPDATE_HAS_MANY & u->flags)
+			printf("\t%sSTMT_%s_DELETE_%zu_MANY%s,\n", 
+				qt, p->cname, pos, qt);
+		pos++;
+	}
 	pos = 0;
-	TAILQ_FOREACH(u, &p->dq, entries)
-		printf("\tSTMT_%s_DELETE_%zu,\n", p->cname, pos++);
+	TAILQ_FOREACH(u, &p->pq, entries)
+		printf("\t%sSTMT_%s_UPSERT_%zu%s,\n", 
+			qt, p->cname, pos++, qt);
 }
 
 /*
@@ -1118,7 +4765,8 @@ gen_stmt_schema(const struct strct *orig,
 	 */
 
 	TAILQ_FOREACH(f, &p->fq, entries) {
-		if (FTYPE_STRUCT != f->type)
+		if (FTYPE_STRUCT != f->type ||
+		    FIELD_LAZY & f->flags)
 			continue;
 
 		if (NULL != pname) {
@@ -1129,54 +4777,361 @@ gen_stmt_schema(const struct strct *orig,
 		} else if (NULL == (name = strdup(f->name)))
 			err(EXIT_FAILURE, NULL);
 
-		gen_stmt_schema(orig, 
-			f->ref->target->parent, name);
-		free(name);
+		gen_stmt_schema(orig, 
+			f->ref->target->parent, name);
+		free(name);
+	}
+}
+
+/*
+ * Whether the join "a" is on the path to the join "to".
+ */
+static int
+gen_stmt_joinpath(const struct alias *a, const struct alias *to)
+{
+	size_t	 sz;
+
+	sz = strlen(a->name);
+	return(NULL != to && 
+	       0 == strncasecmp(to->name, a->name, sz) &&
+	       ('\0' == to->name[sz] || '.' == to->name[sz]));
+}
+
+/*
+ * Whether the join "a" is needed by the search and ordering terms of
+ * "s", that is, whether it's on the path to any of their aliases.
+ */
+static int
+gen_stmt_joined(const struct search *s, const struct alias *a)
+{
+	const struct sent *sent;
+	const struct ord *ord;
+
+	TAILQ_FOREACH(sent, &s->sntq, entries)
+		if (gen_stmt_joinpath(a, sent->alias))
+			return(1);
+	TAILQ_FOREACH(ord, &s->ordq, entries)
+		if (gen_stmt_joinpath(a, ord->alias))
+			return(1);
+	return(0);
+}
+
+/*
+ * Recursively generate a series of INNER JOIN statements for any
+ * structure object.
+ * If the structure object has no inner nested components, this will not
+ * do anything.
+ * If "s" is not NULL, only joins needed by its search terms are
+ * generated.
+ * Lazy fields are never joined.
+ * See gen_stmt_schema().
+ */
+static void
+gen_stmt_joins(const struct strct *orig, const struct strct *p, 
+	const struct alias *parent, const struct search *s)
+{
+	const struct field *f;
+	const struct alias *a;
+	int	 c;
+	char	*name;
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT != f->type ||
+		    FIELD_LAZY & f->flags)
+			continue;
+
+		if (NULL != parent) {
+			c = asprintf(&name, "%s.%s", 
+				parent->name, f->name);
+			if (c < 0)
+				err(EXIT_FAILURE, NULL);
+		} else if (NULL == (name = strdup(f->name)))
+			err(EXIT_FAILURE, NULL);
+
+		TAILQ_FOREACH(a, &orig->aq, entries)
+			if (0 == strcasecmp(a->name, name))
+				break;
+		assert(NULL != a);
+
+		if (NULL != s && ! gen_stmt_joined(s, a)) {
+			free(name);
+			continue;
+		}
+
+		printf(" INNER JOIN %s AS %s ON %s.%s=%s.%s",
+			f->ref->tstrct, a->alias,
+			a->alias, f->ref->tfield,
+			NULL == parent ? p->name : parent->alias,
+			f->ref->sfield);
+		gen_stmt_joins(orig, 
+			f->ref->target->parent, a, s);
+		free(name);
+	}
+}
+
+/*
+ * Print the ordering field "ord" of a statement for "p".
+ */
+static void
+gen_stmt_ord(const struct strct *p, const struct ord *ord)
+{
+	const struct sref *sr;
+
+	sr = TAILQ_LAST(&ord->srq, srefq);
+	printf("%s.%s", NULL == ord->alias ?
+		p->name : ord->alias->alias, sr->name);
+}
+
+/*
+ * Print the keyset position predicate of search "s", which continues
+ * a search after the row last seen.
+ * This is a lexicographic comparison over all ordering fields, also
+ * bounding the leading field alone so that an index may be used.
+ * See count_keyset() and gen_search_binds().
+ */
+static void
+gen_stmt_keyset(const struct strct *p, const struct search *s)
+{
+	const struct ord *ord, *oo;
+
+	ord = TAILQ_FIRST(&s->ordq);
+	if (NULL == TAILQ_NEXT(ord, entries)) {
+		putchar(' ');
+		gen_stmt_ord(p, ord);
+		printf(" %s ?", ORDTYPE_DESC == ord->op ? "<" : ">");
+		return;
+	}
+
+	putchar(' ');
+	gen_stmt_ord(p, ord);
+	printf(" %s ? AND (", ORDTYPE_DESC == ord->op ? "<=" : ">=");
+	TAILQ_FOREACH(ord, &s->ordq, entries) {
+		if (ord != TAILQ_FIRST(&s->ordq))
+			printf(" OR ");
+		putchar('(');
+		TAILQ_FOREACH(oo, &s->ordq, entries) {
+			gen_stmt_ord(p, oo);
+			if (oo == ord) {
+				printf(" %s ?", ORDTYPE_DESC == oo->op ? 
+					"<" : ">");
+				break;
+			}
+			printf(" = ? AND ");
+		}
+		putchar(')');
+	}
+	putchar(')');
+}
+
+/*
+ * Print the query for search "s" of "p".
+ * Counts, existence tests, and projections join only what their terms
+ * need, as they don't select any columns of nested structures.
+ * If "after" is non-zero, this is the statement continuing from a
+ * keyset position.
+ */
+static void
+gen_stmt_search(const struct strct *p, 
+	const struct search *s, int after)
+{
+	const struct sent *sent;
+	const struct sref *sr;
+	const struct ord *ord;
+	int	 first;
+
+	if (STYPE_COUNT == s->type) {
+		printf("\t\"SELECT COUNT(*) FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, s);
+	} else if (STYPE_EXISTS == s->type) {
+		printf("\t\"SELECT EXISTS(SELECT 1 FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, s);
+	} else if ( ! TAILQ_EMPTY(&s->fq)) {
+		printf("\t\"SELECT ");
+		TAILQ_FOREACH(sr, &s->fq, entries)
+			printf("%s%s.%s", sr == TAILQ_FIRST(&s->fq) ?
+				"" : ",", p->name, sr->name);
+		printf(" FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, s);
+	} else {
+		printf("\t\"SELECT ");
+		gen_stmt_schema(p, p, NULL);
+		printf("\" FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, NULL);
+	}
+	printf(" WHERE");
+	first = 1;
+	TAILQ_FOREACH(sent, &s->sntq, entries) {
+		sr = TAILQ_LAST(&sent->srq, srefq);
+		if (FTYPE_PASSWORD == sr->field->type)
+			continue;
+		if ( ! first)
+			printf(" AND");
+		first = 0;
+		if (OPTYPE_ISUNARY(sent->op))
+			printf(" %s.%s %s",
+				NULL == sent->alias ?
+				p->name : sent->alias->alias,
+				sr->name, optypes[sent->op]);
+		else
+			printf(" %s.%s %s ?", 
+				NULL == sent->alias ?
+				p->name : sent->alias->alias,
+				sr->name, optypes[sent->op]);
+	}
+
+	if (after) {
+		if ( ! first)
+			printf(" AND");
+		gen_stmt_keyset(p, s);
+	}
+
+	first = 1;
+	TAILQ_FOREACH(ord, &s->ordq, entries) {
+		printf("%s", first ? " ORDER BY " : ", ");
+		gen_stmt_ord(p, ord);
+		if (ORDTYPE_DESC == ord->op)
+			printf(" DESC");
+		first = 0;
+	}
+
+	/* SQLite needs a LIMIT for an OFFSET: -1 is unbounded. */
+
+	if (SEARCH_HAS_LIMIT & s->flags)
+		printf(" LIMIT ?");
+	else if (SEARCH_HAS_OFFSET & s->flags)
+		printf(" LIMIT -1");
+	if (SEARCH_HAS_OFFSET & s->flags)
+		printf(" OFFSET ?");
+	if (STYPE_EXISTS == s->type)
+		putchar(')');
+	puts("\",");
+}
+
+/*
+ * Print the columns and values of an insertion of "p", following
+ * "INSERT INTO table ".
+ * TODO: DEFAULT_VALUES.
+ */
+static void
+gen_stmt_insert(const struct strct *p)
+{
+	const struct field *f;
+	int	 first = 1;
+
+	TAILQ_FOREACH(f, &p->fq, entries) {
+		if (FTYPE_STRUCT == f->type ||
+		    FIELD_ROWID & f->flags)
+			continue;
+		if (first)
+			putchar('(');
+		printf("%s%s", first ? "" : ",", f->name);
+		first = 0;
+	}
+
+	if (0 == first) {
+		printf(") VALUES (");
+		first = 1;
+		TAILQ_FOREACH(f, &p->fq, entries) {
+			if (FTYPE_STRUCT == f->type ||
+			    FIELD_ROWID & f->flags)
+				continue;
+			printf("%s?", first ? "" : ",");
+			first = 0;
+		}
+		putchar(')');
+	} else
+		printf("DEFAULT VALUES");
+}
+
+/*
+ * Print the constraints of an update or delete, each qualified by
+ * "table" if not NULL.
+ * If "many" is non-zero, the sole equality constraint instead matches
+ * any of MANY_BATCH values.
+ */
+static void
+gen_stmt_constraints(const struct update *up, int many, 
+	const char *table)
+{
+	const struct uref *ur;
+	size_t	 i;
+	int	 first = 1;
+
+	TAILQ_FOREACH(ur, &up->crq, entries) {
+		printf("%s", first ? " " : " AND ");
+		if (NULL != table)
+			printf("%s.", table);
+		if (OPTYPE_ISUNARY(ur->op))
+			printf("%s %s", ur->name, 
+				optypes[ur->op]);
+		else if (many) {
+			assert(OPTYPE_EQUAL == ur->op);
+			printf("%s IN (", ur->name);
+			for (i = 0; i < MANY_BATCH; i++)
+				printf("%s?", i > 0 ? "," : "");
+			putchar(')');
+		} else
+			printf("%s %s ?", ur->name,
+				optypes[ur->op]);
+		first = 0;
 	}
 }
 
 /*
- * Recursively generate a series of INNER JOIN statements for any
- * structure object.
- * If the structure object has no inner nested components, this will not
- * do anything.
- * See gen_stmt_schema().
+ * Print an update or delete statement (without quotes).
+ * Our updates can have modifications where they modify the given field
+ * (instead of setting it externally).
+ * If "many" is non-zero, the sole equality constraint instead matches
+ * any of MANY_BATCH values.
+ */
+static void
+gen_stmt_update(const struct update *up, int many)
+{
+	const struct uref *ur;
+	int	 first = 1;
+
+	if (UP_MODIFY == up->type) {
+		printf("UPDATE %s SET", up->parent->name);
+		TAILQ_FOREACH(ur, &up->mrq, entries) {
+			putchar(first ? ' ' : ',');
+			first = 0;
+			if (MODTYPE_INC == ur->mod) 
+				printf("%s = %s + ?", 
+					ur->name, ur->name);
+			else if (MODTYPE_DEC == ur->mod) 
+				printf("%s = %s - ?", 
+					ur->name, ur->name);
+			else
+				printf("%s = ?", ur->name);
+		}
+		printf(" WHERE");
+	} else
+		printf("DELETE FROM %s WHERE", up->parent->name);
+	gen_stmt_constraints(up, many, NULL);
+}
+
+/*
+ * Print the RETURNING clause of the native columns of "p", in the order
+ * read by db_xxx_fill().
+ * If "p" has nested structures, this is only the row identifier: the
+ * row is then re-read by STMT_xxx_RET (see gen_func_fill_rowid()).
  */
 static void
-gen_stmt_joins(const struct strct *orig, 
-	const struct strct *p, const struct alias *parent)
+gen_stmt_returning(const struct strct *p)
 {
 	const struct field *f;
-	const struct alias *a;
-	int	 c;
-	char	*name;
+	int	 first = 1;
 
+	if (has_nested(p)) {
+		printf(" RETURNING rowid");
+		return;
+	}
+	printf(" RETURNING");
 	TAILQ_FOREACH(f, &p->fq, entries) {
-		if (FTYPE_STRUCT != f->type)
+		if (FTYPE_STRUCT == f->type)
 			continue;
-
-		if (NULL != parent) {
-			c = asprintf(&name, "%s.%s", 
-				parent->name, f->name);
-			if (c < 0)
-				err(EXIT_FAILURE, NULL);
-		} else if (NULL == (name = strdup(f->name)))
-			err(EXIT_FAILURE, NULL);
-
-		TAILQ_FOREACH(a, &orig->aq, entries)
-			if (0 == strcasecmp(a->name, name))
-				break;
-		assert(NULL != a);
-
-		printf(" INNER JOIN %s AS %s ON %s.%s=%s.%s",
-			f->ref->tstrct, a->alias,
-			a->alias, f->ref->tfield,
-			NULL == parent ? p->name : parent->alias,
-			f->ref->sfield);
-		gen_stmt_joins(orig, 
-			f->ref->target->parent, 
-			a);
-		free(name);
+		printf("%s%s", first ? " " : ",", f->name);
+		first = 0;
 	}
 }
 
@@ -1187,13 +5142,12 @@ static void
 gen_stmt(const struct strct *p)
 {
 	const struct search *s;
-	const struct sent *sent;
-	const struct sref *sr;
 	const struct field *f;
 	const struct update *up;
 	const struct uref *ur;
+	const struct strct *c;
 	int	 first;
-	size_t	 pos;
+	size_t	 pos, i;
 
 	/* 
 	 * Print custom search queries.
@@ -1202,125 +5156,176 @@ gen_stmt(const struct strct *p)
 
 	pos = 0;
 	TAILQ_FOREACH(s, &p->sq, entries) {
-		printf("\t/* STMT_%s_BY_SEARCH_%zu */\n"
-		       "\t\"SELECT ",
-			p->cname, pos++);
+		printf("\t/* STMT_%s_BY_SEARCH_%zu */\n", 
+			p->cname, pos);
+		gen_stmt_search(p, s, 0);
+		if (SEARCH_HAS_AFTER & s->flags) {
+			printf("\t/* STMT_%s_BY_SEARCH_%zu_AFTER */\n", 
+				p->cname, pos);
+			gen_stmt_search(p, s, 1);
+		}
+		pos++;
+	}
+
+	/* Lazy loading by rowid (see gen_func_lazy()). */
+
+	if (STRCT_HAS_LAZY & p->flags) {
+		printf("\t/* STMT_%s_LAZY */\n"
+		       "\t\"SELECT ", p->cname);
 		gen_stmt_schema(p, p, NULL);
 		printf("\" FROM %s", p->name);
-		gen_stmt_joins(p, p, NULL);
-		printf(" WHERE");
-		first = 1;
-		TAILQ_FOREACH(sent, &s->sntq, entries) {
-			sr = TAILQ_LAST(&sent->srq, srefq);
-			if (FTYPE_PASSWORD == sr->field->type)
-				continue;
-			if ( ! first)
-				printf(" AND");
-			first = 0;
-			if (OPTYPE_ISUNARY(sent->op))
-				printf(" %s.%s %s",
-					NULL == sent->alias ?
-					p->name : sent->alias->alias,
-					sr->name, optypes[sent->op]);
-			else
-				printf(" %s.%s %s ?", 
-					NULL == sent->alias ?
-					p->name : sent->alias->alias,
-					sr->name, optypes[sent->op]);
-		}
-		puts("\",");
+		gen_stmt_joins(p, p, NULL, NULL);
+		printf(" WHERE %s.%s = ?\",\n", 
+			p->name, p->rowid->name);
 	}
 
-	/* 
-	 * Insertion of a new record.
-	 * TODO: DEFAULT_VALUES.
-	 */
+	if (STRCT_HAS_LAZY_IN & p->flags) {
+		printf("\t/* STMT_%s_LAZY_IN */\n"
+		       "\t\"SELECT ", p->cname);
+		gen_stmt_schema(p, p, NULL);
+		printf("\" FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, NULL);
+		printf(" WHERE %s.%s IN (", p->name, p->rowid->name);
+		for (pos = 0; pos < LAZY_BATCH; pos++)
+			printf("%s?", 0 == pos ? "" : ",");
+		puts(")\",");
+	}
 
-	printf("\t/* STMT_%s_INSERT */\n"
-	       "\t\"INSERT INTO %s ", p->cname, p->name);
-	first = 1;
+	/* Children of up to LAZY_BATCH parents. */
+
+	pos = 0;
 	TAILQ_FOREACH(f, &p->fq, entries) {
-		if (FTYPE_STRUCT == f->type ||
-		    FIELD_ROWID & f->flags)
+		if ( ! (FIELD_CHILDREN & f->flags))
 			continue;
-		if (first)
-			putchar('(');
-		printf("%s%s", first ? "" : ",", f->name);
-		first = 0;
+		c = f->ref->target->parent;
+		printf("\t/* STMT_%s_CHILDREN_%zu */\n"
+		       "\t\"SELECT ", p->cname, pos++);
+		gen_stmt_schema(c, c, NULL);
+		printf("\" FROM %s", c->name);
+		gen_stmt_joins(c, c, NULL, NULL);
+		printf(" WHERE %s.%s IN (", c->name, f->ref->tfield);
+		for (i = 0; i < LAZY_BATCH; i++)
+			printf("%s?", 0 == i ? "" : ",");
+		putchar(')');
+		if (NULL != c->rowid)
+			printf(" ORDER BY %s.%s", 
+				c->name, c->rowid->name);
+		puts("\",");
 	}
 
-	if (0 == first) {
-		printf(") VALUES (");
-		first = 1;
-		TAILQ_FOREACH(f, &p->fq, entries) {
-			if (FTYPE_STRUCT == f->type ||
-			    FIELD_ROWID & f->flags)
-				continue;
-			printf("%s?", first ? "" : ",");
-			first = 0;
-		}
-		puts(")\",");
-	} else
-		puts("DEFAULT VALUES\",");
+	/* Insertion of a new record. */
+
+	printf("\t/* STMT_%s_INSERT */\n"
+	       "\t\"INSERT INTO %s ", p->cname, p->name);
+	gen_stmt_insert(p);
+	puts("\",");
 	
+	printf("\t/* STMT_%s_INSERT_RET */\n"
+	       "\t\"INSERT INTO %s ", p->cname, p->name);
+	gen_stmt_insert(p);
+	gen_stmt_returning(p);
+	puts("\",");
+
+	if (has_nested(p)) {
+		printf("\t/* STMT_%s_RET */\n"
+		       "\t\"SELECT ", p->cname);
+		gen_stmt_schema(p, p, NULL);
+		printf("\" FROM %s", p->name);
+		gen_stmt_joins(p, p, NULL, NULL);
+		printf(" WHERE %s.rowid = ?\",\n", p->name);
+	}
+
 	/* 
-	 * Custom update queries. 
-	 * Our updates can have modifications where they modify the
-	 * given field (instead of setting it externally).
+	 * Custom update and delete queries, each followed by its
+	 * variant returning the modified rows and, if applicable, its
+	 * set-based variant.
+	 * Deletes of structures with nested structures instead select
+	 * the first row to be deleted, with its joins.
 	 */
 
 	pos = 0;
 	TAILQ_FOREACH(up, &p->uq, entries) {
-		printf("\t/* STMT_%s_UPDATE_%zu */\n"
-		       "\t\"UPDATE %s SET",
-		       p->cname, pos++, p->name);
-		first = 1;
-		TAILQ_FOREACH(ur, &up->mrq, entries) {
-			putchar(first ? ' ' : ',');
-			first = 0;
-			if (MODTYPE_INC == ur->mod) 
-				printf("%s = %s + ?", 
-					ur->name, ur->name);
-			else if (MODTYPE_DEC == ur->mod) 
-				printf("%s = %s - ?", 
-					ur->name, ur->name);
-			else
-				printf("%s = ?", ur->name);
+		printf("\t/* STMT_%s_UPDATE_%zu */\n\t\"", 
+			p->cname, pos);
+		gen_stmt_update(up, 0);
+		puts("\",");
+		printf("\t/* STMT_%s_UPDATE_%zu_RET */\n\t\"", 
+			p->cname, pos);
+		gen_stmt_update(up, 0);
+		gen_stmt_returning(p);
+		puts("\",");
+		if (UPDATE_HAS_MANY & up->flags) {
+			printf("\t/* STMT_%s_UPDATE_%zu_MANY */\n\t\"", 
+				p->cname, pos);
+			gen_stmt_update(up, 1);
+			puts("\",");
 		}
-		printf(" WHERE");
-		first = 1;
-		TAILQ_FOREACH(ur, &up->crq, entries) {
-			printf("%s", first ? " " : " AND ");
-			if (OPTYPE_ISUNARY(ur->op))
-				printf("%s %s", ur->name, 
-					optypes[ur->op]);
-			else
-				printf("%s %s ?", ur->name,
-					optypes[ur->op]);
-			first = 0;
+		pos++;
+	}
+
+	pos = 0;
+	TAILQ_FOREACH(up, &p->dq, entries) {
+		printf("\t/* STMT_%s_DELETE_%zu */\n\t\"", 
+			p->cname, pos);
+		gen_stmt_update(up, 0);
+		puts("\",");
+		printf("\t/* STMT_%s_DELETE_%zu_RET */\n\t\"", 
+			p->cname, pos);
+		if (has_nested(p)) {
+			printf("SELECT ");
+			gen_stmt_schema(p, p, NULL);
+			printf("\" FROM %s", p->name);
+			gen_stmt_joins(p, p, NULL, NULL);
+			printf(" WHERE");
+			gen_stmt_constraints(up, 0, p->name);
+			printf(" LIMIT 1");
+		} else {
+			gen_stmt_update(up, 0);
+			gen_stmt_returning(p);
 		}
 		puts("\",");
+		if (UPDATE_HAS_MANY & up->flags) {
+			printf("\t/* STMT_%s_DELETE_%zu_MANY */\n\t\"", 
+				p->cname, pos);
+			gen_stmt_update(up, 1);
+			puts("\",");
+		}
+		pos++;
 	}
 
-	/* Custom delete queries. */
+	/* 
+	 * Upserts are inserts that update the given fields of the
+	 * conflicting row instead.
+	 * These need the row identifier, as it isn't set by updates.
+	 */
 
 	pos = 0;
-	TAILQ_FOREACH(up, &p->dq, entries) {
-		printf("\t/* STMT_%s_DELETE_%zu */\n"
-		       "\t\"DELETE FROM %s WHERE",
-		       p->cname, pos++, p->name);
+	TAILQ_FOREACH(up, &p->pq, entries) {
+		printf("\t/* STMT_%s_UPSERT_%zu */\n"
+		       "\t\"INSERT INTO %s ", p->cname, pos++, p->name);
+		gen_stmt_insert(p);
+		printf(" ON CONFLICT (");
 		first = 1;
 		TAILQ_FOREACH(ur, &up->crq, entries) {
-			printf("%s", first ? " " : " AND ");
-			if (OPTYPE_ISUNARY(ur->op))
-				printf("%s %s", ur->name, 
-					optypes[ur->op]);
-			else
-				printf("%s %s ?", ur->name,
-					optypes[ur->op]);
+			printf("%s%s", first ? "" : ",", ur->name);
 			first = 0;
 		}
-		puts("\",");
+		printf(") DO UPDATE SET");
+		first = 1;
+		TAILQ_FOREACH(ur, &up->mrq, entries) {
+			putchar(first ? ' ' : ',');
+			first = 0;
+			if (MODTYPE_INC == ur->mod) 
+				printf("%s = %s + excluded.%s", 
+					ur->name, ur->name, ur->name);
+			else if (MODTYPE_DEC == ur->mod) 
+				printf("%s = %s - excluded.%s", 
+					ur->name, ur->name, ur->name);
+			else
+				printf("%s = excluded.%s", 
+					ur->name, ur->name);
+		}
+		puts(" RETURNING rowid\",");
 	}
 }
 
@@ -1342,18 +5347,60 @@ gen_valid_struct(const struct strct *p)
 	}
 }
 
+/*
+ * Generate the cursor structure for "p", if it has any iterators.
+ * The row "p" is filled in-place from "stmt", which is "id" in the
+ * statement cache of "ctx".
+ */
+static void
+gen_cursor_struct(const struct strct *p)
+{
+	size_t	 npass;
+
+	if ( ! (STRCT_HAS_ITERATOR & p->flags))
+		return;
+
+	print_commentv(0, COMMENT_C,
+		"A cursor over an iterate search of %s.\n"
+		"The statement is stepped by db_%s_cursor_next().",
+		p->name, p->name);
+	printf("struct\t%s_cursor {\n"
+	       "\tstruct kwbp *ctx;\n"
+	       "\tstruct ksqlstmt *stmt;\n"
+	       "\tenum stmt id;\n"
+	       "\tint done;\n"
+	       "\tstruct timespec deadline_at;\n"
+	       "\tstruct %s p;\n", p->name, p->name);
+	if ((npass = count_cursor_passwords(p)) > 0)
+		printf("\tchar *pass[%zu];\n", npass);
+	puts("};\n"
+	     "");
+}
+
 /*
  * Generate the C source file from "q" structure objects.
  * If "json" is non-zero, this generates the JSON formatters.
  * If "valids" is non-zero, this generates the field validators.
+ * If "arena" is non-zero, results may be allocated from an arena.
+ * If "pool" is non-zero, this generates the connection pool.
+ * If "metrics" is non-zero, this generates per-statement metrics.
  * The "header" is what's noted as an inclusion.
  * (Your header file, see gen_c_header, should have the same name.)
  */
 void
-gen_c_source(const struct strctq *q, 
-	int json, int valids, const char *header)
+gen_c_source(const struct config *cfg, 
+	int json, int valids, int arena, int pool, int metrics, 
+	const char *header)
 {
-	const struct strct *p;
+	const struct strctq *q = &cfg->sq;
+	const struct strct *p, *cache;
+	const struct field *f;
+	const struct update *u;
+	size_t	 pos;
+
+	TAILQ_FOREACH(cache, q, entries)
+		if (STRCT_HAS_CACHE & cache->flags)
+			break;
 
 	print_commentt(0, COMMENT_C, 
 		"WARNING: automatically generated by "
@@ -1363,6 +5410,9 @@ gen_c_source(const struct strctq *q,
 	/* Start with all headers we'll need. */
 
 	puts("#include <sys/queue.h>");
+	if (NULL != cache || metrics)
+		puts("#include <sys/mman.h>\n"
+		     "#include <sys/stat.h>");
 
 	TAILQ_FOREACH(p, q, entries) 
 		if (STRCT_HAS_BLOB & p->flags) {
@@ -1374,16 +5424,25 @@ gen_c_source(const struct strctq *q,
 		}
 
 	puts("");
-	if (valids) {
+	if (pool || NULL != cache)
+		puts("#include <errno.h>");
+	if (NULL != cache || metrics)
+		puts("#include <fcntl.h>");
+	if (pool)
+		puts("#include <pthread.h>");
+	if (NULL != cache)
+		puts("#include <signal.h>");
+	if (valids)
 		puts("#include <stdarg.h>");
-		puts("#include <stdint.h>");
-	}
+	puts("#include <stdint.h>");
 	puts("#include <stdio.h>\n"
 	     "#include <stdlib.h>\n"
 	     "#include <string.h>\n"
+	     "#include <time.h>\n"
 	     "#include <unistd.h>\n"
 	     "\n"
-	     "#include <ksql.h>");
+	     "#include <ksql.h>\n"
+	     "#include <sqlite3.h>");
 	if (valids)
 		puts("#include <kcgi.h>");
 	if (json)
@@ -1401,7 +5460,11 @@ gen_c_source(const struct strctq *q,
 		"All SQL statements we'll define in \"stmts\".");
 	puts("enum\tstmt {");
 	TAILQ_FOREACH(p, q, entries)
-		gen_enum(p);
+		gen_enum(p, 0);
+	if (NULL != cache)
+		puts("\tSTMT_DATA_VERSION,");
+	if (has_changes(q))
+		puts("\tSTMT_CHANGES,");
 	puts("\tSTMT__MAX\n"
 	     "};\n"
 	     "");
@@ -1417,9 +5480,369 @@ gen_c_source(const struct strctq *q,
 	puts("static\tconst char *const stmts[STMT__MAX] = {");
 	TAILQ_FOREACH(p, q, entries)
 		gen_stmt(p);
+	if (NULL != cache)
+		puts("\t/* STMT_DATA_VERSION */\n"
+		     "\t\"PRAGMA data_version\",");
+	if (has_changes(q))
+		puts("\t/* STMT_CHANGES */\n"
+		     "\t\"SELECT changes()\",");
 	puts("};");
 	puts("");
 
+	if (metrics) {
+		print_commentt(0, COMMENT_C,
+			"Names of the statements in the per-statement "
+			"metrics.");
+		puts("static\tconst char *const stmtnames[STMT__MAX] = {");
+		TAILQ_FOREACH(p, q, entries)
+			gen_enum(p, 1);
+		if (NULL != cache)
+			puts("\t\"STMT_DATA_VERSION\",");
+		if (has_changes(q))
+			puts("\t\"STMT_CHANGES\",");
+		puts("};\n"
+		     "");
+	}
+
+	/* The database handle and its statement cache. */
+
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			break;
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Number of hashtable buckets (by rowid) for "
+			"structures loaded by db_xxxx_load_yyyy().");
+		puts("#define\tLAZY_BUCKETS 64\n");
+	}
+	TAILQ_FOREACH(p, q, entries) {
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FIELD_CHILDREN & f->flags)
+				break;
+		if (NULL != f || STRCT_HAS_LAZY_IN & p->flags)
+			break;
+	}
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Number of rowids loaded at once by "
+			"db_xxxx_load_yyyy_q() and _array().");
+		printf("#define\tLAZY_BATCH %d\n"
+		       "\n", LAZY_BATCH);
+	}
+	TAILQ_FOREACH(p, q, entries) {
+		TAILQ_FOREACH(u, &p->uq, entries)
+			if (UPDATE_HAS_MANY & u->flags)
+				break;
+		if (NULL == u)
+			TAILQ_FOREACH(u, &p->dq, entries)
+				if (UPDATE_HAS_MANY & u->flags)
+					break;
+		if (NULL != u)
+			break;
+	}
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Number of values bound at once by "
+			"db_xxxx_update_yyyy_many() and "
+			"db_xxxx_delete_yyyy_many().");
+		printf("#define\tMANY_BATCH %d\n"
+		       "\n", MANY_BATCH);
+	}
+	TAILQ_FOREACH(p, q, entries) {
+		if ( ! (STRCT_HAS_LAZY & p->flags))
+			continue;
+		print_commentv(0, COMMENT_C,
+			"A %s loaded on demand, chained in its bucket.", 
+			p->name);
+		printf("struct\t%s_lazy {\n"
+		       "\tstruct %s obj;\n"
+		       "\tstruct %s_lazy *next;\n"
+		       "};\n"
+		       "\n", p->name, p->name, p->name);
+	}
+
+	/* Tables de-duplicating shared structures in results. */
+
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_SHARED & p->flags)
+			break;
+	if (NULL != p) {
+		print_commentt(0, COMMENT_C,
+			"Number of hashtable buckets (by rowid) for "
+			"de-duplicating shared structures.");
+		puts("#define\tSHARED_BUCKETS 64\n");
+		TAILQ_FOREACH(p, q, entries) {
+			if ( ! (STRCT_HAS_SHARED & p->flags))
+				continue;
+			print_commentv(0, COMMENT_C,
+				"A %s shared by \"refs\" results, "
+				"chained in its bucket.", p->name);
+			printf("struct\t%s_shared {\n"
+			       "\tstruct %s obj;\n"
+			       "\tsize_t refs;\n"
+			       "\tstruct %s_shared *next;\n"
+			       "};\n"
+			       "\n", p->name, p->name, p->name);
+		}
+		print_commentt(0, COMMENT_C,
+			"Shared structures filled while stepping over "
+			"a single result set.");
+		puts("struct\tkwbp_dedup {");
+		TAILQ_FOREACH(p, q, entries)
+			if (STRCT_HAS_SHARED & p->flags)
+				printf("\tstruct %s_shared "
+				       "*%s[SHARED_BUCKETS];\n",
+				       p->name, p->name);
+		puts("};\n"
+		     "");
+		if (has_dedup(q))
+			puts("static void db_dedup_free"
+			     "(struct kwbp_dedup *);\n"
+			     "");
+	}
+
+	/* Row caches of cached searches. */
+
+	if (NULL != cache) {
+		print_commentt(0, COMMENT_C,
+			"Maximum number of rows kept in the row cache "
+			"of each structure with cached searches.");
+		puts("#ifndef CACHE_SIZE\n"
+		     "#define\tCACHE_SIZE 64\n"
+		     "#endif\n");
+		print_commentt(0, COMMENT_C,
+			"Number of slots (and bytes per slot) in "
+			"the shared-memory row cache\n"
+			"of each structure with cached searches.\n"
+			"Rows (with their keys) not fitting in a slot "
+			"aren't shared.");
+		puts("#ifndef SHM_SLOTS\n"
+		     "#define\tSHM_SLOTS 1024\n"
+		     "#endif\n"
+		     "#ifndef SHM_SLOT_SIZE\n"
+		     "#define\tSHM_SLOT_SIZE 512\n"
+		     "#endif\n");
+		print_commentt(0, COMMENT_C,
+			"Identify shared-memory row cache files and "
+			"the layout of the rows\n"
+			"packed into them: files of other layouts "
+			"can't be attached.");
+		printf("#define\tSHM_MAGIC 0x6b77627073686d31ULL\n"
+		       "#define\tSHM_LAYOUT 0x%016" PRIx64 "ULL\n"
+		       "\n", shm_layout(q));
+		print_commentt(0, COMMENT_C,
+			"Starts the shared-memory row cache file, "
+			"followed by the regions.");
+		puts("struct\tkwbp_shm_header {\n"
+		     "\tvolatile uint64_t magic;\n"
+		     "\tvolatile uint64_t layout;\n"
+		     "};\n"
+		     "");
+		print_commentt(0, COMMENT_C,
+			"A shared-memory slot holding a packed key "
+			"and row.\n"
+			"It's being written by \"pid\" while \"seq\" "
+			"is odd.");
+		puts("struct\tkwbp_shm_slot {\n"
+		     "\tvolatile uint64_t seq;\n"
+		     "\tpid_t pid;\n"
+		     "\tuint64_t gen;\n"
+		     "\tsize_t ksz;\n"
+		     "\tsize_t sz;\n"
+		     "\tchar data[SHM_SLOT_SIZE];\n"
+		     "};\n"
+		     "");
+		print_commentt(0, COMMENT_C,
+			"The shared-memory row cache of a structure.\n"
+			"Its generation is bumped whenever the "
+			"structure (or one it joins) is modified.");
+		puts("struct\tkwbp_shm_region {\n"
+		     "\tvolatile uint64_t gen;\n"
+		     "\tstruct kwbp_shm_slot slots[SHM_SLOTS];\n"
+		     "};\n"
+		     "");
+	}
+	TAILQ_FOREACH(p, q, entries) {
+		if ( ! (STRCT_HAS_CACHE & p->flags))
+			continue;
+		print_commentv(0, COMMENT_C,
+			"A cached %s, most recently used first.",
+			p->name);
+		printf("struct\t%s_cache {\n"
+		       "\tstruct %s obj;\n"
+		       "\tTAILQ_ENTRY(%s_cache) entries;\n"
+		       "};\n"
+		       "\n"
+		       "TAILQ_HEAD(%s_cacheq, %s_cache);\n"
+		       "\n", p->name, p->name, p->name, 
+		       p->name, p->name);
+	}
+
+	print_commentt(0, COMMENT_C,
+		"Bounds (in microseconds) of the randomised, "
+		"exponentially-increasing\n"
+		"waits for a locked database, and how long (in "
+		"milliseconds) to wait in\n"
+		"all unless set in the configuration or by "
+		"db_busy_timeout().");
+	puts("#ifndef BUSY_BACKOFF_MIN\n"
+	     "#define\tBUSY_BACKOFF_MIN 1000\n"
+	     "#endif\n"
+	     "#ifndef BUSY_BACKOFF_MAX\n"
+	     "#define\tBUSY_BACKOFF_MAX 100000\n"
+	     "#endif\n"
+	     "#ifndef BUSY_TIMEOUT\n"
+	     "#define\tBUSY_TIMEOUT 5000\n"
+	     "#endif\n");
+	print_commentt(0, COMMENT_C,
+		"How many virtual machine instructions a search runs "
+		"between checks of\n"
+		"its deadline (see db_deadline()).");
+	puts("#ifndef DEADLINE_STEPS\n"
+	     "#define\tDEADLINE_STEPS 1000\n"
+	     "#endif\n");
+	print_commentt(0, COMMENT_C,
+		"The sqlite3(3) connection of a ksql(3) handle, "
+		"which ksql(3) doesn't\n"
+		"expose: define this to an accessor, if one is "
+		"available, when compiling.\n"
+		"Without it, busy waits use SQLite's own busy "
+		"timeout (and aren't counted),\n"
+		"deadlines aren't enforced, and metrics don't "
+		"count rows and bytes.");
+	puts("#ifndef DB_SQLITE\n"
+	     "#define\tDB_SQLITE(_db) NULL\n"
+	     "#endif\n");
+
+	if (metrics) {
+		print_commentt(0, COMMENT_C,
+			"Likewise, the sqlite3(3) statement of a ksql(3) "
+			"statement, taken when\n"
+			"it's prepared.\n"
+			"Without it, metrics don't include query plans.");
+		puts("#ifndef DB_SQLITE_STMT\n"
+		     "#define\tDB_SQLITE_STMT(_stmt) NULL\n"
+		     "#endif\n");
+		gen_metrics_structs();
+		print_commentt(0, COMMENT_C,
+			"A statement being run, from db_stmt_get() "
+			"until db_stmt_put(),\n"
+			"whose rows and bytes are counted as they're "
+			"stepped.");
+		puts("struct\tkwbp_metrics_run {\n"
+		     "\tsqlite3_stmt *stmt;\n"
+		     "\tenum stmt id;\n"
+		     "\tstruct timespec start;\n"
+		     "\tuint64_t rows;\n"
+		     "\tuint64_t bytes;\n"
+		     "};\n"
+		     "");
+	}
+
+	print_commentt(0, COMMENT_C,
+		"A database handle as returned by db_open().\n"
+		"Each statement in \"stmts\" is prepared once, on first "
+		"use, then reset and re-used by subsequent calls.");
+	puts("struct\tkwbp {\n"
+	     "\tstruct ksql *db;\n"
+	     "\tstruct ksqlstmt *cache[STMT__MAX];\n"
+	     "\tint busy[STMT__MAX];\n"
+	     "\tsize_t trans;\n"
+	     "\tint trans_dirty;\n"
+	     "\tsqlite3 *sqlite;\n"
+	     "\tint64_t busy_timeout;\n"
+	     "\tstruct timespec busy_start;\n"
+	     "\tunsigned short busy_seed[3];\n"
+	     "\tstruct kwbp_busystats busystats;\n"
+	     "\tsize_t write_depth;\n"
+	     "\tint busy_expired;\n"
+	     "\tint64_t deadline;\n"
+	     "\tstruct timespec deadline_at;\n"
+	     "\tsize_t deadline_depth;\n"
+	     "\tint expired;\n"
+	     "\tint closing;");
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_LAZY & p->flags)
+			printf("\tstruct %s_lazy *lazy_%s[LAZY_BUCKETS];\n",
+				p->name, p->name);
+	TAILQ_FOREACH(p, q, entries)
+		if (STRCT_HAS_CACHE & p->flags)
+			printf("\tstruct %s_cacheq lru_%s;\n"
+			       "\tsize_t lru_%s_sz;\n"
+			       "\tint64_t lru_%s_version;\n"
+			       "\tstruct kwbp_shm_region *shm_%s;\n",
+			       p->name, p->name, p->name, p->name,
+			       p->name);
+	if (NULL != cache)
+		puts("\tvoid *shm;\n"
+		     "\tsize_t shm_sz;");
+	if (metrics)
+		puts("\tsqlite3_stmt *sqlstmt[STMT__MAX];\n"
+		     "\tstruct kwbp_metrics *metrics;\n"
+		     "\tsize_t metrics_sz;\n"
+		     "\tstruct kwbp_metrics_run *runs;\n"
+		     "\tsize_t runsz;\n"
+		     "\tsize_t runmax;");
+	puts("};\n"
+	     "");
+
+	/* Cursors over iterators. */
+
+	TAILQ_FOREACH(p, q, entries)
+		gen_cursor_struct(p);
+
+	/* The arena and its chunks. */
+
+	if (arena) {
+		print_commentt(0, COMMENT_C,
+			"A chunk of arena memory.\n"
+			"Allocations are carved from the \"sz\" bytes "
+			"following the (aligned) chunk header.");
+		puts("struct\tkwbp_arena_chunk {\n"
+		     "\tstruct kwbp_arena_chunk *next;\n"
+		     "\tsize_t sz;\n"
+		     "\tsize_t used;\n"
+		     "};\n"
+		     "");
+		print_commentt(0, COMMENT_C,
+			"A memory arena as returned by "
+			"db_arena_alloc().\n"
+			"Chunks are kept in order and \"cur\" is the "
+			"one being allocated from.");
+		puts("struct\tkwbp_arena {\n"
+		     "\tstruct kwbp_arena_chunk *first;\n"
+		     "\tstruct kwbp_arena_chunk *last;\n"
+		     "\tstruct kwbp_arena_chunk *cur;\n"
+		     "};\n"
+		     "");
+		puts("#define\tARENA_CHUNK 16384\n"
+		     "#define\tARENA_ALIGN(_sz) "
+		     "(((_sz) + 15) & ~(size_t)15)\n"
+		     "");
+	}
+
+	/* The connection pool. */
+
+	if (pool) {
+		print_commentt(0, COMMENT_C,
+			"A connection pool as returned by "
+			"db_pool_open().\n"
+			"The first \"nfree\" of the \"nreaders\" "
+			"readers are checked in, and \"writing\"\n"
+			"is set while the writer is checked out.\n"
+			"Threads wait on \"cond\" for either.");
+		puts("struct\tkwbp_pool {\n"
+		     "\tpthread_mutex_t mutex;\n"
+		     "\tpthread_cond_t cond;\n"
+		     "\tstruct kwbp *writer;\n"
+		     "\tint writing;\n"
+		     "\tstruct kwbp **readers;\n"
+		     "\tsize_t nreaders;\n"
+		     "\tsize_t nfree;\n"
+		     "};\n"
+		     "");
+	}
+
 	/*
 	 * Validation array.
 	 * This is declared in the header file, but we define it now.
@@ -1440,9 +5863,42 @@ gen_c_source(const struct strctq *q,
 		"Finally, all of the functions we'll use.");
 	puts("");
 
-	gen_func_open();
-	gen_func_close();
+	if (metrics)
+		gen_func_metrics();
+	gen_func_stmt_cache(metrics);
+	gen_func_busy();
+	gen_func_deadline();
+	gen_func_open(cfg);
+	if (NULL != cache) {
+		gen_func_data_version();
+		gen_func_shm(q);
+	}
+	if (has_changes(q))
+		gen_func_changes();
+	TAILQ_FOREACH(p, q, entries)
+		if (has_nested(p))
+			break;
+	if (NULL != p)
+		gen_func_ret_release();
+	if (arena)
+		gen_func_arena();
 
 	TAILQ_FOREACH(p, q, entries)
-		gen_funcs(p, json, valids);
+		gen_funcs(q, p, json, valids, arena);
+	gen_func_dedup(q);
+
+	/* Children follow their structures' fill functions. */
+
+	TAILQ_FOREACH(p, q, entries) {
+		pos = 0;
+		TAILQ_FOREACH(f, &p->fq, entries)
+			if (FIELD_CHILDREN & f->flags)
+				gen_func_children(f, pos++, arena);
+	}
+
+	gen_func_unload(q);
+	gen_func_close(q, metrics);
+	gen_func_trans(q);
+	if (pool)
+		gen_func_pool(q, metrics);
 }
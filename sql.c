@@ -141,6 +141,20 @@ gen_field(const struct field *f, int *first, int comments)
 	*first = 0;
 }
 
+/*
+ * Generate an index on a table.
+ */
+static void
+gen_index(const struct sindex *ix)
+{
+
+	printf("CREATE INDEX %s ON %s(%s)", 
+		ix->name, ix->parent->name, ix->cols);
+	if (NULL != ix->where)
+		printf(" WHERE %s", ix->where);
+	puts(";");
+}
+
 /*
  * Generate a table and all of its components.
  */
@@ -149,6 +163,7 @@ gen_struct(const struct strct *p, int comments)
 {
 	const struct field *f;
 	const struct unique *n;
+	const struct sindex *ix;
 	int	 first = 1;
 
 	if (comments)
@@ -161,19 +176,34 @@ gen_struct(const struct strct *p, int comments)
 		gen_fkeys(f, &first);
 	TAILQ_FOREACH(n, &p->nq, entries)
 		gen_unique(n, &first);
-	puts("\n);\n"
-	     "");
+	puts("\n);");
+	TAILQ_FOREACH(ix, &p->ixq, entries)
+		gen_index(ix);
+	puts("");
 }
 
+/*
+ * Generate the schema.
+ * This starts with those database settings stored in the database
+ * itself: the page size, which must precede creating any tables, and
+ * write-ahead logging.
+ * The others only last for a connection, so they're set by db_open().
+ */
 void
-gen_sql(const struct strctq *q)
+gen_sql(const struct config *cfg)
 {
 	const struct strct *p;
 
-	puts("PRAGMA foreign_keys=ON;\n"
-	     "");
+	puts("PRAGMA foreign_keys=ON;");
+	if (NULL != cfg->pragmas[PRAGMA_PAGESIZE])
+		printf("PRAGMA page_size=%s;\n", 
+			cfg->pragmas[PRAGMA_PAGESIZE]);
+	if (NULL != cfg->pragmas[PRAGMA_JOURNAL] &&
+	    0 == strcmp(cfg->pragmas[PRAGMA_JOURNAL], "wal"))
+		puts("PRAGMA journal_mode=WAL;");
+	puts("");
 
-	TAILQ_FOREACH(p, q, entries)
+	TAILQ_FOREACH(p, &cfg->sq, entries)
 		gen_struct(p, 1);
 }
 
@@ -344,6 +374,42 @@ gen_diff_uniques_old(const struct strct *s, const struct strct *ds)
 	return(0 == errs);
 }
 
+/*
+ * Create indexes in the new structure that aren't in the old, and drop
+ * those in the old that aren't in the new.
+ * As index names are derived from their columns, changed indexes are
+ * dropped and re-created.
+ * Returns the number of statements.
+ */
+static size_t
+gen_diff_indexes(const struct strct *s, const struct strct *ds)
+{
+	const struct sindex *ix, *dix;
+	size_t	 count = 0;
+
+	TAILQ_FOREACH(dix, &ds->ixq, entries) {
+		TAILQ_FOREACH(ix, &s->ixq, entries)
+			if (0 == strcasecmp(ix->name, dix->name))
+				break;
+		if (NULL != ix)
+			continue;
+		printf("DROP INDEX %s;\n", dix->name);
+		count++;
+	}
+
+	TAILQ_FOREACH(ix, &s->ixq, entries) {
+		TAILQ_FOREACH(dix, &ds->ixq, entries)
+			if (0 == strcasecmp(ix->name, dix->name))
+				break;
+		if (NULL != dix)
+			continue;
+		gen_index(ix);
+		count++;
+	}
+
+	return(count);
+}
+
 /*
  * Compare the enumeration objects in both files.
  * This does the usual check of new <-> old, then old -> new.
@@ -466,6 +532,19 @@ gen_diff(const struct config *cfg, const struct config *dcfg)
 			puts("");
 	}
 
+	/* 
+	 * Indexes are derived, so unlike with tables and columns, we
+	 * can freely drop and create them.
+	 */
+
+	TAILQ_FOREACH(s, &cfg->sq, entries) {
+		TAILQ_FOREACH(ds, &dcfg->sq, entries)
+			if (0 == strcasecmp(s->name, ds->name))
+				break;
+		if (NULL != ds && gen_diff_indexes(s, ds))
+			puts("");
+	}
+
 	/*
 	 * Now reverse and see if we should drop tables.
 	 * Don't do this---just tell the user and return an error.
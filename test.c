@@ -21,6 +21,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ksql.h>
 #include <kcgi.h>
@@ -28,10 +29,328 @@
 
 #include "db.h"
 
+/*
+ * Page through the users of company "cid" two at a time, each page
+ * following the last user of the one before.
+ * First add users in bulk, making sure that a failed batch leaves no
+ * identifiers behind.
+ */
+static void
+test_page(struct kwbp *sql, int64_t cid)
+{
+	struct user	 v[4], last, *u;
+	struct user_q	*q;
+	const char	*names[4] = { "carol", "alice", "dave", "bob" };
+	const char	*emails[4] = { "c@foo.com", "a@foo.com", 
+				       "d@foo.com", "b@foo.com" };
+	const char	*pass[4] = { "pc", "pa", "pd", "pb" };
+	int64_t		 ids[4];
+	size_t		 i, seen = 0, pages = 0;
+
+	memset(v, 0, sizeof(v));
+	for (i = 0; i < 4; i++) {
+		v[i].cid = cid;
+		v[i].email = (char *)emails[i];
+		v[i].name = (char *)names[i];
+	}
+	if ( ! db_user_insert_many(sql, v, 4, pass, ids))
+		errx(EXIT_FAILURE, "db_user_insert_many");
+	for (i = 0; i < 4; i++)
+		if (ids[i] <= 0)
+			errx(EXIT_FAILURE, "db_user_insert_many (ids)");
+
+	/* E-mails are unique, so none of these are inserted. */
+
+	v[0].email = "e@foo.com";
+	if (db_user_insert_many(sql, v, 4, pass, ids))
+		errx(EXIT_FAILURE, "db_user_insert_many (duplicate)");
+	for (i = 0; i < 4; i++)
+		if (-1 != ids[i])
+			errx(EXIT_FAILURE, "db_user_insert_many (reset)");
+
+	memset(&last, 0, sizeof(struct user));
+	q = db_user_list_page(sql, cid, 2, NULL);
+	while ( ! TAILQ_EMPTY(q)) {
+		pages++;
+		TAILQ_FOREACH(u, q, _entries) {
+			if (seen > 0 && 
+			    strcmp(u->name, last.name) <= 0)
+				errx(EXIT_FAILURE, "db_user_list_page "
+					"(order)");
+			free(last.name);
+			last.name = strdup(u->name);
+			last.uid = u->uid;
+			seen++;
+		}
+		db_user_freeq(q);
+		q = db_user_list_page(sql, cid, 2, &last);
+	}
+	db_user_freeq(q);
+	free(last.name);
+
+	/* Our four and the initial user. */
+
+	if (5 != seen || 3 != pages)
+		errx(EXIT_FAILURE, "db_user_list_page (pages)");
+}
+
+/*
+ * Insert a user by e-mail, then rename the same user.
+ */
+static void
+test_upsert(struct kwbp *sql, int64_t cid)
+{
+	struct user	*u;
+	int64_t		 id, id2;
+
+	id = db_user_upsert_name_by_email(sql, cid,
+		"password", "up@foo.com", 0, NULL, "first");
+	if (id <= 0)
+		errx(EXIT_FAILURE, "db_user_upsert_name_by_email");
+	id2 = db_user_upsert_name_by_email(sql, cid,
+		"password", "up@foo.com", 0, NULL, "second");
+	if (id2 != id)
+		errx(EXIT_FAILURE, "db_user_upsert_name_by_email (update)");
+
+	/* This also checks that the write invalidated the cache. */
+
+	if (NULL == (u = db_user_get_by_uid_eq(sql, id)) ||
+	    strcmp(u->name, "second"))
+		errx(EXIT_FAILURE, "db_user_get_by_uid_eq (upsert)");
+	db_user_free(u);
+}
+
+/*
+ * Insert sessions in bulk, then delete them by their identifiers.
+ * Also set one password for several users at once.
+ */
+static void
+test_many(struct kwbp *sql, int64_t uid)
+{
+	struct session	 v[3];
+	struct user	*u;
+	int64_t		 ids[4], uids[2];
+	size_t		 i;
+
+	memset(v, 0, sizeof(v));
+	for (i = 0; i < 3; i++) {
+		v[i].userid = uid;
+		v[i].token = i;
+	}
+	if ( ! db_session_insert_many(sql, v, 3, ids))
+		errx(EXIT_FAILURE, "db_session_insert_many");
+
+	/* The last doesn't exist, so isn't counted. */
+
+	ids[3] = ids[2] + 100;
+	if (3 != db_session_delete_by_id_eq_many(sql, ids, 4))
+		errx(EXIT_FAILURE, "db_session_delete_by_id_eq_many");
+	if (0 != db_session_delete_by_id_eq_many(sql, ids, 4))
+		errx(EXIT_FAILURE, "db_session_delete_by_id_eq_many "
+			"(deleted)");
+	if (0 != db_session_delete_by_id_eq_many(sql, ids, 0))
+		errx(EXIT_FAILURE, "db_session_delete_by_id_eq_many "
+			"(empty)");
+
+	uids[0] = uids[1] = uid;
+	if (1 != db_user_update_hash_by_uid_eq_many
+	    (sql, "password3", uids, 2))
+		errx(EXIT_FAILURE, "db_user_update_hash_by_uid_eq_many");
+	if (NULL == (u = db_user_get_creds
+	    (sql, "foo@foo.com", "password3")))
+		errx(EXIT_FAILURE, "db_user_get_creds (many)");
+	db_user_free(u);
+}
+
+/*
+ * Notes refer to their company by a shared pointer and to their user
+ * lazily, both of which should be the same object for all of them.
+ */
+static void
+test_lazy(struct kwbp *sql, int64_t cid, int64_t uid)
+{
+	struct note_q	*q;
+	struct note	*n, *first, ret;
+	size_t		 i = 0;
+
+	if (db_note_insert(sql, uid, cid, "one") <= 0 ||
+	    db_note_insert(sql, uid, cid, "two") <= 0)
+		errx(EXIT_FAILURE, "db_note_insert");
+
+	/* Shared structures are also filled by _ret. */
+
+	if ( ! db_note_insert_ret(sql, &ret, uid, cid, "three") ||
+	    NULL == ret.company || cid != ret.company->id ||
+	    NULL != ret.user)
+		errx(EXIT_FAILURE, "db_note_insert_ret");
+	db_note_unfill(&ret);
+
+	q = db_note_list_bycompany(sql, cid);
+	first = TAILQ_FIRST(q);
+	TAILQ_FOREACH(n, q, _entries) {
+		if (NULL == n->company || 
+		    n->company != first->company ||
+		    strcmp(n->company->name, "foo bar"))
+			errx(EXIT_FAILURE, "db_note_list_bycompany "
+				"(shared)");
+		if (NULL != n->user)
+			errx(EXIT_FAILURE, "db_note_list_bycompany "
+				"(lazy)");
+		i++;
+	}
+	if (3 != i)
+		errx(EXIT_FAILURE, "db_note_list_bycompany");
+
+	db_note_load_user_q(sql, q);
+	TAILQ_FOREACH(n, q, _entries)
+		if (NULL == n->user || uid != n->user->uid ||
+		    n->user != first->user)
+			errx(EXIT_FAILURE, "db_note_load_user_q");
+	if (db_note_load_user(sql, first) != first->user)
+		errx(EXIT_FAILURE, "db_note_load_user");
+
+	/* The company is freed with the last note referring to it. */
+
+	db_note_freeq(q);
+	db_unload(sql);
+}
+
+/*
+ * Writes from any handle must invalidate the row cache of another, and
+ * for handles sharing a cache, the shared rows.
+ */
+static void
+test_cache(struct kwbp *sql, int64_t uid)
+{
+	struct kwbp	*h, *k;
+	struct user	*u;
+
+	if (NULL == (h = db_open("db.db")))
+		errx(EXIT_FAILURE, "db.db");
+	if (NULL == (u = db_user_get_by_uid_eq(sql, uid)))
+		errx(EXIT_FAILURE, "db_user_get_by_uid_eq");
+	db_user_free(u);
+	if ( ! db_user_update_email_by_uid_eq(h, "bar@foo.com", uid))
+		errx(EXIT_FAILURE, "db_user_update_email_by_uid_eq");
+	if (NULL == (u = db_user_get_by_uid_eq(sql, uid)) ||
+	    strcmp(u->email, "bar@foo.com"))
+		errx(EXIT_FAILURE, "db_user_get_by_uid_eq (stale)");
+	db_user_free(u);
+
+	unlink("test.shm");
+	if (NULL == (k = db_open("db.db")))
+		errx(EXIT_FAILURE, "db.db");
+	if ( ! db_shm_attach(h, "test.shm") ||
+	    ! db_shm_attach(k, "test.shm"))
+		errx(EXIT_FAILURE, "db_shm_attach");
+	if (NULL == (u = db_user_get_by_uid_eq(k, uid)))
+		errx(EXIT_FAILURE, "db_user_get_by_uid_eq (shared)");
+	db_user_free(u);
+	if ( ! db_user_update_email_by_uid_eq(h, "foo@foo.com", uid))
+		errx(EXIT_FAILURE, "db_user_update_email_by_uid_eq");
+	if (NULL == (u = db_user_get_by_uid_eq(k, uid)) ||
+	    strcmp(u->email, "foo@foo.com"))
+		errx(EXIT_FAILURE, "db_user_get_by_uid_eq "
+			"(stale shared)");
+	db_user_free(u);
+
+	db_close(k);
+	db_close(h);
+	unlink("test.shm");
+}
+
+/*
+ * Writes give up once the database has been locked by another handle
+ * for longer than the busy timeout, without exiting.
+ */
+static void
+test_busy(struct kwbp *sql, int64_t uid)
+{
+	struct kwbp	*h;
+#ifdef DB_SQLITE
+	struct kwbp_busystats st;
+#endif
+
+	if (NULL == (h = db_open("db.db")))
+		errx(EXIT_FAILURE, "db.db");
+	if ( ! db_trans_open_write(h) ||
+	    db_session_insert(h, uid, 1, 0) <= 0)
+		errx(EXIT_FAILURE, "db_trans_open_write");
+
+	db_busy_timeout(sql, 100);
+	if (-2 != db_session_insert(sql, uid, 2, 0) ||
+	    ! db_busy_expired(sql))
+		errx(EXIT_FAILURE, "db_session_insert (busy)");
+#ifdef DB_SQLITE
+	db_busy_stats(sql, &st);
+	if (0 == st.timeouts)
+		errx(EXIT_FAILURE, "db_busy_stats");
+#endif
+
+	if ( ! db_trans_rollback(h))
+		errx(EXIT_FAILURE, "db_trans_rollback");
+	if (db_session_insert(sql, uid, 2, 0) <= 0 ||
+	    db_busy_expired(sql))
+		errx(EXIT_FAILURE, "db_session_insert (unlocked)");
+	db_busy_timeout(sql, 5000);
+	db_close(h);
+}
+
+static int
+deadline_cb(const struct session *s, void *arg)
+{
+	size_t	*n = arg;
+
+	/* Run the deadline out on the first result. */
+
+	if (0 == (*n)++)
+		usleep(20000);
+	return(0);
+}
+
+/*
+ * A search running out its deadline is interrupted.
+ * Deadlines are only enforced with DB_SQLITE (see kwebapp(1)),
+ * otherwise the search runs to completion.
+ */
+static void
+test_deadline(struct kwbp *sql, int64_t uid)
+{
+	struct session	 v[2000];
+	size_t		 i, n;
+	int		 rc;
+
+	memset(v, 0, sizeof(v));
+	for (i = 0; i < 2000; i++) {
+		v[i].userid = uid;
+		v[i].token = i;
+		v[i].mtime = 1;
+	}
+	if ( ! db_session_insert_many(sql, v, 2000, NULL))
+		errx(EXIT_FAILURE, "db_session_insert_many");
+
+	db_deadline(sql, 10);
+	n = 0;
+	rc = db_session_iterate_foo(sql, deadline_cb, &n, "foo bar", 1);
+#ifdef DB_SQLITE
+	if (0 != rc || ! db_deadline_expired(sql) || n >= 2000)
+		errx(EXIT_FAILURE, "db_session_iterate_foo (deadline)");
+#else
+	if (0 == rc || db_deadline_expired(sql) || 2000 != n)
+		errx(EXIT_FAILURE, "db_session_iterate_foo (deadline)");
+#endif
+
+	db_deadline(sql, 0);
+	n = 0;
+	rc = db_session_iterate_foo(sql, deadline_cb, &n, "foo bar", 1);
+	if (0 == rc || db_deadline_expired(sql) || 2000 != n)
+		errx(EXIT_FAILURE, "db_session_iterate_foo");
+}
+
 int
 main(void)
 {
-	struct ksql	*sql;
+	struct kwbp	*sql;
 	int64_t		 cid, uid, nuid, val = 1;
 	struct user	*u, *u2, *u3;
 	const char	*buf = "hello there";
@@ -126,8 +445,16 @@ main(void)
 	db_user_free(u2);
 	db_user_free(u3);
 
+	test_page(sql, cid);
+	test_upsert(sql, cid);
+	test_many(sql, uid);
+	test_lazy(sql, cid, uid);
+	test_cache(sql, uid);
+	test_busy(sql, uid);
+	test_deadline(sql, uid);
+
 	/* That's it!  Close up shop. */
 
 	db_close(sql);
-	return(EXIT_FAILURE);
+	return(EXIT_SUCCESS);
 }